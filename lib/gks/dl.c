@@ -1,6 +1,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "gks.h"
 #include "gkscore.h"
@@ -22,9 +23,21 @@
 #endif
 
 static void reallocate(gks_display_list_t *d, int len)
+/*
+   Grow the display list geometrically so that recording n bytes costs
+   O(n) copying in total. Consumers (socket, Qt, GL, ...) rely on the
+   display list being one contiguous buffer, so it is never split.
+ */
 {
-  while (d->nbytes + len > d->size) d->size += SEGM_SIZE;
+  size_t size = d->size > 0 ? (size_t)d->size : SEGM_SIZE;
+  size_t needed = (size_t)d->nbytes + (size_t)len;
+
+  if (needed >= INT_MAX) gks_fatal_error("display list exceeds maximum size");
+
+  while (needed > size) size *= 2;
+  if (size >= INT_MAX) size = INT_MAX - 1;
 
+  d->size = (int)size;
   d->buffer = (char *)gks_realloc(d->buffer, d->size + 1);
 }
 
@@ -37,8 +50,8 @@ static int purge(gks_display_list_t *d, char *t)
   char *s;
   int i;
   int sp = 0, tp = 0, *len, fctid;
-  static const char *attribute_buffer[MAX_ATTRIBUTE_FCTID + 1];
-  static const char *color_buffer[MAX_COLOR];
+  static GKS_THREAD_LOCAL const char *attribute_buffer[MAX_ATTRIBUTE_FCTID + 1];
+  static GKS_THREAD_LOCAL const char *color_buffer[MAX_COLOR];
   memset(attribute_buffer, 0, sizeof(char *) * (MAX_ATTRIBUTE_FCTID + 1));
   memset(color_buffer, 0, sizeof(char *) * MAX_COLOR);
 
@@ -11,7 +11,7 @@
 #include "gkscore.h"
 
 char *gks_a_error_info = NULL; /* for compatibility with GLI/GKS */
-int gks_errno = 0;
+GKS_THREAD_LOCAL int gks_errno = 0;
 FILE *gks_a_error_file = NULL;
 
 void gks_perror(const char *format, ...)
@@ -242,6 +242,12 @@ const char *gks_function_name(int routine)
     case 110:
       name = "INQ_TEXT";
       break;
+    case 111:
+      name = "SEEK_FRAME";
+      break;
+    case 112:
+      name = "INQ_NUM_FRAMES";
+      break;
     case 200:
       name = "SET_TEXT_SLANT";
       break;
@@ -461,6 +467,9 @@ void gks_report_error(int routine, int errnum)
       message = "Item type is not a valid GKS item in\
  routine %s";
       break;
+    case 165:
+      message = "Metafile frame number is invalid in routine %s";
+      break;
     case 401:
       message = "Dimensions of image are invalid in routine %s";
       break;
@@ -17,7 +17,7 @@
 #define MAXPATHLEN 1024
 #endif
 
-static int font_cache[95], bufcache[95][256], gks = -1;
+static GKS_THREAD_LOCAL int font_cache[95], bufcache[95][256], gks = -1;
 
 int gks_open_font(void)
 {
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #if defined(_WIN32)
 #include <windows.h>
@@ -91,21 +92,21 @@ static const FT_String *gks_font_list_ttf[] = {
 
 static char gks_font_list_user_defined[MAX_NUM_USER_FONTS][MAXPATHLEN];
 
-static FT_Face font_face_cache_pfb[] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                                        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                                        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+static GKS_THREAD_LOCAL FT_Face font_face_cache_pfb[] = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
 
-static FT_Face font_face_cache_ttf[] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                                        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-                                        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+static GKS_THREAD_LOCAL FT_Face font_face_cache_ttf[] = {
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
 
-static FT_Face font_face_cache_user_defined[MAX_NUM_USER_FONTS] = {0};
+static GKS_THREAD_LOCAL FT_Face font_face_cache_user_defined[MAX_NUM_USER_FONTS] = {0};
 
 /* TODO: Add fallback fonts for non-Latin languages */
 static const char *fallback_font_list[] = {NULL};
 static int fallback_font_reference_list[] = {232};
 
-static FT_Face fallback_font_faces[] = {NULL};
+static GKS_THREAD_LOCAL FT_Face fallback_font_faces[] = {NULL};
 static const unsigned int NUM_FALLBACK_FACES = sizeof(fallback_font_faces) / sizeof(fallback_font_faces[0]);
 
 static const int map[] = {22, 9,  5, 14, 18, 26, 13, 1, 24, 11, 7, 16, 20, 28, 13, 3,
@@ -115,18 +116,21 @@ static const double caps[] = {0.662, 0.653, 0.676, 0.669, 0.718, 0.718, 0.718, 0
                               0.562, 0.667, 0.681, 0.681, 0.681, 0.681, 0.722, 0.722, 0.722, 0.722, 0.740,
                               0.740, 0.740, 0.740, 0.692, 0.692, 0.681, 0.681, 0.587, 0.692};
 
-static FT_Bool init = 0;
-static FT_Library library;
+/* FreeType objects must not be shared between threads, so every thread
+   initializes a library instance and face caches of its own */
 
-double horiAdvance = 0, vertAdvance = 0;
+static GKS_THREAD_LOCAL FT_Bool init = 0;
+static GKS_THREAD_LOCAL FT_Library library;
 
-static unsigned int npoints = 0, maxpoints = 0;
-static double *xpoint = NULL, *ypoint = NULL;
+GKS_THREAD_LOCAL double horiAdvance = 0, vertAdvance = 0;
 
-static int num_opcodes = 0;
-static int *opcodes = NULL;
+static GKS_THREAD_LOCAL unsigned int npoints = 0, maxpoints = 0;
+static GKS_THREAD_LOCAL double *xpoint = NULL, *ypoint = NULL;
 
-static long pen_x = 0;
+static GKS_THREAD_LOCAL int num_opcodes = 0;
+static GKS_THREAD_LOCAL int *opcodes = NULL;
+
+static GKS_THREAD_LOCAL long pen_x = 0;
 
 static const char *system_font_directories[] = {
 #if defined(_WIN32)
@@ -153,8 +157,9 @@ static const char *user_font_directories[] = {
 #endif
 };
 
+struct ft_glyph_t;
 static FT_Error set_glyph(FT_Face face, FT_UInt codepoint, FT_UInt *previous, FT_Vector *pen, FT_Bool vertical,
-                          FT_Matrix *rotation, FT_Vector *bearing, FT_Int halign, FT_GlyphSlot *glyph_slot_ptr);
+                          FT_Matrix *rotation, FT_Vector *bearing, FT_Int halign, struct ft_glyph_t **glyph_ptr);
 static void gks_ft_init_fallback_faces();
 static void utf_to_unicode(FT_Bytes str, FT_UInt *unicode_string, FT_UInt *length);
 static FT_Long ft_min(FT_Long a, FT_Long b);
@@ -405,12 +410,232 @@ DLLEXPORT void gks_ft_inq_bearing_x_direction(int *direction)
   *direction = gks_ft_bearing_x_direction;
 }
 
+/* Glyph cache
+ *
+ * Rendered glyph bitmaps and decomposed glyph outlines are kept in a hash table with LRU eviction, so repeated strings
+ * (e.g. tick labels) do not have to be loaded, rasterized or decomposed by FreeType again. Bitmap entries are keyed by
+ * face, glyph index, scaled size, transformation matrix and layout direction; outline entries are loaded unscaled and
+ * are therefore keyed by face and codepoint only. The memory budget can be set with gks_ft_set_glyph_cache_size() or
+ * the GKS_FT_CACHE_SIZE environment variable (in bytes, 0 disables caching). Like the cache itself, the budget is
+ * private to each thread; gks_ft_set_glyph_cache_size() only affects the calling thread. */
+
+#define GLYPH_CACHE_BITMAP 0
+#define GLYPH_CACHE_OUTLINE 1
+#define GLYPH_CACHE_BUCKETS 4096
+#define GLYPH_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+
+typedef struct ft_glyph_t
+{
+  int kind;
+  FT_Face face;
+  FT_UInt index;
+  FT_Bool vertical;
+  FT_Fixed x_scale, y_scale;
+  FT_Matrix transform;
+  unsigned long hash;
+
+  FT_Glyph_Metrics metrics;
+  FT_Vector advance;
+  FT_Bitmap bitmap;
+  FT_Int bitmap_left, bitmap_top;
+  long *points;
+  int num_points;
+  int *codes;
+  int num_codes;
+
+  size_t size;
+  struct ft_glyph_t *next, *older, *newer;
+} ft_glyph_t;
+
+static GKS_THREAD_LOCAL ft_glyph_t *glyph_cache[GLYPH_CACHE_BUCKETS];
+static GKS_THREAD_LOCAL ft_glyph_t *glyph_cache_newest = NULL, *glyph_cache_oldest = NULL;
+static GKS_THREAD_LOCAL size_t glyph_cache_used = 0;
+static GKS_THREAD_LOCAL size_t glyph_cache_limit = GLYPH_CACHE_DEFAULT_SIZE;
+static GKS_THREAD_LOCAL unsigned long glyph_cache_hits = 0, glyph_cache_misses = 0;
+
+static unsigned long glyph_hash(int kind, FT_Face face, FT_UInt index, FT_Bool vertical, FT_Fixed x_scale,
+                                FT_Fixed y_scale, const FT_Matrix *transform)
+{
+  unsigned long hash = 2166136261UL;
+
+#define HASH_VALUE(value) hash = ((hash ^ (unsigned long)(value)) * 16777619UL) & 0xffffffffUL
+  HASH_VALUE(kind);
+  HASH_VALUE((size_t)face);
+  HASH_VALUE(index);
+  HASH_VALUE(vertical);
+  HASH_VALUE(x_scale);
+  HASH_VALUE(y_scale);
+  HASH_VALUE(transform->xx);
+  HASH_VALUE(transform->xy);
+  HASH_VALUE(transform->yx);
+  HASH_VALUE(transform->yy);
+#undef HASH_VALUE
+
+  return hash;
+}
+
+static void glyph_cache_touch(ft_glyph_t *glyph)
+{
+  if (glyph == glyph_cache_newest) return;
+
+  if (glyph->older) glyph->older->newer = glyph->newer;
+  if (glyph->newer) glyph->newer->older = glyph->older;
+  if (glyph == glyph_cache_oldest) glyph_cache_oldest = glyph->newer;
+
+  glyph->older = glyph_cache_newest;
+  glyph->newer = NULL;
+  if (glyph_cache_newest) glyph_cache_newest->newer = glyph;
+  glyph_cache_newest = glyph;
+  if (!glyph_cache_oldest) glyph_cache_oldest = glyph;
+}
+
+static ft_glyph_t *glyph_cache_lookup(int kind, FT_Face face, FT_UInt index, FT_Bool vertical, FT_Fixed x_scale,
+                                      FT_Fixed y_scale, const FT_Matrix *transform, unsigned long hash)
+{
+  ft_glyph_t *glyph;
+
+  for (glyph = glyph_cache[hash % GLYPH_CACHE_BUCKETS]; glyph; glyph = glyph->next)
+    {
+      if (glyph->hash == hash && glyph->kind == kind && glyph->face == face && glyph->index == index &&
+          glyph->vertical == vertical && glyph->x_scale == x_scale && glyph->y_scale == y_scale &&
+          glyph->transform.xx == transform->xx && glyph->transform.xy == transform->xy &&
+          glyph->transform.yx == transform->yx && glyph->transform.yy == transform->yy)
+        {
+          glyph_cache_hits++;
+          glyph_cache_touch(glyph);
+          return glyph;
+        }
+    }
+  glyph_cache_misses++;
+
+  return NULL;
+}
+
+static void glyph_cache_remove(ft_glyph_t *glyph)
+{
+  ft_glyph_t **link = &glyph_cache[glyph->hash % GLYPH_CACHE_BUCKETS];
+
+  while (*link != glyph) link = &(*link)->next;
+  *link = glyph->next;
+
+  if (glyph->older) glyph->older->newer = glyph->newer;
+  if (glyph->newer) glyph->newer->older = glyph->older;
+  if (glyph == glyph_cache_oldest) glyph_cache_oldest = glyph->newer;
+  if (glyph == glyph_cache_newest) glyph_cache_newest = glyph->older;
+
+  glyph_cache_used -= glyph->size;
+  if (glyph->bitmap.buffer) gks_free(glyph->bitmap.buffer);
+  if (glyph->points) gks_free(glyph->points);
+  if (glyph->codes) gks_free(glyph->codes);
+  gks_free(glyph);
+}
+
+/* evict least recently used glyphs until the cache fits into its budget, but always keep the newest entry as it might
+ * still be in use by the caller */
+static void glyph_cache_trim(void)
+{
+  while (glyph_cache_used > glyph_cache_limit && glyph_cache_oldest && glyph_cache_oldest != glyph_cache_newest)
+    {
+      glyph_cache_remove(glyph_cache_oldest);
+    }
+}
+
+static ft_glyph_t *glyph_cache_insert(int kind, FT_Face face, FT_UInt index, FT_Bool vertical, FT_Fixed x_scale,
+                                      FT_Fixed y_scale, const FT_Matrix *transform, unsigned long hash)
+{
+  ft_glyph_t *glyph = (ft_glyph_t *)gks_malloc(sizeof(ft_glyph_t));
+
+  glyph->kind = kind;
+  glyph->face = face;
+  glyph->index = index;
+  glyph->vertical = vertical;
+  glyph->x_scale = x_scale;
+  glyph->y_scale = y_scale;
+  glyph->transform = *transform;
+  glyph->hash = hash;
+  glyph->bitmap.buffer = NULL;
+  glyph->points = NULL;
+  glyph->num_points = 0;
+  glyph->codes = NULL;
+  glyph->num_codes = 0;
+  glyph->size = sizeof(ft_glyph_t);
+
+  glyph->older = glyph->newer = NULL;
+  glyph->next = glyph_cache[hash % GLYPH_CACHE_BUCKETS];
+  glyph_cache[hash % GLYPH_CACHE_BUCKETS] = glyph;
+  glyph_cache_touch(glyph);
+  glyph_cache_used += glyph->size;
+
+  return glyph;
+}
+
+static void glyph_cache_clear(void)
+{
+  while (glyph_cache_oldest) glyph_cache_remove(glyph_cache_oldest);
+}
+
+DLLEXPORT void gks_ft_set_glyph_cache_size(size_t size)
+{
+  glyph_cache_limit = size;
+  glyph_cache_trim();
+  if (glyph_cache_limit == 0) glyph_cache_clear();
+}
+
+DLLEXPORT void gks_ft_inq_glyph_cache_stats(unsigned long *hits, unsigned long *misses, size_t *used, size_t *size)
+{
+  *hits = glyph_cache_hits;
+  *misses = glyph_cache_misses;
+  *used = glyph_cache_used;
+  *size = glyph_cache_limit;
+}
+
+/* get the rendered bitmap of a glyph using the current size and transformation of the face */
+static ft_glyph_t *get_glyph_bitmap(FT_Face face, FT_UInt glyph_index, FT_Bool vertical, const FT_Matrix *transform)
+{
+  FT_Error error;
+  FT_GlyphSlot slot;
+  ft_glyph_t *glyph;
+  size_t buffer_size;
+  unsigned long hash;
+  FT_Fixed x_scale = face->size->metrics.x_scale, y_scale = face->size->metrics.y_scale;
+
+  hash = glyph_hash(GLYPH_CACHE_BITMAP, face, glyph_index, vertical, x_scale, y_scale, transform);
+  glyph = glyph_cache_lookup(GLYPH_CACHE_BITMAP, face, glyph_index, vertical, x_scale, y_scale, transform, hash);
+  if (glyph) return glyph;
+
+  error = FT_Load_Glyph(face, glyph_index, vertical ? FT_LOAD_VERTICAL_LAYOUT : FT_LOAD_DEFAULT);
+  if (error) return NULL;
+  error = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
+  if (error) return NULL;
+
+  slot = face->glyph;
+  glyph = glyph_cache_insert(GLYPH_CACHE_BITMAP, face, glyph_index, vertical, x_scale, y_scale, transform, hash);
+  glyph->metrics = slot->metrics;
+  glyph->advance = slot->advance;
+  glyph->bitmap = slot->bitmap;
+  glyph->bitmap.buffer = NULL;
+  glyph->bitmap_left = slot->bitmap_left;
+  glyph->bitmap_top = slot->bitmap_top;
+
+  buffer_size = (size_t)abs(slot->bitmap.pitch) * slot->bitmap.rows;
+  if (buffer_size > 0)
+    {
+      glyph->bitmap.buffer = (unsigned char *)gks_malloc(buffer_size);
+      memcpy(glyph->bitmap.buffer, slot->bitmap.buffer, buffer_size);
+    }
+  glyph->size += buffer_size;
+  glyph_cache_used += buffer_size;
+  glyph_cache_trim();
+
+  return glyph;
+}
+
 /* load a glyph into the slot and compute bearing */
 static FT_Error set_glyph(FT_Face face, FT_UInt codepoint, FT_UInt *previous, FT_Vector *pen, FT_Bool vertical,
-                          FT_Matrix *rotation, FT_Vector *bearing, FT_Int halign, FT_GlyphSlot *glyph_slot_ptr)
+                          FT_Matrix *rotation, FT_Vector *bearing, FT_Int halign, ft_glyph_t **glyph_ptr)
 {
-  FT_Error error;
   FT_UInt glyph_index;
+  ft_glyph_t *glyph;
 
   glyph_index = FT_Get_Char_Index(face, codepoint);
   if (FT_HAS_KERNING(face) && !FT_IS_FIXED_WIDTH(face) && *previous && !vertical && glyph_index)
@@ -445,44 +670,37 @@ static FT_Error set_glyph(FT_Face face, FT_UInt codepoint, FT_UInt *previous, FT
     {
       gks_perror("glyph missing from current font: %d", codepoint);
     }
-  error = FT_Load_Glyph(face, glyph_index, vertical ? FT_LOAD_VERTICAL_LAYOUT : FT_LOAD_DEFAULT);
-  if (error)
+  glyph = get_glyph_bitmap(face, glyph_index, vertical, rotation);
+  if (!glyph)
     {
-      gks_perror("glyph could not be loaded: %d", codepoint);
+      gks_perror("glyph could not be rendered: %d", codepoint);
       return 1;
     }
-  *glyph_slot_ptr = face->glyph;
+  *glyph_ptr = glyph;
 
-  error = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL);
-  if (error)
-    {
-      gks_perror("glyph could not be rendered: %c", codepoint);
-      return 1;
-    }
-
-  bearing->x = FT_IS_FIXED_WIDTH(face) ? 0 : face->glyph->metrics.horiBearingX;
+  bearing->x = FT_IS_FIXED_WIDTH(face) ? 0 : glyph->metrics.horiBearingX;
   bearing->y = 0;
   if (vertical)
     {
       if (halign == GKS_K_TEXT_HALIGN_RIGHT)
         {
-          bearing->x += face->glyph->metrics.width;
+          bearing->x += glyph->metrics.width;
         }
       else if (halign == GKS_K_TEXT_HALIGN_CENTER)
         {
-          bearing->x += face->glyph->metrics.width / 2;
+          bearing->x += glyph->metrics.width / 2;
         }
       if (bearing->x != 0) FT_Vector_Transform(bearing, rotation);
-      bearing->x = 64 * face->glyph->bitmap_left - bearing->x;
-      bearing->y = 64 * face->glyph->bitmap_top - bearing->y;
+      bearing->x = 64 * glyph->bitmap_left - bearing->x;
+      bearing->y = 64 * glyph->bitmap_top - bearing->y;
     }
   else
     {
       if (bearing->x != 0) FT_Vector_Transform(bearing, rotation);
       pen->x += gks_ft_bearing_x_direction * bearing->x;
       pen->y -= bearing->y;
-      bearing->x = 64 * face->glyph->bitmap_left;
-      bearing->y = 64 * face->glyph->bitmap_top;
+      bearing->x = 64 * glyph->bitmap_left;
+      bearing->y = 64 * glyph->bitmap_top;
     }
   return 0;
 }
@@ -570,7 +788,10 @@ static void utf_to_unicode(FT_Bytes str, FT_UInt *unicode_string, FT_UInt *lengt
 int gks_ft_init(void)
 {
   FT_Error error;
+  const char *cache_size;
   if (init) return 0;
+  cache_size = gks_getenv("GKS_FT_CACHE_SIZE");
+  if (cache_size != NULL) glyph_cache_limit = (size_t)atol(cache_size);
   error = FT_Init_FreeType(&library);
   if (error)
     {
@@ -588,9 +809,30 @@ void gks_ft_terminate(void)
 {
   if (init)
     {
+      glyph_cache_clear();
       FT_Done_FreeType(library);
+
+      /* the faces have been discarded together with the library */
+      memset(font_face_cache_pfb, 0, sizeof(font_face_cache_pfb));
+      memset(font_face_cache_ttf, 0, sizeof(font_face_cache_ttf));
+      memset(font_face_cache_user_defined, 0, sizeof(font_face_cache_user_defined));
+      memset(fallback_font_faces, 0, sizeof(fallback_font_faces));
     }
   init = 0;
+
+  if (xpoint != NULL)
+    {
+      free(xpoint);
+      free(ypoint);
+      xpoint = ypoint = NULL;
+    }
+  npoints = maxpoints = 0;
+  if (opcodes != NULL)
+    {
+      free(opcodes);
+      opcodes = NULL;
+    }
+  num_opcodes = 0;
 }
 
 static int gks_ft_convert_textfont(int textfont)
@@ -750,6 +992,12 @@ void *gks_ft_get_face(int textfont)
 
   if (user_defined)
     {
+      if (font_face_cache_user_defined[textfont] == NULL && *gks_font_list_user_defined[textfont])
+        {
+          /* the font has been loaded by another thread */
+          if (FT_New_Face(library, gks_font_list_user_defined[textfont], 0, &face) == 0)
+            font_face_cache_user_defined[textfont] = face;
+        }
       if (font_face_cache_user_defined[textfont] != NULL)
         {
           return (void *)font_face_cache_user_defined[textfont];
@@ -953,7 +1201,7 @@ unsigned char *gks_ft_get_bitmap(int *x, int *y, int *width, int *height, gks_st
                                  int length)
 {
   FT_Face face;                /* font face */
-  FT_GlyphSlot glyph_slot;     /* glyph slot (might be in a fallback face) */
+  ft_glyph_t *glyph;           /* cached glyph (might be from a fallback face) */
   FT_Vector pen;               /* glyph position */
   FT_BBox bb;                  /* bounding box */
   FT_Vector bearing;           /* individual glyph translation */
@@ -1054,6 +1302,8 @@ unsigned char *gks_ft_get_bitmap(int *x, int *y, int *width, int *height, gks_st
     }
   else
     {
+      rotation.xx = rotation.yy = 0x10000L;
+      rotation.xy = rotation.yx = 0;
       FT_Set_Transform(face, NULL, NULL);
       for (i = 0; i < NUM_FALLBACK_FACES; i++)
         {
@@ -1111,23 +1361,23 @@ unsigned char *gks_ft_get_bitmap(int *x, int *y, int *width, int *height, gks_st
     {
       codepoint = unicode_string[i];
 
-      error = set_glyph(face, codepoint, &previous, &pen, vertical, &rotation, &bearing, halign, &glyph_slot);
+      error = set_glyph(face, codepoint, &previous, &pen, vertical, &rotation, &bearing, halign, &glyph);
       if (error) continue;
 
       bb.xMin = ft_min(bb.xMin, pen.x + bearing.x);
-      bb.xMax = ft_max(bb.xMax, pen.x + bearing.x + 64 * glyph_slot->bitmap.width);
-      bb.yMin = ft_min(bb.yMin, pen.y + bearing.y - 64 * glyph_slot->bitmap.rows);
+      bb.xMax = ft_max(bb.xMax, pen.x + bearing.x + 64 * glyph->bitmap.width);
+      bb.yMin = ft_min(bb.yMin, pen.y + bearing.y - 64 * glyph->bitmap.rows);
       bb.yMax = ft_max(bb.yMax, pen.y + bearing.y);
 
       if (direction == GKS_K_TEXT_PATH_DOWN)
         {
-          pen.x -= glyph_slot->advance.x + spacing.x;
-          pen.y -= glyph_slot->advance.y + spacing.y;
+          pen.x -= glyph->advance.x + spacing.x;
+          pen.y -= glyph->advance.y + spacing.y;
         }
       else
         {
-          pen.x += glyph_slot->advance.x + spacing.x;
-          pen.y += glyph_slot->advance.y + spacing.y;
+          pen.x += glyph->advance.x + spacing.x;
+          pen.y += glyph->advance.y + spacing.y;
         }
     }
 
@@ -1202,12 +1452,12 @@ unsigned char *gks_ft_get_bitmap(int *x, int *y, int *width, int *height, gks_st
       codepoint = unicode_string[i];
 
       bearing.x = bearing.y = 0;
-      error = set_glyph(face, codepoint, &previous, &pen, vertical, &rotation, &bearing, halign, &glyph_slot);
+      error = set_glyph(face, codepoint, &previous, &pen, vertical, &rotation, &bearing, halign, &glyph);
       if (error) continue;
 
       pos_x = (pen.x + bearing.x - bb.xMin) / 64;
       pos_y = (-pen.y - bearing.y + bb.yMax) / 64;
-      ftbitmap = glyph_slot->bitmap;
+      ftbitmap = glyph->bitmap;
       for (j = 0; j < (unsigned int)ftbitmap.rows; j++)
         {
           for (k = 0; k < (unsigned int)ftbitmap.width; k++)
@@ -1226,13 +1476,13 @@ unsigned char *gks_ft_get_bitmap(int *x, int *y, int *width, int *height, gks_st
 
       if (direction == GKS_K_TEXT_PATH_DOWN)
         {
-          pen.x -= glyph_slot->advance.x + spacing.x;
-          pen.y -= glyph_slot->advance.y + spacing.y;
+          pen.x -= glyph->advance.x + spacing.x;
+          pen.y -= glyph->advance.y + spacing.y;
         }
       else
         {
-          pen.x += glyph_slot->advance.x + spacing.x;
-          pen.y += glyph_slot->advance.y + spacing.y;
+          pen.x += glyph->advance.x + spacing.x;
+          pen.y += glyph->advance.y + spacing.y;
         }
     }
   gks_free(unicode_string);
@@ -1291,13 +1541,16 @@ static void reallocate(unsigned int npoints)
   opcodes = (int *)xrealloc(opcodes, maxpoints * sizeof(int));
 }
 
-static void load_glyph(FT_Face face, FT_UInt code)
+static FT_Error load_glyph(FT_Face face, FT_UInt code)
 {
   FT_Error error;
   FT_UInt glyph_index = FT_Get_Char_Index(face, code);
   if (!glyph_index) gks_perror("glyph missing from current font: %d", code);
+  /* outlines are transformed by the caller, so discard any transformation left over from rendering bitmaps */
+  FT_Set_Transform(face, NULL, NULL);
   error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE | FT_LOAD_NO_BITMAP);
   if (error) gks_perror("could not load glyph: %d\n", glyph_index);
+  return error;
 }
 
 static void add_point(long x, long y)
@@ -1308,68 +1561,119 @@ static void add_point(long x, long y)
   npoints += 1;
 }
 
+static void add_outline_point(ft_glyph_t *glyph, const FT_Vector *point)
+{
+  glyph->points[2 * glyph->num_points] = point->x;
+  glyph->points[2 * glyph->num_points + 1] = point->y;
+  glyph->num_points += 1;
+}
+
 static int move_to(const FT_Vector *to, void *user)
 {
-  GKS_UNUSED(user);
-  add_point(to->x, to->y);
-  opcodes[num_opcodes++] = (int)'M';
+  ft_glyph_t *glyph = (ft_glyph_t *)user;
+  add_outline_point(glyph, to);
+  glyph->codes[glyph->num_codes++] = (int)'M';
   return 0;
 }
 
 static int line_to(const FT_Vector *to, void *user)
 {
-  GKS_UNUSED(user);
-  add_point(to->x, to->y);
-  opcodes[num_opcodes++] = (int)'L';
+  ft_glyph_t *glyph = (ft_glyph_t *)user;
+  add_outline_point(glyph, to);
+  glyph->codes[glyph->num_codes++] = (int)'L';
   return 0;
 }
 
 static int conic_to(const FT_Vector *control, const FT_Vector *to, void *user)
 {
-  GKS_UNUSED(user);
-  add_point(control->x, control->y);
-  add_point(to->x, to->y);
-  opcodes[num_opcodes++] = (int)'Q';
+  ft_glyph_t *glyph = (ft_glyph_t *)user;
+  add_outline_point(glyph, control);
+  add_outline_point(glyph, to);
+  glyph->codes[glyph->num_codes++] = (int)'Q';
   return 0;
 }
 
 static int cubic_to(const FT_Vector *control1, const FT_Vector *control2, const FT_Vector *to, void *user)
 {
-  GKS_UNUSED(user);
-  add_point(control1->x, control1->y);
-  add_point(control2->x, control2->y);
-  add_point(to->x, to->y);
-  opcodes[num_opcodes++] = (int)'C';
+  ft_glyph_t *glyph = (ft_glyph_t *)user;
+  add_outline_point(glyph, control1);
+  add_outline_point(glyph, control2);
+  add_outline_point(glyph, to);
+  glyph->codes[glyph->num_codes++] = (int)'C';
   return 0;
 }
 
-static void get_outline(FT_Face face, FT_UInt charcode, FT_Bool first, FT_Bool last)
+/* get the decomposed (unscaled) outline of a glyph */
+static ft_glyph_t *get_glyph_outline(FT_Face face, FT_UInt code)
 {
+  static const FT_Matrix identity = {0x10000L, 0, 0, 0x10000L};
   FT_Outline_Funcs callbacks;
-  FT_GlyphSlot slot;
-  FT_Glyph_Metrics metrics;
-  FT_Outline outline;
+  FT_Outline *outline;
   FT_Error error;
+  ft_glyph_t *glyph;
+  unsigned long hash;
+  size_t max_points;
 
-  callbacks.move_to = move_to;
-  callbacks.line_to = line_to;
-  callbacks.conic_to = conic_to;
-  callbacks.cubic_to = cubic_to;
+  hash = glyph_hash(GLYPH_CACHE_OUTLINE, face, code, 0, 0, 0, &identity);
+  glyph = glyph_cache_lookup(GLYPH_CACHE_OUTLINE, face, code, 0, 0, 0, &identity, hash);
+  if (glyph) return glyph;
 
-  callbacks.shift = 0;
-  callbacks.delta = 0;
+  if (load_glyph(face, code)) return NULL;
 
-  slot = face->glyph;
-  outline = slot->outline;
-  metrics = slot->metrics;
+  glyph = glyph_cache_insert(GLYPH_CACHE_OUTLINE, face, code, 0, 0, 0, &identity, hash);
+  glyph->metrics = face->glyph->metrics;
+  glyph->advance = face->glyph->advance;
+  glyph->bitmap_left = glyph->bitmap_top = 0;
+
+  /* every outline point results in at most two path points (conic control point and implied on-curve point), and
+   * every contour adds at most two more points for the start point and the closing segment */
+  outline = &face->glyph->outline;
+  max_points = 2 * (size_t)outline->n_points + 2 * (size_t)outline->n_contours;
+  if (max_points > 0)
+    {
+      glyph->points = (long *)gks_malloc((int)(2 * max_points * sizeof(long)));
+      glyph->codes = (int *)gks_malloc((int)(max_points * sizeof(int)));
+      glyph->size += max_points * (2 * sizeof(long) + sizeof(int));
+      glyph_cache_used += max_points * (2 * sizeof(long) + sizeof(int));
 
-  if (first) pen_x -= metrics.horiBearingX;
+      callbacks.move_to = move_to;
+      callbacks.line_to = line_to;
+      callbacks.conic_to = conic_to;
+      callbacks.cubic_to = cubic_to;
 
-  error = FT_Outline_Decompose(&outline, &callbacks, NULL);
-  if (error) gks_perror("could not extract the outline");
+      callbacks.shift = 0;
+      callbacks.delta = 0;
 
-  if (num_opcodes > 0)
+      error = FT_Outline_Decompose(outline, &callbacks, glyph);
+      if (error) gks_perror("could not extract the outline");
+    }
+  glyph_cache_trim();
+
+  return glyph;
+}
+
+static void get_outline(FT_Face face, FT_UInt charcode, FT_Bool first, FT_Bool last)
+{
+  ft_glyph_t *glyph;
+  int i;
+
+  glyph = get_glyph_outline(face, charcode);
+  if (!glyph) return;
+
+  if (first) pen_x -= glyph->metrics.horiBearingX;
+
+  for (i = 0; i < glyph->num_points; i++)
     {
+      add_point(glyph->points[2 * i], glyph->points[2 * i + 1]);
+    }
+  if (glyph->num_codes > 0)
+    {
+      if ((unsigned int)(num_opcodes + glyph->num_codes + 2) >= maxpoints)
+        {
+          reallocate(num_opcodes + glyph->num_codes + 2);
+        }
+      memcpy(opcodes + num_opcodes, glyph->codes, glyph->num_codes * sizeof(int));
+      num_opcodes += glyph->num_codes;
       opcodes[num_opcodes++] = 'f';
       opcodes[num_opcodes] = '\0';
     }
@@ -1378,11 +1682,11 @@ static void get_outline(FT_Face face, FT_UInt charcode, FT_Bool first, FT_Bool l
     {
       /* Use bearingX + width for the last character so that right-aligned texts are aligned to the bounding box of the
        * last glyph. If the last character is a space use the horiAdvance instead as the width is 0. */
-      pen_x += metrics.horiBearingX + metrics.width;
+      pen_x += glyph->metrics.horiBearingX + glyph->metrics.width;
     }
   else
     {
-      pen_x += metrics.horiAdvance;
+      pen_x += glyph->metrics.horiAdvance;
     }
 }
 
@@ -1461,8 +1765,6 @@ static void process_glyphs(FT_Face face, double x, double y, char *text, double
 
   for (i = 0; i < length; i++)
     {
-      load_glyph(face, unicode_string[i]);
-
       if (i > 0 && FT_HAS_KERNING(face) && !FT_IS_FIXED_WIDTH(face))
         pen_x += get_kerning(face, unicode_string[i - 1], unicode_string[i]);
 
@@ -1613,8 +1915,6 @@ static void process_glyphs3d(FT_Face face, double x, double y, double z, char *t
 
   for (i = 0; i < length; i++)
     {
-      load_glyph(face, unicode_string[i]);
-
       if (i > 0 && FT_HAS_KERNING(face) && !FT_IS_FIXED_WIDTH(face))
         pen_x += get_kerning(face, unicode_string[i - 1], unicode_string[i]);
 
@@ -1857,4 +2157,12 @@ int gks_ft_load_user_font(char *font, int ignore_file_not_found)
   return -1;
 }
 
+void gks_ft_set_glyph_cache_size(size_t size) {}
+
+void gks_ft_inq_glyph_cache_stats(unsigned long *hits, unsigned long *misses, size_t *used, size_t *size)
+{
+  *hits = *misses = 0;
+  *used = *size = 0;
+}
+
 #endif
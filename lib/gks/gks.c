@@ -14,6 +14,14 @@
 #include <unistd.h>
 #endif
 
+#ifdef _MSC_VER
+#define NO_THREADS 1
+#endif
+
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
 #include "gks.h"
 #include "gkscore.h"
 
@@ -32,16 +40,31 @@
 #define OK 0
 #define MAX_POINTS 2048
 
-static gks_state_list_t *s = NULL, *seg_state = NULL;
+struct gks_context_t
+{
+  gks_state_list_t *s, *seg_state;
+  int state, api, id;
+  gks_list_t *open_ws, *active_ws, *av_ws_types;
+  ws_list_t **ws_table;
+  int num_ws_table, max_ws_table;
+};
+
+/* The state of the context that is currently selected in a thread lives in
+   the following thread-local variables. Selecting another context swaps
+   their contents with the ones saved in the context object. */
+
+static GKS_THREAD_LOCAL gks_state_list_t *s = NULL, *seg_state = NULL;
 
-static int state = GKS_K_GKCL, api = 1;
+static GKS_THREAD_LOCAL int state = GKS_K_GKCL, api = 1;
 
-static int i_arr[13];
-static double f_arr_1[6], f_arr_2[6];
-static char c_arr[1];
-static int id = 0;
+static GKS_THREAD_LOCAL int i_arr[13];
+static GKS_THREAD_LOCAL double f_arr_1[6], f_arr_2[6];
+static GKS_THREAD_LOCAL char c_arr[1];
+static GKS_THREAD_LOCAL int id = 0;
 
-static gks_list_t *open_ws = NULL, *active_ws = NULL, *av_ws_types = NULL;
+static GKS_THREAD_LOCAL gks_list_t *open_ws = NULL, *active_ws = NULL, *av_ws_types = NULL;
+
+static GKS_THREAD_LOCAL gks_context_t *current_context = NULL, default_context;
 
 static ws_descr_t ws_types[] = {
     {2, GKS_K_METERS, 1.00000, 1.00000, 65536, 65536, 4, "mf", NULL, "MO"},
@@ -119,18 +142,163 @@ static int gksgral_fill_styles[6] = {7, 7, 1, 8, 8, 2};
 
 static int gddm_fill_styles[6] = {4, 10, 3, 9, 2, 1};
 
-extern int gks_errno;
+extern GKS_THREAD_LOCAL int gks_errno;
+
+static GKS_THREAD_LOCAL double *x = NULL, *y = NULL;
+
+static GKS_THREAD_LOCAL int max_points = 0;
+
+static GKS_THREAD_LOCAL ws_list_t **ws_table = NULL;
+
+static GKS_THREAD_LOCAL int num_ws_table = 0, max_ws_table = 0;
+
+static void gks_drv_null(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_arr_1, double *f_arr_1,
+                         int len_f_arr_2, double *f_arr_2, int len_c_arr, char *c_arr, void **ptr)
+{
+  GKS_UNUSED(fctid);
+  GKS_UNUSED(dx);
+  GKS_UNUSED(dy);
+  GKS_UNUSED(dimx);
+  GKS_UNUSED(i_arr);
+  GKS_UNUSED(len_f_arr_1);
+  GKS_UNUSED(f_arr_1);
+  GKS_UNUSED(len_f_arr_2);
+  GKS_UNUSED(f_arr_2);
+  GKS_UNUSED(len_c_arr);
+  GKS_UNUSED(c_arr);
+  GKS_UNUSED(ptr);
+}
+
+static void gks_drv_unknown(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_arr_1, double *f_arr_1,
+                            int len_f_arr_2, double *f_arr_2, int len_c_arr, char *c_arr, void **ptr)
+{
+  gks_drv_null(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
+  printf("GKS: %s\n", gks_function_name(fctid));
+}
+
+/* driver capabilities */
+#define DRV_PRIMITIVE_LISTS (1 << 0) /* implements GKS_K_GDP_DRAW_POLYLINES and GKS_K_GDP_FILL_AREAS natively */
+
+#ifndef EMSCRIPTEN
+
+static struct
+{
+  int wtype;
+  gks_driver_t driver;
+  int flags;
+} ws_drivers[] = {
+    {2, gks_drv_mo, 0},
+    {3, gks_drv_mi, 0},
+    {5, gks_drv_wiss, 0},
+    {41, gks_drv_win, 0},
+    {61, gks_drv_ps, 0},
+    {62, gks_drv_ps, 0},
+    {63, gks_drv_ps, 0},
+    {64, gks_drv_ps, 0},
+    {100, gks_drv_null, 0},
+    {101, gks_drv_pdf, DRV_PRIMITIVE_LISTS},
+    {102, gks_drv_pdf, DRV_PRIMITIVE_LISTS},
+    {120, gks_video_plugin, 0},
+    {121, gks_video_plugin, 0},
+    {130, gks_video_plugin, 0},
+    {131, gks_video_plugin, 0},
+    {140, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {141, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {142, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {143, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {144, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {145, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {146, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {150, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {151, gks_cairo_plugin, DRV_PRIMITIVE_LISTS},
+    {160, gks_video_plugin, 0},
+    {161, gks_video_plugin, 0},
+    {162, gks_video_plugin, 0},
+    {170, gks_agg_plugin, DRV_PRIMITIVE_LISTS},
+    {171, gks_agg_plugin, DRV_PRIMITIVE_LISTS},
+    {172, gks_agg_plugin, DRV_PRIMITIVE_LISTS},
+    {173, gks_agg_plugin, DRV_PRIMITIVE_LISTS},
+    {210, gks_x11_plugin, 0},
+    {211, gks_x11_plugin, 0},
+    {212, gks_x11_plugin, 0},
+    {213, gks_x11_plugin, 0},
+    {214, gks_x11_plugin, 0},
+    {215, gks_x11_plugin, 0},
+    {216, gks_x11_plugin, 0},
+    {217, gks_x11_plugin, 0},
+    {218, gks_x11_plugin, 0},
+    {301, gks_drv_plugin, 0},
+    {314, gks_pgf_plugin, 0},
+    {320, gks_gs_plugin, 0},
+    {321, gks_gs_plugin, 0},
+    {322, gks_gs_plugin, 0},
+    {323, gks_gs_plugin, 0},
+    {371, gks_gtk_plugin, 0},
+    {380, gks_wx_plugin, 0},
+    {381, gks_qt_plugin, 0},
+    {382, gks_svg_plugin, DRV_PRIMITIVE_LISTS},
+    {390, gks_wmf_plugin, 0},
+    {400, gks_quartz_plugin, 0},
+    {410, gks_drv_socket, 0},
+    {411, gks_drv_socket, 0},
+    {412, gks_drv_socket, 0},
+    {413, gks_drv_socket, 0},
+    {415, gks_zmq_plugin, 0},
+    {420, gks_gl_plugin, 0},
+};
+
+static int num_ws_drivers = sizeof(ws_drivers) / sizeof(ws_drivers[0]);
 
-static double *x = NULL, *y = NULL;
+#endif
 
-static int max_points = 0;
+static gks_driver_t gks_lookup_driver(int wtype, int *flags)
+{
+#ifndef EMSCRIPTEN
+  int i;
+
+  for (i = 0; i < num_ws_drivers; i++)
+    {
+      if (ws_drivers[i].wtype == wtype)
+        {
+          *flags = ws_drivers[i].flags;
+          return ws_drivers[i].driver;
+        }
+    }
+  *flags = 0;
+  return gks_drv_unknown;
+#else
+  GKS_UNUSED(wtype);
+  *flags = 0;
+  return gks_drv_js;
+#endif
+}
+
+static void gks_update_ws_table(void)
+/*
+   Rebuild the flat array of open workstations used by the dispatcher.
+   Must be called whenever the list of open workstations changes.
+ */
+{
+  gks_list_t *list;
+  int n = 0;
+
+  for (list = open_ws; list != NULL; list = list->next) n++;
+
+  if (n > max_ws_table)
+    {
+      max_ws_table = n;
+      ws_table = (ws_list_t **)gks_realloc(ws_table, max_ws_table * sizeof(ws_list_t *));
+    }
+
+  num_ws_table = 0;
+  for (list = open_ws; list != NULL; list = list->next) ws_table[num_ws_table++] = (ws_list_t *)list->ptr;
+}
 
 static void gks_ddlk(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_arr_1, double *f_arr_1, int len_f_arr_2,
                      double *f_arr_2, int len_c_arr, char *c_arr, void **ptr)
 {
-  gks_list_t *list;
   ws_list_t *ws;
-  int have_id;
+  int have_id, i;
 
   switch (fctid)
     {
@@ -153,6 +321,8 @@ static void gks_ddlk(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_
     case REQUEST_STROKE:
     case REQUEST_CHOICE:
     case REQUEST_STRING:
+    case SEEK_FRAME:
+    case INQ_NUM_FRAMES:
       have_id = 1;
       break;
 
@@ -161,185 +331,23 @@ static void gks_ddlk(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_
     }
 
   api = 0;
-  list = open_ws;
 
-  while (list != NULL)
+  for (i = 0; i < num_ws_table; i++)
     {
-      ws = (ws_list_t *)list->ptr;
+      ws = ws_table[i];
 
-      if (i_arr[0] == ws->wkid || !have_id)
-        {
-          if (id != 0)
-            {
-              if (id != ws->wkid)
-                {
-                  list = list->next;
-                  continue;
-                }
-            }
-          ptr = &ws->ptr;
+      if (have_id && i_arr[0] != ws->wkid) continue;
+      if (id != 0 && id != ws->wkid) continue;
 
-#ifndef EMSCRIPTEN
-          if (s->debug)
-            fprintf(stdout, "[DEBUG:GKS] dispatch %s function to %s driver (wtype: %d)\n", gks_function_name(fctid),
-                    ws->name, ws->wtype);
+      ptr = &ws->ptr;
 
-          switch (ws->wtype)
-            {
-            case 2:
-              gks_drv_mo(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
-              break;
-
-            case 3:
-              gks_drv_mi(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
-              break;
-
-            case 5:
-              gks_drv_wiss(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                           ptr);
-              break;
-
-            case 41:
-              gks_drv_win(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                          ptr);
-              break;
-
-            case 61:
-            case 62:
-            case 63:
-            case 64:
-              gks_drv_ps(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
-              break;
-
-            case 100:
-              break;
-
-            case 101:
-            case 102:
-              gks_drv_pdf(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                          ptr);
-              break;
-
-            case 210:
-            case 211:
-            case 212:
-            case 213:
-            case 214:
-            case 215:
-            case 216:
-            case 217:
-            case 218:
-              gks_x11_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 410:
-            case 411:
-            case 412:
-            case 413:
-              gks_drv_socket(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 415:
-              gks_zmq_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 301:
-              gks_drv_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 320:
-            case 321:
-            case 322:
-            case 323:
-              gks_gs_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                            ptr);
-              break;
-
-            case 371:
-              gks_gtk_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 380:
-              gks_wx_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                            ptr);
-              break;
-
-            case 381:
-              gks_qt_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                            ptr);
-              break;
-
-            case 382:
-              gks_svg_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 390:
-              gks_wmf_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 400:
-              gks_quartz_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr,
-                                c_arr, ptr);
-              break;
-
-            case 420:
-              gks_gl_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                            ptr);
-              break;
-
-            case 140:
-            case 141:
-            case 142:
-            case 143:
-            case 144:
-            case 145:
-            case 146:
-            case 150:
-            case 151:
-              gks_cairo_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                               ptr);
-              break;
-
-            case 120:
-            case 121:
-            case 130:
-            case 131:
-            case 160:
-            case 161:
-            case 162:
-              gks_video_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                               ptr);
-              break;
-
-            case 170:
-            case 171:
-            case 172:
-            case 173:
-              gks_agg_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            case 314:
-              gks_pgf_plugin(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr,
-                             ptr);
-              break;
-
-            default:
-              printf("GKS: %s\n", gks_function_name(fctid));
-              break;
-            }
-#else
-          gks_drv_js(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
+#ifndef EMSCRIPTEN
+      if (s->debug)
+        fprintf(stdout, "[DEBUG:GKS] dispatch %s function to %s driver (wtype: %d)\n", gks_function_name(fctid),
+                ws->name, ws->wtype);
 #endif
-        }
-      list = list->next;
+
+      ws->driver(fctid, dx, dy, dimx, i_arr, len_f_arr_1, f_arr_1, len_f_arr_2, f_arr_2, len_c_arr, c_arr, ptr);
     }
   api = 1;
 }
@@ -553,6 +561,45 @@ int gks_debug(void)
   return 0;
 }
 
+#ifndef NO_THREADS
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_state(void *arg)
+/*
+   Release the thread-local buffers of an exiting thread. The workstation
+   table of a context other than the implicit one is owned by that context
+   and freed in gks_destroy_context.
+ */
+{
+  ws_list_t **table;
+
+  GKS_UNUSED(arg);
+
+  table = current_context != NULL && current_context != &default_context ? default_context.ws_table : ws_table;
+  if (table != NULL) gks_free(table);
+  ws_table = default_context.ws_table = NULL;
+  num_ws_table = max_ws_table = 0;
+
+  gks_ft_terminate();
+}
+
+static void create_thread_key(void)
+{
+  pthread_key_create(&thread_key, free_thread_state);
+}
+
+#endif
+
+static void register_thread(void)
+{
+#ifndef NO_THREADS
+  pthread_once(&thread_key_once, create_thread_key);
+  if (pthread_getspecific(thread_key) == NULL) pthread_setspecific(thread_key, &thread_key);
+#endif
+}
+
 void gks_open_gks(int errfil)
 {
   int i;
@@ -560,7 +607,10 @@ void gks_open_gks(int errfil)
 
   if (state == GKS_K_GKCL)
     {
+      register_thread();
+
       open_ws = NULL;
+      gks_update_ws_table();
       active_ws = NULL;
       av_ws_types = NULL;
       for (i = 0; i < num_ws_types; i++)
@@ -620,6 +670,11 @@ void gks_close_gks(void)
       gks_list_free(av_ws_types);
       gks_free((void *)s);
       s = NULL;
+      if (seg_state != NULL)
+        {
+          gks_free((void *)seg_state);
+          seg_state = NULL;
+        }
 
       state = GKS_K_GKCL;
     }
@@ -695,6 +750,7 @@ void gks_open_ws(int wkid, char *path, int wtype)
                       ws->wtype = wtype;
                       ws->conid = 0;
                       ws->name = descr->name;
+                      ws->driver = gks_lookup_driver(wtype, &ws->flags);
 
                       if (descr->env)
                         {
@@ -728,6 +784,7 @@ void gks_open_ws(int wkid, char *path, int wtype)
                       /* add workstation identifier to the set of open
                          workstations */
                       open_ws = gks_list_add(open_ws, wkid, ws);
+                      gks_update_ws_table();
 
                       if (state == GKS_K_GKOP) state = GKS_K_WSOP;
 
@@ -794,6 +851,7 @@ void gks_open_ws(int wkid, char *path, int wtype)
                           /* remove workstation identifier from the set of open
                              workstations */
                           open_ws = gks_list_del(open_ws, wkid);
+                          gks_update_ws_table();
 
                           if (open_ws == NULL) state = GKS_K_GKOP;
 
@@ -859,6 +917,7 @@ void gks_close_ws(int wkid)
                   /* remove workstation identifier from the set of open
                      workstations */
                   open_ws = gks_list_del(open_ws, wkid);
+                  gks_update_ws_table();
 
                   if (open_ws == NULL) state = GKS_K_GKOP;
                 }
@@ -1380,6 +1439,114 @@ void gks_gdp(int n, double *px, double *py, int primid, int ldr, int *datrec)
     gks_report_error(GDP, 5);
 }
 
+static void primitive_list(int fctid, int primid, int n, int *offsets, double *pxa, double *pya, int *colia)
+{
+  ws_list_t *ws;
+  int *dr, len, npoints, first, saved_id, saved_coli;
+  int i, k, m, minpoints = fctid == POLYLINE ? 2 : 3;
+
+  first = offsets[0];
+  npoints = offsets[n] - first;
+
+  len = 3 + 2 * n;
+  dr = (int *)gks_malloc(len * sizeof(int));
+  dr[0] = npoints;
+  dr[1] = primid;
+  dr[2] = 2 * n;
+  for (i = 0; i < n; i++)
+    {
+      dr[3 + 2 * i] = offsets[i + 1] - offsets[i];
+      dr[4 + 2 * i] = colia != NULL ? colia[i] : -1;
+    }
+
+  saved_id = id;
+  for (k = 0; k < num_ws_table; k++)
+    {
+      ws = ws_table[k];
+      if (saved_id != 0 && saved_id != ws->wkid) continue;
+
+      /* restrict the dispatch to this workstation */
+      id = ws->wkid;
+
+      if (ws->flags & DRV_PRIMITIVE_LISTS)
+        {
+          /* call the device driver link routine */
+          gks_ddlk(GDP, len, 1, len, dr, npoints, pxa + first, npoints, pya + first, 0, c_arr, NULL);
+        }
+      else
+        {
+          saved_coli = fctid == POLYLINE ? s->plcoli : s->facoli;
+          for (i = 0; i < n; i++)
+            {
+              m = offsets[i + 1] - offsets[i];
+              if (m < minpoints) continue;
+
+              if (colia != NULL)
+                {
+                  if (fctid == POLYLINE)
+                    gks_set_pline_color_index(colia[i] >= 0 ? colia[i] : saved_coli);
+                  else
+                    gks_set_fill_color_index(colia[i] >= 0 ? colia[i] : saved_coli);
+                }
+              if (fctid == POLYLINE)
+                gks_polyline(m, pxa + offsets[i], pya + offsets[i]);
+              else
+                gks_fillarea(m, pxa + offsets[i], pya + offsets[i]);
+            }
+          if (fctid == POLYLINE)
+            gks_set_pline_color_index(saved_coli);
+          else
+            gks_set_fill_color_index(saved_coli);
+        }
+    }
+  id = saved_id;
+
+  free(dr);
+}
+
+static int valid_offsets(int n, int *offsets)
+{
+  int i;
+
+  if (n < 1 || offsets[0] < 0) return 0;
+  for (i = 0; i < n; i++)
+    if (offsets[i + 1] < offsets[i]) return 0;
+
+  return offsets[n] > offsets[0];
+}
+
+void gks_polyline_list(int n, int *offsets, double *pxa, double *pya, int *colia)
+{
+  if (state >= GKS_K_WSAC)
+    {
+      if (valid_offsets(n, offsets))
+        primitive_list(POLYLINE, GKS_K_GDP_DRAW_POLYLINES, n, offsets, pxa, pya, colia);
+      else
+        /* number of points is invalid */
+        gks_report_error(POLYLINE, 100);
+    }
+  else
+    /* GKS not in proper state. GKS must be either in the state
+       WSAC or in the state SGOP */
+    gks_report_error(POLYLINE, 5);
+}
+
+void gks_fillarea_list(int n, int *offsets, double *pxa, double *pya, int *colia)
+{
+  if (state >= GKS_K_WSAC)
+    {
+      if (valid_offsets(n, offsets))
+        primitive_list(FILLAREA, GKS_K_GDP_FILL_AREAS, n, offsets, pxa, pya, colia);
+      else
+        /* number of points is invalid */
+        gks_report_error(FILLAREA, 100);
+    }
+  else
+    /* GKS not in proper state. GKS must be either in the state
+       WSAC or in the state SGOP */
+    gks_report_error(FILLAREA, 5);
+}
+
 void gks_set_pline_index(int index)
 {
   if (state >= GKS_K_GKOP)
@@ -2144,7 +2311,7 @@ void gks_create_seg(int segn)
       state = GKS_K_SGOP;
 
       /* save segment state */
-      seg_state = (gks_state_list_t *)gks_malloc(sizeof(gks_state_list_t));
+      if (seg_state == NULL) seg_state = (gks_state_list_t *)gks_malloc(sizeof(gks_state_list_t));
       memmove(seg_state, s, sizeof(gks_state_list_t));
     }
   else
@@ -2642,6 +2809,48 @@ void gks_interpret_item(int type, int lenidr, int dimidr, char *idr)
     gks_report_error(INTERPRET_ITEM, 7);
 }
 
+void gks_seek_frame(int wkid, int frame)
+{
+  gks_list_t *element;
+  ws_list_t *ws;
+
+  if (state >= GKS_K_WSOP)
+    {
+      if (wkid > 0)
+        {
+          if ((element = gks_list_find(open_ws, wkid)) != NULL)
+            {
+              ws = (ws_list_t *)element->ptr;
+              if (ws->wtype == 3)
+                {
+                  i_arr[0] = wkid;
+                  i_arr[1] = frame;
+
+                  /* call the device driver link routine */
+                  gks_ddlk(SEEK_FRAME, 3, 1, 3, i_arr, 0, f_arr_1, 0, f_arr_2, 0, c_arr, NULL);
+
+                  if (i_arr[2] != GKS_K_NO_ERROR)
+                    /* metafile frame number is invalid */
+                    gks_report_error(SEEK_FRAME, 165);
+                }
+              else
+                /* specified workstation is not of category MI */
+                gks_report_error(SEEK_FRAME, 34);
+            }
+          else
+            /* specified workstation is not open */
+            gks_report_error(SEEK_FRAME, 25);
+        }
+      else
+        /* specified workstation identifier is invalid */
+        gks_report_error(SEEK_FRAME, 20);
+    }
+  else
+    /* GKS not in proper state. GKS must be in one of the
+       states WSOP, WSAC or SGOP */
+    gks_report_error(SEEK_FRAME, 7);
+}
+
 void gks_eval_xform_matrix(double fx, double fy, double transx, double transy, double phi, double scalex, double scaley,
                            int coord, double tran[3][2])
 {
@@ -2988,6 +3197,25 @@ void gks_inq_ws_conntype(int wkid, int *errind, int *conid, int *wtype)
     *errind = GKS_K_ERROR;
 }
 
+void gks_inq_num_frames(int wkid, int *errind, int *nframes)
+{
+  gks_list_t *element;
+  ws_list_t *ws;
+
+  if ((element = gks_list_find(open_ws, wkid)) != NULL && ((ws_list_t *)element->ptr)->wtype == 3)
+    {
+      ws = (ws_list_t *)element->ptr;
+
+      i_arr[0] = ws->wkid;
+      gks_ddlk(INQ_NUM_FRAMES, 2, 1, 2, i_arr, 0, f_arr_1, 0, f_arr_2, 0, c_arr, NULL);
+
+      *errind = GKS_K_NO_ERROR;
+      *nframes = i_arr[1];
+    }
+  else
+    *errind = GKS_K_ERROR;
+}
+
 void gks_inq_ws_category(int wtype, int *errind, int *wscat)
 {
   gks_list_t *element;
@@ -3143,7 +3371,7 @@ void gks_inq_vp_size(int wkid, int *errind, int *width, int *height, double *dev
 
 void gks_emergency_close(void)
 {
-  static int closing = 0;
+  static GKS_THREAD_LOCAL int closing = 0;
 
   if (!closing)
     {
@@ -3167,6 +3395,95 @@ void gks_emergency_close(void)
     }
 }
 
+static void save_context(gks_context_t *context)
+{
+  context->s = s;
+  context->seg_state = seg_state;
+  context->state = state;
+  context->api = api;
+  context->id = id;
+  context->open_ws = open_ws;
+  context->active_ws = active_ws;
+  context->av_ws_types = av_ws_types;
+  context->ws_table = ws_table;
+  context->num_ws_table = num_ws_table;
+  context->max_ws_table = max_ws_table;
+}
+
+static void load_context(gks_context_t *context)
+{
+  s = context->s;
+  seg_state = context->seg_state;
+  state = context->state;
+  api = context->api;
+  id = context->id;
+  open_ws = context->open_ws;
+  active_ws = context->active_ws;
+  av_ws_types = context->av_ws_types;
+  ws_table = context->ws_table;
+  num_ws_table = context->num_ws_table;
+  max_ws_table = context->max_ws_table;
+
+  if (s != NULL) gks_init_core(s);
+}
+
+gks_context_t *gks_create_context(void)
+/*
+   Create an independent GKS context in the closed state (GKCL). Each thread
+   starts with an implicit context of its own, so creating contexts is only
+   required to drive several GKS instances from the same thread.
+ */
+{
+  gks_context_t *context;
+
+  context = (gks_context_t *)gks_malloc(sizeof(gks_context_t));
+  context->state = GKS_K_GKCL;
+  context->api = 1;
+
+  return context;
+}
+
+void gks_select_context(gks_context_t *context)
+/*
+   Make the given context current for the calling thread. A NULL pointer
+   selects the implicit context of the thread. A context must not be
+   current in more than one thread at a time.
+ */
+{
+  if (context == NULL) context = &default_context;
+  if (current_context == NULL) current_context = &default_context;
+
+  if (context != current_context)
+    {
+      save_context(current_context);
+      load_context(context);
+      current_context = context;
+    }
+}
+
+gks_context_t *gks_inq_current_context(void)
+{
+  if (current_context == &default_context) return NULL;
+
+  return current_context;
+}
+
+void gks_destroy_context(gks_context_t *context)
+{
+  gks_context_t *previous;
+
+  if (context == NULL || context == &default_context) return;
+
+  previous = gks_inq_current_context();
+
+  gks_select_context(context);
+  gks_emergency_close();
+  gks_select_context(previous != context ? previous : NULL);
+
+  if (context->ws_table != NULL) gks_free(context->ws_table);
+  gks_free(context);
+}
+
 void gks_set_text_slant(double slant)
 {
   if (state >= GKS_K_GKOP)
@@ -246,6 +246,8 @@ extern "C" {
 #define GKS_K_GDP_DRAW_MARKERS 3
 #define GKS_K_GDP_DRAW_TRIANGLES 4
 #define GKS_K_GDP_FILL_POLYGONS 5
+#define GKS_K_GDP_DRAW_POLYLINES 6
+#define GKS_K_GDP_FILL_AREAS 7
 
 /* resize behaviour flag */
 
@@ -418,6 +420,8 @@ typedef enum
 
 /* Forward type definitions */
 
+typedef struct gks_context_t gks_context_t; /* opaque GKS context */
+
 typedef struct
 {         /* integer point */
   Gint x; /* x coordinate */
@@ -570,6 +574,8 @@ DLLEXPORT void gks_fillarea(int n, double *pxa, double *pya);
 DLLEXPORT void gks_cellarray(double qx, double qy, double rx, double ry, int dimx, int dimy, int scol, int srow,
                              int ncol, int nrow, int *colia);
 DLLEXPORT void gks_gdp(int n, double *px, double *py, int primid, int ldr, int *datrec);
+DLLEXPORT void gks_polyline_list(int n, int *offsets, double *pxa, double *pya, int *colia);
+DLLEXPORT void gks_fillarea_list(int n, int *offsets, double *pxa, double *pya, int *colia);
 
 DLLEXPORT void gks_set_pline_index(int index);
 DLLEXPORT void gks_set_pline_linetype(int ltype);
@@ -621,6 +627,8 @@ DLLEXPORT void gks_request_string(int wkid, int stdnr, int *stat, int *lostr, ch
 DLLEXPORT void gks_read_item(int wkid, int lenidr, int maxodr, char *odr);
 DLLEXPORT void gks_get_item(int wkid, int *type, int *lenodr);
 DLLEXPORT void gks_interpret_item(int type, int lenidr, int dimidr, char *idr);
+DLLEXPORT void gks_seek_frame(int wkid, int frame);
+DLLEXPORT void gks_inq_num_frames(int wkid, int *errind, int *nframes);
 DLLEXPORT void gks_eval_xform_matrix(double fx, double fy, double transx, double transy, double phi, double scalex,
                                      double scaley, int coord, double tran[3][2]);
 
@@ -662,6 +670,11 @@ DLLEXPORT void gks_inq_max_ds_size(int wtype, int *errind, int *dcunit, double *
 DLLEXPORT void gks_inq_vp_size(int wkid, int *errind, int *width, int *height, double *device_pixel_ratio);
 DLLEXPORT void gks_emergency_close(void);
 
+DLLEXPORT gks_context_t *gks_create_context(void);
+DLLEXPORT void gks_select_context(gks_context_t *context);
+DLLEXPORT gks_context_t *gks_inq_current_context(void);
+DLLEXPORT void gks_destroy_context(gks_context_t *context);
+
 DLLEXPORT void gks_set_text_slant(double slant);
 DLLEXPORT void gks_draw_image(double x, double y, double scalex, double scaley, int width, int height, int *data);
 DLLEXPORT void gks_set_shadow(double offsetx, double offsety, double blur);
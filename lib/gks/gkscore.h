@@ -20,6 +20,18 @@
 
 #endif
 
+/* storage class for state that has to be private to each thread */
+
+#ifndef GKS_THREAD_LOCAL
+#if defined(_MSC_VER)
+#define GKS_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__) || defined(__INTEL_COMPILER) || defined(__SUNPRO_C)
+#define GKS_THREAD_LOCAL __thread
+#else
+#define GKS_THREAD_LOCAL
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -103,6 +115,8 @@ extern "C" {
 #define SET_RESAMPLE_METHOD 108
 #define SET_RESIZE_BEHAVIOUR 109
 #define INQ_TEXT 110
+#define SEEK_FRAME 111
+#define INQ_NUM_FRAMES 112
 
 #define SET_TEXT_SLANT 200
 #define DRAW_IMAGE 201
@@ -178,6 +192,9 @@ typedef struct gks_list
   void *ptr;
 } gks_list_t;
 
+typedef void (*gks_driver_t)(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_arr_1, double *f_arr_1,
+                             int len_f_arr_2, double *f_arr_2, int len_c_arr, char *c_arr, void **ptr);
+
 typedef struct
 {
   int wkid;
@@ -187,6 +204,8 @@ typedef struct
   void *ptr;
   double vp[4];
   char *name;
+  gks_driver_t driver;
+  int flags;
 } ws_list_t;
 
 typedef struct
@@ -272,6 +291,10 @@ void gks_move(double x, double y, void (*move)(double x, double y));
 void gks_dash(double x, double y, void (*move)(double x, double y), void (*draw)(double x, double y));
 void gks_emul_polyline(int n, double *px, double *py, int ltype, int tnr, void (*move)(double x, double y),
                        void (*draw)(double x, double y));
+void gks_emul_polylines(int n, double *px, double *py, int nc, int *codes, int *plcoli,
+                        void (*polyline)(int n, double *px, double *py));
+void gks_emul_fillareas(int n, double *px, double *py, int nc, int *codes, int *facoli,
+                        void (*fillarea)(int n, double *px, double *py));
 void gks_emul_polymarker(int n, double *px, double *py, void (*marker)(double x, double y, int mtype));
 void gks_emul_text(double px, double py, int nchars, char *chars,
                    void (*polyline)(int n, double *px, double *py, int ltype, int tnr),
@@ -283,6 +306,8 @@ void gks_util_inq_text_extent(double px, double py, char *chars, int nchars, dou
 int gks_get_ws_type(void);
 int gks_base64(unsigned char *src, size_t srclength, char *target, size_t targsize);
 DLLEXPORT const char *gks_getenv(const char *env);
+int gks_thread_count(const char *env, int max_threads);
+void gks_run_threads(int num_threads, void (*func)(void *arg, int index), void *arg);
 void gks_iso2utf(unsigned char c, char *utf, size_t *len);
 void gks_symbol2utf(unsigned char c, char *utf, size_t *len);
 void gks_input2utf8(const char *input_str, char *utf8_str, int input_encoding);
@@ -408,6 +433,8 @@ DLLEXPORT void gks_ft_inq_text3d_extent(double x, double y, double z, char *text
 DLLEXPORT void gks_ft_set_bearing_x_direction(int);
 DLLEXPORT void gks_ft_inq_bearing_x_direction(int *);
 DLLEXPORT int gks_ft_load_user_font(char *font, int ignore_file_not_found);
+DLLEXPORT void gks_ft_set_glyph_cache_size(size_t size);
+DLLEXPORT void gks_ft_inq_glyph_cache_stats(unsigned long *hits, unsigned long *misses, size_t *used, size_t *size);
 
 DLLEXPORT void gks_set_encoding(int encoding);
 DLLEXPORT void gks_inq_encoding(int *encoding);
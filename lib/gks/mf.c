@@ -5,6 +5,8 @@
 
 #if !defined(VMS) && !defined(_WIN32)
 #include <unistd.h>
+#include <sys/mman.h>
+#define HAVE_MMAP
 #endif
 
 #include <sys/types.h>
@@ -13,7 +15,8 @@
 #include "gkscore.h"
 #include "gks.h"
 
-#define SEGM_SIZE 262144 /* 256K */
+#define SEGM_SIZE 262144         /* 256K */
+#define MAP_WINDOW_SIZE 67108864 /* 64M */
 
 #define COPY(s, n)                              \
   memmove(p->buffer + p->nbytes, (void *)s, n); \
@@ -33,13 +36,19 @@
 typedef struct ws_state_list_struct
 {
   int conid, state;
-  int empty;
+  int empty, streaming, new_frame;
   char *buffer;
   int size, nbytes, position;
+  char *map;
+  size_t map_size;
+  off_t map_offset, file_size, offset, scan_offset;
+  off_t *frames;
+  int num_frames, max_frames;
+  gks_state_list_t *gkss;
 } ws_state_list;
 
-static ws_state_list *p;
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL ws_state_list *p;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss;
 static int wkid = 1;
 static int unused_variable = 0;
 
@@ -280,12 +289,27 @@ static void write_gksm(int stream)
     }
 }
 
+/* write pending items; in streaming mode the buffer is reused afterwards, so it never grows beyond the size of a
+ * segment plus one item */
+static void flush_gksm(void)
+{
+  if (p->position < p->nbytes && !p->empty)
+    {
+      write_gksm(p->conid);
+      p->position = p->nbytes;
+      if (p->streaming) p->nbytes = p->position = 0;
+    }
+}
+
 void gks_drv_mo(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1, double *f_arr_1, int len_farr_2,
                 double *f_arr_2, int len_c_arr, char *c_arr, void **ptr)
 {
   int gksm = 2;
   p = (ws_state_list *)*ptr;
 
+  /* the workstation may belong to another GKS context */
+  if (fctid != 2 && p != NULL) gkss = p->gkss;
+
   switch (fctid)
     {
     case 2: /* open workstation */
@@ -295,19 +319,21 @@ void gks_drv_mo(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
       p->conid = i_arr[1];
       p->state = GKS_K_WS_INACTIVE;
       p->empty = 1;
+      p->streaming = gks_getenv("GKS_MF_STREAMING") != NULL;
+      p->new_frame = 1;
 
       p->buffer = (char *)gks_malloc(SEGM_SIZE + 1);
       p->size = SEGM_SIZE;
       p->nbytes = p->position = 0;
 
-      gkss = (gks_state_list_t *)*ptr;
+      gkss = p->gkss = (gks_state_list_t *)*ptr;
 
       *ptr = (void *)p;
       break;
 
     case 3: /* close workstation */
 
-      if (p->position < p->nbytes && !p->empty) write_gksm(p->conid);
+      flush_gksm();
 
       free(p->buffer);
       free(p);
@@ -327,21 +353,18 @@ void gks_drv_mo(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
 
     case 6: /* clear workstation */
 
+      /* parts of the current frame may already be on disk, so the remaining items must not be discarded */
+      if (p->streaming) flush_gksm();
+
       p->nbytes = p->position = 0;
       p->empty = 1;
+      p->new_frame = 1;
       memset(p->buffer, 0, p->size);
       break;
 
     case 8: /* update workstation */
 
-      if (i_arr[1] & GKS_K_PERFORM_FLAG)
-        {
-          if (p->position < p->nbytes && !p->empty)
-            {
-              write_gksm(p->conid);
-              p->position = p->nbytes;
-            }
-        }
+      if (i_arr[1] & GKS_K_PERFORM_FLAG) flush_gksm();
       break;
 
     case 12:
@@ -392,19 +415,22 @@ void gks_drv_mo(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
         {
           int len = 2 * sizeof(int) + sizeof(gks_state_list_t);
 
-          if (p->nbytes == 0)
+          if (p->new_frame)
             {
               COPY(&len, sizeof(int));
               COPY(&gksm, sizeof(int));
               COPY(gkss, sizeof(gks_state_list_t));
+              p->new_frame = 0;
             }
           write_item(fctid, dx, dy, dimx, i_arr, len_farr_1, f_arr_1, len_farr_2, f_arr_2, len_c_arr, c_arr);
+
+          if (p->streaming && p->nbytes >= SEGM_SIZE) flush_gksm();
         }
       break;
     }
 }
 
-static char *readfile(int fd)
+static char *readfile(int fd, off_t *nbytes)
 {
   int cc;
   struct stat buf;
@@ -420,6 +446,7 @@ static char *readfile(int fd)
 
       if ((cc = read(fd, s, size)) != -1) s[cc] = '\0';
       memset(s + cc, 0, 2 * sizeof(int));
+      *nbytes = cc;
     }
   else
     gks_perror("invalid file descriptor (%d)", fd);
@@ -427,6 +454,76 @@ static char *readfile(int fd)
   return s;
 }
 
+/* Regular metafiles are memory-mapped through a sliding window instead of being read into memory, so that replaying
+ * even very large files needs a constant amount of memory. Other files (e.g. pipes) are read completely. */
+static void openfile(int fd)
+{
+#ifdef HAVE_MMAP
+  struct stat buf;
+
+  if (fd != -1 && fstat(fd, &buf) == 0 && S_ISREG(buf.st_mode))
+    {
+      p->file_size = buf.st_size;
+      return;
+    }
+#endif
+  p->buffer = readfile(fd, &p->file_size);
+}
+
+/* get a pointer to len bytes of the metafile starting at offset */
+static char *item_data(off_t offset, size_t len)
+{
+  if (offset < 0 || offset > p->file_size || (off_t)len > p->file_size - offset) return NULL;
+
+  if (p->buffer != NULL) return p->buffer + offset;
+
+#ifdef HAVE_MMAP
+  if (p->map == NULL || offset < p->map_offset || offset + (off_t)len > p->map_offset + (off_t)p->map_size)
+    {
+      if (p->map != NULL) munmap(p->map, p->map_size);
+
+      p->map_offset = offset - offset % sysconf(_SC_PAGESIZE);
+      p->map_size = (size_t)(offset - p->map_offset) + len;
+      if (p->map_size < MAP_WINDOW_SIZE) p->map_size = MAP_WINDOW_SIZE;
+      if ((off_t)p->map_size > p->file_size - p->map_offset) p->map_size = (size_t)(p->file_size - p->map_offset);
+
+      p->map = (char *)mmap(NULL, p->map_size, PROT_READ, MAP_PRIVATE, p->conid, p->map_offset);
+      if (p->map == (char *)MAP_FAILED)
+        {
+          gks_perror("can't map GKSM metafile");
+          p->map = NULL;
+          return NULL;
+        }
+    }
+  return p->map + (offset - p->map_offset);
+#else
+  return NULL;
+#endif
+}
+
+/* extend the frame index until it contains the given frame (or all frames if frame is 0) */
+static void index_frames(int frame)
+{
+  int *header;
+
+  while (frame == 0 || p->num_frames < frame)
+    {
+      header = (int *)item_data(p->scan_offset, 2 * sizeof(int));
+      if (header == NULL || header[0] < (int)(2 * sizeof(int))) break;
+
+      if (header[1] == 2)
+        {
+          if (p->num_frames == p->max_frames)
+            {
+              p->max_frames = p->max_frames == 0 ? 256 : 2 * p->max_frames;
+              p->frames = (off_t *)gks_realloc(p->frames, p->max_frames * sizeof(off_t));
+            }
+          p->frames[p->num_frames++] = p->scan_offset;
+        }
+      p->scan_offset += header[0];
+    }
+}
+
 static void gksinit(gks_state_list_t *gkss)
 {
   int tnr;
@@ -763,8 +860,8 @@ static void interp(char *str)
 void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1, double *f_arr_1, int len_farr_2,
                 double *f_arr_2, int len_c_arr, char *c_arr, void **ptr)
 {
-  char *s;
-  int len;
+  char *s, *data;
+  int len, *header;
   GKS_UNUSED(dx);
   GKS_UNUSED(dy);
   GKS_UNUSED(dimx);
@@ -785,8 +882,14 @@ void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
       p->conid = i_arr[1];
       p->state = GKS_K_WS_INACTIVE;
 
-      p->buffer = (char *)readfile(p->conid);
-      p->position = 0;
+      p->buffer = NULL;
+      p->map = NULL;
+      p->map_size = 0;
+      p->map_offset = p->file_size = 0;
+      p->offset = p->scan_offset = 0;
+      p->frames = NULL;
+      p->num_frames = p->max_frames = 0;
+      openfile(p->conid);
 
       *ptr = p;
       break;
@@ -794,6 +897,10 @@ void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
     case 3: /* close workstation */
 
       if (p->buffer != NULL) free(p->buffer);
+#ifdef HAVE_MMAP
+      if (p->map != NULL) munmap(p->map, p->map_size);
+#endif
+      if (p->frames != NULL) free(p->frames);
       free(p);
 
       p = NULL;
@@ -801,10 +908,11 @@ void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
 
     case 102: /* get item */
 
-      if (p->buffer != NULL)
+      header = (int *)item_data(p->offset, 2 * sizeof(int));
+      if (header != NULL)
         {
-          i_arr[0] = *(int *)(p->buffer + p->position + sizeof(int));
-          i_arr[1] = *(int *)(p->buffer + p->position);
+          i_arr[0] = header[1];
+          i_arr[1] = header[0];
           if (i_arr[0] < 0 || i_arr[0] > 204 || i_arr[1] < 0)
             {
               gks_perror("invalid metafile item (type=%d, lenodr=%d)", i_arr[0], i_arr[1]);
@@ -819,13 +927,14 @@ void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
 
     case 103: /* read item */
 
-      if (p->buffer == NULL) break;
+      header = (int *)item_data(p->offset, sizeof(int));
+      if (header == NULL) break;
       s = c_arr;
 
-      len = *(int *)(p->buffer + p->position);
-      if (len < i_arr[2] * 80 - 2 * (int)sizeof(int))
+      len = *header;
+      if (len < i_arr[2] * 80 - 2 * (int)sizeof(int) && (data = item_data(p->offset, len)) != NULL)
         {
-          memmove(s, p->buffer + p->position, len);
+          memmove(s, data, len);
           memset(s + len, 0, 2 * sizeof(int));
         }
       else
@@ -833,12 +942,30 @@ void gks_drv_mi(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1,
           memset(s, 0, i_arr[2] * 80);
           gks_perror("item data record is too long");
         }
-      p->position += len;
+      if (len > 0) p->offset += len;
       break;
 
     case 104: /* interpret item */
 
-      if (p->buffer != NULL) interp(c_arr);
+      if (p->buffer != NULL || p->file_size > 0) interp(c_arr);
+      break;
+
+    case 111: /* seek frame */
+
+      index_frames(i_arr[1]);
+      if (i_arr[1] >= 1 && i_arr[1] <= p->num_frames)
+        {
+          p->offset = p->frames[i_arr[1] - 1];
+          i_arr[2] = GKS_K_NO_ERROR;
+        }
+      else
+        i_arr[2] = GKS_K_ERROR;
+      break;
+
+    case 112: /* inquire number of frames */
+
+      index_frames(0);
+      i_arr[1] = p->num_frames;
       break;
     }
 }
@@ -1,5 +1,9 @@
 #define _POSIX_C_SOURCE 200112L
 
+#ifdef _MSC_VER
+#define NO_THREADS 1
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -11,6 +15,10 @@
 #include <unistd.h>
 #endif
 
+#if defined(HAVE_ZLIB) && !defined(NO_THREADS)
+#include <pthread.h>
+#endif
+
 #include "gks.h"
 #include "gkscore.h"
 
@@ -33,6 +41,11 @@ typedef unsigned long uLong;
 
 #define NO_OF_BUFS 10
 
+#define MAX_PDF_THREADS 64
+
+/* number of objects collected into one object stream */
+#define OBJSTM_SIZE 100
+
 #define DrawBorder 0
 
 #ifndef M_PI
@@ -117,6 +130,8 @@ typedef struct PDF_image_t
   long object;
   int width, height;
   int *data;
+  int have_alpha;
+  PDF_stream *rgb, *alpha; /* Flate encoded color and alpha samples */
 } PDF_image;
 
 typedef struct PDF_page_t
@@ -145,6 +160,7 @@ typedef struct ws_state_list_t
   long object_number;
   long info, root, outlines, pages;
   long *byte_offset;
+  long *container; /* object stream holding the object, 0 if written directly */
   int max_objects;
   PDF_page **page;
   int current_page, max_pages;
@@ -156,13 +172,19 @@ typedef struct ws_state_list_t
   int pattern_id[PATTERNS][2];
   PDF_image **image;
   int images, max_images;
+  int use_objstm;
+  PDF_stream *objstm, *direct;
+  long objstm_id, objstm_object[OBJSTM_SIZE];
+  uLong objstm_offset[OBJSTM_SIZE];
+  int objstm_count;
+  gks_state_list_t *gkss;
 } ws_state_list;
 
-static ws_state_list *p;
+static GKS_THREAD_LOCAL ws_state_list *p;
 
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss;
 
-static double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
+static GKS_THREAD_LOCAL double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
 
 static const char *fonts[MAX_FONT] = {"Times-Roman",
                                       "Times-Italic",
@@ -229,7 +251,7 @@ static int map[32] = {22, 9,  5, 14, 18, 26, 13, 1, 24, 11, 7, 16, 20, 28, 13, 3
 static int rmap[29] = {8,  24, 16, 32, 3,  19, 11, 27, 2, 18, 10, 26, 23, 4, 20,
                        12, 28, 5,  21, 13, 29, 1,  17, 9, 25, 6,  22, 14, 30};
 
-static char bitmap[PATTERNS][17];
+static GKS_THREAD_LOCAL char bitmap[PATTERNS][17];
 
 static int predef_font[] = {1, 1, 1, -2, -3, -4};
 
@@ -245,8 +267,8 @@ static double yfac[6] = {0, -1.2, -1, -0.5, 0, 0.2};
 
 static void fill_routine(int n, double *px, double *py, int tnr);
 
-static char buf_array[NO_OF_BUFS][20];
-static int current_buf = 0;
+static GKS_THREAD_LOCAL char buf_array[NO_OF_BUFS][20];
+static GKS_THREAD_LOCAL int current_buf = 0;
 
 static const char *pdf_double(double f)
 {
@@ -327,10 +349,12 @@ static PDF_stream *pdf_alloc_stream(void)
 
 static long pdf_alloc_id(PDF *p)
 {
-  if (p->object_number >= p->max_objects)
+  if (p->object_number + 1 >= p->max_objects)
     {
       p->max_objects += MAX_OBJECTS;
       p->byte_offset = (long *)pdf_realloc(p->byte_offset, p->max_objects * sizeof(long));
+      p->container = (long *)pdf_realloc(p->container, p->max_objects * sizeof(long));
+      memset(p->container + p->max_objects - MAX_OBJECTS, 0, MAX_OBJECTS * sizeof(long));
     }
   return ++(p->object_number);
 }
@@ -344,6 +368,7 @@ static void pdf_open(int fd)
   p->object_number = p->current_page = 0;
   p->max_objects = MAX_OBJECTS;
   p->byte_offset = (long *)pdf_calloc(p->max_objects, sizeof(long));
+  p->container = (long *)pdf_calloc(p->max_objects, sizeof(long));
 
   p->info = pdf_alloc_id(p);
   p->root = pdf_alloc_id(p);
@@ -362,7 +387,7 @@ static PDF_image *pdf_image(PDF *p, int width, int height)
 {
   PDF_image *image;
 
-  if (p->images + 1 >= MAX_IMAGES)
+  if (p->images + 1 >= p->max_images)
     {
       p->max_images += MAX_IMAGES;
       p->image = (PDF_image **)pdf_realloc(p->image, p->max_images * sizeof(PDF_image *));
@@ -383,7 +408,7 @@ static void pdf_page(PDF *p, double height, double width)
   PDF_page *page;
   int font;
 
-  if (p->current_page + 1 >= MAX_PAGES)
+  if (p->current_page + 1 >= p->max_pages)
     {
       p->max_pages += MAX_PAGES;
       p->page = (PDF_page **)pdf_realloc(p->page, p->max_pages * sizeof(PDF_page *));
@@ -405,48 +430,439 @@ static void pdf_page(PDF *p, double height, double width)
   page->first_image = page->last_image = p->images;
 }
 
+#ifdef HAVE_ZLIB
+
+typedef struct PDF_job_t
+{
+  PDF_stream *content; /* page content stream, compressed in place */
+  PDF_image *image;    /* image to be filtered and compressed */
+  double cost;
+  int err;
+} PDF_job;
+
+typedef struct PDF_queue_t
+{
+  PDF_job *job;
+  int num_jobs, next_job;
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+#endif
+} PDF_queue;
+
+static int pdf_deflate(PDF_stream *s, Byte *data, uLong length)
+{
+  s->size = s->length = compressBound(length);
+  s->buffer = (Byte *)pdf_realloc(NULL, s->size);
+
+  return compress(s->buffer, &s->length, data, length);
+}
+
+static void png_filter(int filter, const Byte *row, const Byte *prev, int row_bytes, int bpp, Byte *out)
+{
+  int i, a, b, c, pr, pa, pb, pc;
+
+  switch (filter)
+    {
+    case 1:
+      for (i = 0; i < bpp && i < row_bytes; i++) out[i] = row[i];
+      for (; i < row_bytes; i++) out[i] = (Byte)(row[i] - row[i - bpp]);
+      break;
+    case 2:
+      for (i = 0; i < row_bytes; i++) out[i] = (Byte)(row[i] - prev[i]);
+      break;
+    case 3:
+      for (i = 0; i < bpp && i < row_bytes; i++) out[i] = (Byte)(row[i] - prev[i] / 2);
+      for (; i < row_bytes; i++) out[i] = (Byte)(row[i] - (row[i - bpp] + prev[i]) / 2);
+      break;
+    case 4:
+      for (i = 0; i < bpp && i < row_bytes; i++) out[i] = (Byte)(row[i] - prev[i]);
+      for (; i < row_bytes; i++)
+        {
+          a = row[i - bpp];
+          b = prev[i];
+          c = prev[i - bpp];
+          pr = a + b - c;
+          pa = abs(pr - a);
+          pb = abs(pr - b);
+          pc = abs(pr - c);
+          out[i] = (Byte)(row[i] - (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+        }
+      break;
+    default:
+      memcpy(out, row, row_bytes);
+    }
+}
+
+static void pdf_predict(const Byte *data, int rows, int row_bytes, int bpp, int adaptive, Byte *result)
+/*
+   Apply PNG row filters to data and store the filtered rows, each one
+   preceded by its filter type byte, in result. In adaptive mode the filter
+   with the smallest sum of absolute differences is chosen for every row,
+   otherwise the Up filter is used throughout.
+ */
+{
+  const Byte *row, *prev;
+  Byte *zero, *filtered, *out;
+  int j, i, filter;
+  unsigned long sum, best_sum = 0;
+
+  zero = (Byte *)pdf_calloc(row_bytes, 1);
+  filtered = (Byte *)pdf_calloc(row_bytes, 1);
+
+  for (j = 0; j < rows; j++)
+    {
+      row = data + (size_t)j * row_bytes;
+      prev = j > 0 ? row - row_bytes : zero;
+      out = result + (size_t)j * (row_bytes + 1);
+
+      if (!adaptive)
+        {
+          out[0] = 2;
+          png_filter(2, row, prev, row_bytes, bpp, out + 1);
+          continue;
+        }
+      for (filter = 0; filter < 5; filter++)
+        {
+          png_filter(filter, row, prev, row_bytes, bpp, filtered);
+          sum = 0;
+          for (i = 0; i < row_bytes; i++) sum += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+          if (filter == 0 || sum < best_sum)
+            {
+              best_sum = sum;
+              out[0] = (Byte)filter;
+              memcpy(out + 1, filtered, row_bytes);
+            }
+        }
+    }
+
+  free(filtered);
+  free(zero);
+}
+
+static int pdf_encode_image(PDF_image *image)
+{
+  size_t length = (size_t)image->width * image->height, i;
+  Byte *samples, *rows;
+  int err;
+
+  samples = (Byte *)pdf_realloc(NULL, length * 3);
+  rows = (Byte *)pdf_realloc(NULL, length * 3 + image->height);
+
+  for (i = 0; i < length; i++)
+    {
+      samples[3 * i] = (Byte)(image->data[i] & 0xff);
+      samples[3 * i + 1] = (Byte)((image->data[i] & 0xff00) >> 8);
+      samples[3 * i + 2] = (Byte)((image->data[i] & 0xff0000) >> 16);
+    }
+  pdf_predict(samples, image->height, image->width * 3, 3, 1, rows);
+  image->rgb = pdf_alloc_stream();
+  err = pdf_deflate(image->rgb, rows, (uLong)(length * 3 + image->height));
+
+  if (err == Z_OK && image->have_alpha)
+    {
+      for (i = 0; i < length; i++) samples[i] = (Byte)((image->data[i] >> 24) & 0xff);
+      pdf_predict(samples, image->height, image->width, 1, 1, rows);
+      image->alpha = pdf_alloc_stream();
+      err = pdf_deflate(image->alpha, rows, (uLong)(length + image->height));
+    }
+
+  free(rows);
+  free(samples);
+
+  return err;
+}
+
+static void pdf_run_job(PDF_job *job)
+{
+  PDF_stream content;
+
+  if (job->content != NULL)
+    {
+      job->err = pdf_deflate(&content, job->content->buffer, job->content->length);
+      free(job->content->buffer);
+      *job->content = content;
+    }
+  else
+    job->err = pdf_encode_image(job->image);
+}
+
+static void pdf_worker(void *arg, int index)
+{
+  PDF_queue *queue = (PDF_queue *)arg;
+  int i;
+
+  GKS_UNUSED(index);
+
+  for (;;)
+    {
+#ifndef NO_THREADS
+      pthread_mutex_lock(&queue->mutex);
+#endif
+      i = queue->next_job++;
+#ifndef NO_THREADS
+      pthread_mutex_unlock(&queue->mutex);
+#endif
+      if (i >= queue->num_jobs) break;
+
+      pdf_run_job(queue->job + i);
+    }
+}
+
+static int compare_jobs(const void *a, const void *b)
+{
+  double cost_a = ((const PDF_job *)a)->cost, cost_b = ((const PDF_job *)b)->cost;
+
+  return cost_a < cost_b ? 1 : cost_a > cost_b ? -1 : 0;
+}
+
+static void pdf_compress(PDF *p)
+/*
+   Compress all page contents and images in one batch. The jobs are
+   distributed over a pool of threads, largest first, while the output
+   file is still assembled sequentially afterwards.
+ */
+{
+  PDF_queue queue;
+  int num_jobs = 0, num_threads, i;
+
+  queue.job = (PDF_job *)pdf_calloc(p->current_page + p->images + 1, sizeof(PDF_job));
+  if (p->compress)
+    {
+      for (i = 0; i < p->current_page; i++)
+        {
+          queue.job[num_jobs].content = p->page[i]->stream;
+          queue.job[num_jobs++].cost = (double)p->page[i]->stream->length;
+        }
+    }
+  for (i = 0; i < p->images; i++)
+    {
+      queue.job[num_jobs].image = p->image[i];
+      queue.job[num_jobs++].cost = 4.0 * p->image[i]->width * p->image[i]->height;
+    }
+  qsort(queue.job, num_jobs, sizeof(PDF_job), compare_jobs);
+  queue.num_jobs = num_jobs;
+  queue.next_job = 0;
+
+  num_threads = gks_thread_count("GKS_PDF_THREADS", MAX_PDF_THREADS);
+  if (num_threads > num_jobs) num_threads = num_jobs > 0 ? num_jobs : 1;
+#ifndef NO_THREADS
+  pthread_mutex_init(&queue.mutex, NULL);
+#endif
+  gks_run_threads(num_threads, pdf_worker, &queue);
+#ifndef NO_THREADS
+  pthread_mutex_destroy(&queue.mutex);
+#endif
+
+  for (i = 0; i < num_jobs; i++)
+    if (queue.job[i].err != Z_OK)
+      {
+        gks_perror("compression failed (err=%d)", queue.job[i].err);
+        exit(-1);
+      }
+  free(queue.job);
+}
+
+static void pdf_flush_objects(PDF *p)
+{
+  PDF_stream *objects, data;
+  uLong first;
+  int i, err;
+
+  if (p->objstm_count == 0) return;
+
+  objects = pdf_alloc_stream();
+  for (i = 0; i < p->objstm_count; i++) pdf_printf(objects, "%ld %lu\n", p->objstm_object[i], p->objstm_offset[i]);
+  first = objects->length;
+  pdf_memcpy(objects, (char *)p->objstm->buffer, p->objstm->length);
+
+  if ((err = pdf_deflate(&data, objects->buffer, objects->length)) != Z_OK)
+    {
+      gks_perror("compression failed (err=%d)", err);
+      exit(-1);
+    }
+
+  pdf_obj(p, p->objstm_id);
+  pdf_dict(p);
+  pdf_printf(p->stream, "/Type /ObjStm\n");
+  pdf_printf(p->stream, "/N %d\n", p->objstm_count);
+  pdf_printf(p->stream, "/First %lu\n", first);
+  pdf_printf(p->stream, "/Length %lu\n", data.length);
+  pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
+  pdf_enddict(p);
+  pdf_stream(p);
+  pdf_memcpy(p->stream, (char *)data.buffer, data.length);
+  pdf_printf(p->stream, "\n");
+  pdf_endstream(p);
+  pdf_endobj(p);
+
+  free(data.buffer);
+  free(objects->buffer);
+  free(objects);
+
+  p->objstm->length = 0;
+  p->objstm_count = 0;
+  p->objstm_id = 0;
+}
+
+static long pdf_xref_stream(PDF *p)
+/*
+   Write a cross-reference stream (PDF 1.5) which also covers the objects
+   stored in object streams.
+ */
+{
+  long xref_id, start_xref, object, value;
+  int width, row_bytes, i, err;
+  Byte *table, *entry, *rows;
+  PDF_stream data;
+
+  xref_id = pdf_alloc_id(p);
+  start_xref = p->stream->length;
+  p->byte_offset[xref_id] = start_xref;
+
+  value = start_xref > p->object_number ? start_xref : p->object_number;
+  for (width = 1; width < (int)sizeof(long) && (value >> (8 * width)) != 0; width++)
+    ;
+  row_bytes = 1 + width + 2;
+
+  table = (Byte *)pdf_calloc((p->object_number + 1) * row_bytes, 1);
+  table[row_bytes - 2] = table[row_bytes - 1] = 0xff;
+  for (object = 1; object <= p->object_number; object++)
+    {
+      entry = table + object * row_bytes;
+      entry[0] = p->container[object] ? 2 : 1;
+      value = p->container[object] ? p->container[object] : p->byte_offset[object];
+      for (i = width; i > 0; i--, value >>= 8) entry[i] = (Byte)(value & 0xff);
+      if (p->container[object])
+        {
+          entry[width + 1] = (Byte)((p->byte_offset[object] >> 8) & 0xff);
+          entry[width + 2] = (Byte)(p->byte_offset[object] & 0xff);
+        }
+    }
+
+  rows = (Byte *)pdf_realloc(NULL, (p->object_number + 1) * (row_bytes + 1));
+  pdf_predict(table, p->object_number + 1, row_bytes, 1, 0, rows);
+  if ((err = pdf_deflate(&data, rows, (p->object_number + 1) * (row_bytes + 1))) != Z_OK)
+    {
+      gks_perror("compression failed (err=%d)", err);
+      exit(-1);
+    }
+
+  pdf_obj(p, xref_id);
+  pdf_dict(p);
+  pdf_printf(p->stream, "/Type /XRef\n");
+  pdf_printf(p->stream, "/Size %ld\n", p->object_number + 1);
+  pdf_printf(p->stream, "/W [1 %d 2]\n", width);
+  pdf_printf(p->stream, "/Root %ld 0 R\n", p->root);
+  pdf_printf(p->stream, "/Info %ld 0 R\n", p->info);
+  pdf_printf(p->stream, "/Length %lu\n", data.length);
+  pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
+  pdf_printf(p->stream, "/DecodeParms << /Columns %d /Predictor 12 >>\n", row_bytes);
+  pdf_enddict(p);
+  pdf_stream(p);
+  pdf_memcpy(p->stream, (char *)data.buffer, data.length);
+  pdf_printf(p->stream, "\n");
+  pdf_endstream(p);
+  pdf_endobj(p);
+
+  free(data.buffer);
+  free(rows);
+  free(table);
+
+  return start_xref;
+}
+
+#endif
+
+static void pdf_begin_object(PDF *p, long id)
+{
+  if (p->use_objstm)
+    {
+      if (p->objstm_id == 0) p->objstm_id = pdf_alloc_id(p);
+
+      p->container[id] = p->objstm_id;
+      p->byte_offset[id] = p->objstm_count;
+      p->objstm_object[p->objstm_count] = id;
+      p->objstm_offset[p->objstm_count] = p->objstm->length;
+      p->objstm_count++;
+
+      p->direct = p->stream;
+      p->stream = p->objstm;
+    }
+  else
+    {
+      pdf_obj(p, id);
+    }
+}
+
+static void pdf_end_object(PDF *p)
+{
+  if (p->use_objstm)
+    {
+      p->stream = p->direct;
+#ifdef HAVE_ZLIB
+      if (p->objstm_count == OBJSTM_SIZE) pdf_flush_objects(p);
+#endif
+    }
+  else
+    {
+      pdf_endobj(p);
+    }
+}
+
 static void pdf_close(PDF *p)
 {
   time_t timer;
   struct tm ltime;
   long start_xref;
   int count, object, font, pattern;
-  int image, width, height, length, *rgba, alpha;
-  Byte red, green, blue, data[3];
+  int image, width, height, alpha;
   int mask_id, filter_id, i;
+#ifndef HAVE_ZLIB
+  int length, *rgba;
+  Byte red, green, blue, data[3];
+#endif
   stroke_data_t s;
 
-  pdf_printf(p->stream, "%%PDF-1.4\n");
+#ifdef HAVE_ZLIB
+  p->use_objstm = p->compress;
+  p->objstm = pdf_alloc_stream();
+  p->objstm_id = 0;
+  p->objstm_count = 0;
+
+  pdf_compress(p);
+#endif
+
+  pdf_printf(p->stream, p->use_objstm ? "%%PDF-1.5\n" : "%%PDF-1.4\n");
   pdf_printf(p->stream, "%%\344\343\317\322\n");
 
   time(&timer);
   ltime = *localtime(&timer);
 
-  pdf_obj(p, p->info);
+  pdf_begin_object(p, p->info);
   pdf_dict(p);
   pdf_printf(p->stream, "/Creator (GKS)\n");
   pdf_printf(p->stream, "/CreationDate (D:%04d%02d%02d%02d%02d%02d)\n", ltime.tm_year + 1900, ltime.tm_mon + 1,
              ltime.tm_mday, ltime.tm_hour, ltime.tm_min, ltime.tm_sec);
   pdf_printf(p->stream, "/Producer (%s)\n", "GKS 5 PDF driver");
   pdf_enddict(p);
-  pdf_endobj(p);
+  pdf_end_object(p);
 
-  pdf_obj(p, p->root);
+  pdf_begin_object(p, p->root);
   pdf_dict(p);
   pdf_printf(p->stream, "/Type /Catalog\n");
   pdf_printf(p->stream, "/Pages %ld 0 R\n", p->pages);
   pdf_printf(p->stream, "/Outlines %ld 0 R\n", p->outlines);
   pdf_enddict(p);
-  pdf_endobj(p);
+  pdf_end_object(p);
 
-  pdf_obj(p, p->outlines);
+  pdf_begin_object(p, p->outlines);
   pdf_dict(p);
   pdf_printf(p->stream, "/Type /Outlines\n");
   pdf_printf(p->stream, "/Count 0\n");
   pdf_enddict(p);
-  pdf_endobj(p);
+  pdf_end_object(p);
 
-  pdf_obj(p, p->pages);
+  pdf_begin_object(p, p->pages);
   pdf_dict(p);
   pdf_printf(p->stream, "/Type /Pages\n");
   pdf_printf(p->stream, "/Count %d\n", p->current_page);
@@ -460,7 +876,7 @@ static void pdf_close(PDF *p)
 
   pdf_printf(p->stream, "]\n");
   pdf_enddict(p);
-  pdf_endobj(p);
+  pdf_end_object(p);
 
   filter_id = pdf_alloc_id(p);
   pdf_obj(p, filter_id);
@@ -516,7 +932,7 @@ static void pdf_close(PDF *p)
     {
       PDF_page *page = p->page[count];
 
-      pdf_obj(p, page->object);
+      pdf_begin_object(p, page->object);
       pdf_dict(p);
       pdf_printf(p->stream, "/Type /Page\n");
       pdf_printf(p->stream, "/Parent %ld 0 R\n", p->pages);
@@ -553,45 +969,20 @@ static void pdf_close(PDF *p)
       pdf_printf(p->stream, "/MediaBox [0 0 %g %g]\n", page->height, page->width);
       pdf_printf(p->stream, "/Contents %ld 0 R\n", page->contents);
       pdf_enddict(p);
-      pdf_endobj(p);
+      pdf_end_object(p);
 
       p->content = page->stream;
       pdf_obj(p, page->contents);
       pdf_dict(p);
 
-#ifdef HAVE_ZLIB
-      if (p->compress)
-        {
-          Byte *buffer;
-          uLong length;
-          int err;
-
-          length = p->content->length + 1024;
-          buffer = (Byte *)pdf_calloc((int)length, 1);
-          if ((err = compress(buffer, &length, p->content->buffer, p->content->length)) != Z_OK)
-            {
-              gks_perror("compression failed (err=%d)", err);
-              exit(-1);
-            }
-          free(p->content->buffer);
-
-          p->content->buffer = buffer;
-          p->content->size = p->content->length = length;
-          pdf_printf(p->stream, "/Length %ld\n", p->content->length);
-          pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
-          buffer[p->content->length++] = '\n';
-        }
-      else
-        {
-          pdf_printf(p->stream, "/Length %ld\n", p->content->length);
-        }
-#else
       pdf_printf(p->stream, "/Length %ld\n", p->content->length);
+#ifdef HAVE_ZLIB
+      if (p->compress) pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
 #endif
-
       pdf_enddict(p);
       pdf_stream(p);
       pdf_memcpy(p->stream, (char *)p->content->buffer, p->content->length);
+      if (p->compress) pdf_printf(p->stream, "\n");
       pdf_endstream(p);
       pdf_endobj(p);
 
@@ -599,7 +990,7 @@ static void pdf_close(PDF *p)
         {
           if (page->fonts[font])
             {
-              pdf_obj(p, page->fonts[font]);
+              pdf_begin_object(p, page->fonts[font]);
               pdf_dict(p);
               pdf_printf(p->stream, "/Type /Font\n");
               pdf_printf(p->stream, "/Subtype /Type1\n");
@@ -617,9 +1008,9 @@ static void pdf_close(PDF *p)
               pdf_printf(p->stream, "/FontDescriptor %d 0 R\n", page->fonts[font] + 1);
               if (font != 12) pdf_printf(p->stream, "/Encoding /WinAnsiEncoding\n");
               pdf_enddict(p);
-              pdf_endobj(p);
+              pdf_end_object(p);
 
-              pdf_obj(p, page->fonts[font] + 1);
+              pdf_begin_object(p, page->fonts[font] + 1);
               pdf_dict(p);
               pdf_printf(p->stream, "/Type /FontDescriptor\n");
               pdf_printf(p->stream, "/FontName /%s\n", fonts[font]);
@@ -631,16 +1022,71 @@ static void pdf_close(PDF *p)
               pdf_printf(p->stream, "/Descent %d\n", s.bottom);
               pdf_printf(p->stream, "/ItalicAngle %.1f\n", angles[font]);
               pdf_enddict(p);
-              pdf_endobj(p);
+              pdf_end_object(p);
             }
         }
       free(p->content->buffer);
+      free(p->content);
+      free(page);
     }
 
   for (image = 0; image < p->images; image++)
     {
       width = p->image[image]->width;
       height = p->image[image]->height;
+
+#ifdef HAVE_ZLIB
+      mask_id = 0;
+      if (p->image[image]->have_alpha)
+        {
+          mask_id = pdf_alloc_id(p);
+          pdf_obj(p, mask_id);
+          pdf_dict(p);
+          pdf_printf(p->stream, "/Type /XObject\n");
+          pdf_printf(p->stream, "/Subtype /Image\n");
+          pdf_printf(p->stream, "/BitsPerComponent 8\n");
+          pdf_printf(p->stream, "/ColorSpace /DeviceGray\n");
+          pdf_printf(p->stream, "/Height %d\n", height);
+          pdf_printf(p->stream, "/Width %d\n", width);
+          pdf_printf(p->stream, "/Length %lu\n", p->image[image]->alpha->length);
+          pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
+          pdf_printf(p->stream, "/DecodeParms << /Predictor 15 /Colors 1 /BitsPerComponent 8 /Columns %d >>\n",
+                     width);
+          pdf_enddict(p);
+
+          pdf_stream(p);
+          pdf_memcpy(p->stream, (char *)p->image[image]->alpha->buffer, p->image[image]->alpha->length);
+          pdf_printf(p->stream, "\n");
+          pdf_endstream(p);
+          pdf_endobj(p);
+
+          free(p->image[image]->alpha->buffer);
+          free(p->image[image]->alpha);
+        }
+
+      pdf_obj(p, p->image[image]->object);
+      pdf_dict(p);
+      pdf_printf(p->stream, "/Type /XObject\n");
+      pdf_printf(p->stream, "/Subtype /Image\n");
+      pdf_printf(p->stream, "/BitsPerComponent 8\n");
+      pdf_printf(p->stream, "/ColorSpace /DeviceRGB\n");
+      pdf_printf(p->stream, "/Height %d\n", height);
+      pdf_printf(p->stream, "/Width %d\n", width);
+      if (mask_id) pdf_printf(p->stream, "/SMask %d 0 R\n", mask_id);
+      pdf_printf(p->stream, "/Length %lu\n", p->image[image]->rgb->length);
+      pdf_printf(p->stream, "/Filter [/FlateDecode]\n");
+      pdf_printf(p->stream, "/DecodeParms << /Predictor 15 /Colors 3 /BitsPerComponent 8 /Columns %d >>\n", width);
+      pdf_enddict(p);
+
+      pdf_stream(p);
+      pdf_memcpy(p->stream, (char *)p->image[image]->rgb->buffer, p->image[image]->rgb->length);
+      pdf_printf(p->stream, "\n");
+      pdf_endstream(p);
+      pdf_endobj(p);
+
+      free(p->image[image]->rgb->buffer);
+      free(p->image[image]->rgb);
+#else
       length = width * height;
       rgba = p->image[image]->data;
 
@@ -696,21 +1142,34 @@ static void pdf_close(PDF *p)
       pdf_printf(p->stream, "\n");
       pdf_endstream(p);
       pdf_endobj(p);
+#endif
+      free(p->image[image]->data);
+      free(p->image[image]);
     }
 
-  start_xref = p->stream->length;
-  pdf_printf(p->stream, "xref\n");
-  pdf_printf(p->stream, "0 %ld\n", p->object_number + 1);
-  pdf_printf(p->stream, "0000000000 65535 f \n");
-  for (object = 1; object <= p->object_number; object++)
-    pdf_printf(p->stream, "%010ld 00000 n \n", p->byte_offset[object]);
-
-  pdf_printf(p->stream, "trailer\n");
-  pdf_dict(p);
-  pdf_printf(p->stream, "/Size %ld\n", p->object_number + 1);
-  pdf_printf(p->stream, "/Root %ld 0 R\n", p->root);
-  pdf_printf(p->stream, "/Info %ld 0 R\n", p->info);
-  pdf_enddict(p);
+#ifdef HAVE_ZLIB
+  if (p->use_objstm)
+    {
+      pdf_flush_objects(p);
+      start_xref = pdf_xref_stream(p);
+    }
+  else
+#endif
+    {
+      start_xref = p->stream->length;
+      pdf_printf(p->stream, "xref\n");
+      pdf_printf(p->stream, "0 %ld\n", p->object_number + 1);
+      pdf_printf(p->stream, "0000000000 65535 f \n");
+      for (object = 1; object <= p->object_number; object++)
+        pdf_printf(p->stream, "%010ld 00000 n \n", p->byte_offset[object]);
+
+      pdf_printf(p->stream, "trailer\n");
+      pdf_dict(p);
+      pdf_printf(p->stream, "/Size %ld\n", p->object_number + 1);
+      pdf_printf(p->stream, "/Root %ld 0 R\n", p->root);
+      pdf_printf(p->stream, "/Info %ld 0 R\n", p->info);
+      pdf_enddict(p);
+    }
   pdf_printf(p->stream, "startxref\n");
   pdf_printf(p->stream, "%ld\n", start_xref);
 
@@ -720,9 +1179,14 @@ static void pdf_close(PDF *p)
 
   free(p->stream->buffer);
 
+#ifdef HAVE_ZLIB
+  free(p->objstm->buffer);
+  free(p->objstm);
+#endif
   free(p->image);
   free(p->page);
   free(p->byte_offset);
+  free(p->container);
 }
 
 static void pdf_text_ex(PDF *p, double xorg, double yorg, char *text)
@@ -1514,7 +1978,7 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   PDF_image *image;
   int swapx, swapy, count, chars_per_line;
   unsigned char data[3];
-  int have_alpha;
+  int have_alpha, use_xobject;
 
   WC_to_NDC(xmin, ymax, gkss->cntnr, x1, y1);
   seg_xform(&x1, &y1);
@@ -1558,9 +2022,16 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
             }
     }
 
-  if (true_color && have_alpha)
+#ifdef HAVE_ZLIB
+  use_xobject = 1;
+#else
+  use_xobject = true_color && have_alpha;
+#endif
+
+  if (use_xobject)
     {
       image = pdf_image(p, dx, dy);
+      image->have_alpha = have_alpha;
       p->image[p->images++] = image;
 
       for (j = 0; j < dy; j++)
@@ -1569,7 +2040,14 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
           for (i = 0; i < dx; i++)
             {
               ix = swapx ? dx - 1 - i : i;
-              image->data[j * dx + i] = colia[iy * dimx + ix];
+              color = colia[iy * dimx + ix];
+              if (!true_color)
+                {
+                  color = FIX_COLORIND(color);
+                  color = (int)(0xff000000U | (unsigned int)(p->blue[color] * 255) << 16 |
+                                (unsigned int)(p->green[color] * 255) << 8 | (unsigned int)(p->red[color] * 255));
+                }
+              image->data[j * dx + i] = color;
             }
         }
 
@@ -1992,6 +2470,12 @@ static void gdp(int n, double *px, double *py, int primid, int nc, int *codes)
     case GKS_K_GDP_FILL_POLYGONS:
       fill_polygons(n, px, py, nc, codes);
       break;
+    case GKS_K_GDP_DRAW_POLYLINES:
+      gks_emul_polylines(n, px, py, nc, codes, &gkss->plcoli, polyline);
+      break;
+    case GKS_K_GDP_FILL_AREAS:
+      gks_emul_fillareas(n, px, py, nc, codes, &gkss->facoli, fillarea);
+      break;
     default:
       gks_perror("invalid drawing primitive ('%d')", primid);
       exit(1);
@@ -2015,6 +2499,13 @@ void gks_drv_js(
   GKS_UNUSED(lc);
   p = (ws_state_list *)*ptr;
 
+  if (fctid != 2 && p != NULL && p->gkss != gkss)
+    {
+      /* the workstation belongs to another GKS context */
+      gkss = p->gkss;
+      init_norm_xform();
+    }
+
   switch (fctid)
     {
     case 2:
@@ -2022,6 +2513,7 @@ void gks_drv_js(
 
       /* open workstation */
       open_ws(ia[1], ia[2]);
+      p->gkss = gkss;
 
       init_norm_xform();
       init_colors();
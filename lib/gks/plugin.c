@@ -9,6 +9,7 @@
 #else
 #include <dlfcn.h>
 #include <sys/param.h>
+#include <pthread.h>
 #endif
 
 #include "gkscore.h"
@@ -27,9 +28,27 @@
 #endif
 #endif
 
+#ifndef GKS_UNUSED
+#define GKS_UNUSED(x) (void)(x)
+#endif
+
 #define NAME "plugin"
 #define ENTRY_ARGS int, int, int, int, int *, int, double *, int, double *, int, char *, void **
 
+typedef void (*plugin_entry_t)(ENTRY_ARGS);
+
+typedef struct
+{
+  int loaded;
+  plugin_entry_t entry;
+} plugin_t;
+
+#ifdef _WIN32
+static volatile LONG plugin_lock = 0;
+#else
+static pthread_mutex_t plugin_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 static void *load_library(const char *name)
 {
   char pathname[MAXPATHLEN];
@@ -94,6 +113,55 @@ static void *load_library(const char *name)
   return entry;
 }
 
+static void no_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
+                      char *chars, void **ptr)
+{
+  GKS_UNUSED(fctid);
+  GKS_UNUSED(dx);
+  GKS_UNUSED(dy);
+  GKS_UNUSED(dimx);
+  GKS_UNUSED(ia);
+  GKS_UNUSED(lr1);
+  GKS_UNUSED(r1);
+  GKS_UNUSED(lr2);
+  GKS_UNUSED(r2);
+  GKS_UNUSED(lc);
+  GKS_UNUSED(chars);
+  GKS_UNUSED(ptr);
+}
+
+/*
+ * Resolve the entry point of a plugin exactly once per process. Workstations may be opened from several threads,
+ * so the first lookup is serialized; callers cache the result in a thread-local variable and don't come back here.
+ * A plugin which can't be loaded resolves to a function doing nothing, so the failure is cached as well. The name is
+ * either given or computed by `get_name` under the lock.
+ */
+static plugin_entry_t load_plugin(plugin_t *plugin, const char *name, const char *(*get_name)(void))
+{
+  plugin_entry_t entry;
+
+#ifdef _WIN32
+  while (InterlockedCompareExchange(&plugin_lock, 1, 0) != 0) Sleep(0);
+#else
+  pthread_mutex_lock(&plugin_lock);
+#endif
+  if (!plugin->loaded)
+    {
+      if (get_name != NULL) name = get_name();
+      *(void **)(&plugin->entry) = load_library(name);
+      if (plugin->entry == NULL) plugin->entry = no_plugin;
+      plugin->loaded = 1;
+    }
+  entry = plugin->entry;
+#ifdef _WIN32
+  InterlockedExchange(&plugin_lock, 0);
+#else
+  pthread_mutex_unlock(&plugin_lock);
+#endif
+
+  return entry;
+}
+
 static const char *get_qt_version_string()
 {
   typedef const char *qversion_t();
@@ -114,20 +182,22 @@ static const char *get_qt_version_string()
   return NULL;
 }
 
+static const char *plugin_name(void)
+{
+  const char *name = NAME, *env;
+
+  if ((env = gks_getenv("GKS_PLUGIN")) != NULL) name = env;
+
+  return name;
+}
+
 void gks_drv_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
-  const char *env;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = NAME;
-      if ((env = gks_getenv("GKS_PLUGIN")) != NULL) name = env;
-
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, NULL, plugin_name);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -135,14 +205,10 @@ void gks_drv_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_x11_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "x11plugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "x11plugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -150,14 +216,10 @@ void gks_x11_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_gs_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                    char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "gsplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "gsplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -165,14 +227,10 @@ void gks_gs_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
 void gks_gtk_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "gtkplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "gtkplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -180,52 +238,53 @@ void gks_gtk_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_wx_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                    char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "wxplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "wxplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
 
-void gks_qt_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
-                   char *chars, void **ptr)
+static const char *qt_plugin_name(void)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  const char *name = NULL;
   const char *qt_version_string;
   int qt_major_version;
 
-  if (name == NULL)
+  qt_version_string = getenv("GKS_QT_VERSION");
+  if (!qt_version_string)
     {
-      qt_version_string = getenv("GKS_QT_VERSION");
-      if (!qt_version_string)
-        {
-          qt_version_string = get_qt_version_string();
-        }
-      if (qt_version_string != NULL)
+      qt_version_string = get_qt_version_string();
+    }
+  if (qt_version_string != NULL)
+    {
+      qt_major_version = atoi(qt_version_string);
+      switch (qt_major_version)
         {
-          qt_major_version = atoi(qt_version_string);
-          switch (qt_major_version)
-            {
-            case 6:
-              name = "qt6plugin";
-              break;
-            case 5:
-              name = "qt5plugin";
-              break;
-            default:
-              name = "qtplugin";
-              break;
-            }
+        case 6:
+          name = "qt6plugin";
+          break;
+        case 5:
+          name = "qt5plugin";
+          break;
+        default:
+          name = "qtplugin";
+          break;
         }
-      if (name == NULL) name = "qtplugin";
-      *(void **)(&entry) = load_library(name);
     }
+  if (name == NULL) name = "qtplugin";
+
+  return name;
+}
+
+void gks_qt_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
+                   char *chars, void **ptr)
+{
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
+
+  if (entry == NULL) entry = load_plugin(&plugin, NULL, qt_plugin_name);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -233,14 +292,10 @@ void gks_qt_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
 void gks_svg_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "svgplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "svgplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -248,14 +303,10 @@ void gks_svg_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_wmf_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "wmfplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "wmfplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -263,14 +314,10 @@ void gks_wmf_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_quartz_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                        char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "quartzplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "quartzplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -278,14 +325,10 @@ void gks_quartz_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, do
 void gks_gl_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                    char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "glplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "glplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -293,14 +336,10 @@ void gks_gl_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
 void gks_cairo_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                       char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "cairoplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "cairoplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -308,14 +347,10 @@ void gks_cairo_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, dou
 void gks_zmq_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "zmqplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "zmqplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -323,14 +358,10 @@ void gks_zmq_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_pgf_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "pgfplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "pgfplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -338,14 +369,10 @@ void gks_pgf_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
 void gks_video_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                       char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "videoplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "videoplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
@@ -353,14 +380,10 @@ void gks_video_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, dou
 void gks_agg_plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                     char *chars, void **ptr)
 {
-  static const char *name = NULL;
-  static void (*entry)(ENTRY_ARGS) = NULL;
+  static plugin_t plugin = {0, NULL};
+  static GKS_THREAD_LOCAL plugin_entry_t entry = NULL;
 
-  if (name == NULL)
-    {
-      name = "aggplugin";
-      *(void **)(&entry) = load_library(name);
-    }
+  if (entry == NULL) entry = load_plugin(&plugin, "aggplugin", NULL);
 
   if (entry != NULL) (*entry)(fctid, dx, dy, dimx, ia, lr1, r1, lr2, r2, lc, chars, ptr);
 }
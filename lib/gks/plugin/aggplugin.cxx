@@ -67,10 +67,24 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
 #include <png.h>
 #include <jpeglib.h>
 
+#include <cmath>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
 #define PATTERNS 120
 #define HATCH_STYLE 108
 #define MAXPATHLEN 1024
 
+#define MAX_AGG_THREADS 64
+#define MIN_ROWS_PER_THREAD 32
+#define MAX_DEFERRED_BYTES (64 << 20)
+#define MARKER_CACHE_SIZE 1024
+#define MARKER_PHASES 4
+#define MAX_MARKER_EXTENT 64
+
 typedef agg::pixfmt_alpha_blend_rgba<agg::blender_rgba<agg::rgba8, agg::order_bgra>, agg::rendering_buffer> pix_fmt_t;
 typedef agg::renderer_base<pix_fmt_t> renderer_base_t;
 typedef agg::rasterizer_scanline_aa<agg::rasterizer_sl_clip_dbl> rasterizer_t;
@@ -80,6 +94,105 @@ typedef agg::path_storage path_t;
 typedef agg::conv_curve<agg::path_storage> conv_curve_t;
 typedef agg::conv_stroke<agg::conv_curve<agg::path_storage>> conv_stroke_t;
 typedef agg::conv_dash<agg::conv_curve<agg::path_storage>> conv_dash_t;
+typedef agg::image_accessor_wrap<agg::pixfmt_rgba32, agg::wrap_mode_repeat, agg::wrap_mode_repeat> pattern_source_t;
+typedef agg::span_pattern_rgba<pattern_source_t> pattern_span_t;
+
+/*
+   In tiled mode (GKS_AGG_THREADS > 1) primitives are not rendered immediately.
+   Their flattened outlines, colors and pixel blocks are recorded together with
+   the clip box and the range of rows they touch. When the page is needed, the
+   image is split into horizontal tiles and every tile replays the primitives
+   which intersect it in recording order, with its own rasterizer and scanline
+   renderer clipped to the tile. Each pixel therefore sees the same coverage
+   values and the same sequence of blend operations as in the serial path.
+ */
+
+enum deferred_type_t
+{
+  DEFERRED_PATH,
+  DEFERRED_PATTERN,
+  DEFERRED_PIXELS,
+  DEFERRED_SPRITE
+};
+
+struct deferred_vertex_t
+{
+  double x, y;
+  unsigned cmd;
+};
+
+struct deferred_primitive_t
+{
+  deferred_type_t type;
+  agg::rect_i clip_box;
+  int ymin, ymax;
+  agg::filling_rule_e filling_rule;
+  agg::rgba8 color, border_color;
+  size_t first, count;
+  size_t image;
+  int x, y, width, height;
+};
+
+/*
+   Markers are usually drawn many times with the same attributes. Their
+   coverage spans are therefore captured once per type, size, transformation,
+   stroke and subpixel phase (quantized to 1/MARKER_PHASES pixel) and blended
+   at integer offsets afterwards. Each layer of spans is drawn in either the
+   marker or the border color, so markers of any color share a sprite. A span
+   with a negative length is a solid run with a single coverage value, as in
+   agg::scanline_p8.
+ */
+
+struct marker_span_t
+{
+  int x, y, len;
+  size_t covers;
+};
+
+struct marker_layer_t
+{
+  bool border;
+  size_t first, count;
+};
+
+struct marker_sprite_t
+{
+  int mtype, phase_x, phase_y;
+  double mscale, bwidth, mat[2][2];
+  agg::line_cap_e line_cap;
+  agg::line_join_e line_join;
+  bool border;
+  int ymin{1}, ymax{0};
+  std::vector<marker_layer_t> layers;
+  std::vector<marker_span_t> spans;
+  std::vector<agg::int8u> covers;
+};
+
+struct tile_queue_t
+{
+  int num_threads{1};
+  size_t path_start{};
+  std::vector<deferred_vertex_t> vertices;
+  std::vector<agg::rgba8> pixels;
+  std::vector<agg::int8u> patterns;
+  std::vector<std::shared_ptr<const marker_sprite_t>> sprites;
+  std::vector<deferred_primitive_t> primitives;
+};
+
+struct encoder_options_t
+{
+  int png_level{-1};
+  int png_filters{-1};
+  int jpeg_quality{100};
+};
+
+struct page_job_t
+{
+  int wtype, width, height;
+  std::string path;
+  std::vector<unsigned char> pixels;
+  encoder_options_t options;
+};
 
 struct ws_state_list
 {
@@ -101,6 +214,9 @@ struct ws_state_list
   bool mem_resizable{};
   char mem_format{'a'};
 
+  encoder_options_t options;
+  std::thread encoder;
+
   agg::rendering_buffer render_buffer;
   pix_fmt_t pix_fmt;
   renderer_base_t renderer;
@@ -111,13 +227,18 @@ struct ws_state_list
   path_t path;
   conv_curve_t curve{path};
   conv_stroke_t stroke{curve};
+  agg::filling_rule_e filling_rule{agg::fill_non_zero};
   agg::rgba8 fill_col, stroke_col;
+  gks_state_list_t *gkss{};
+  tile_queue_t tiles;
+  std::shared_ptr<marker_sprite_t> markers[MARKER_CACHE_SIZE];
+  marker_sprite_t *capture{};
 };
 
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss;
 
-static double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
-static ws_state_list *p;
+static GKS_THREAD_LOCAL double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
+static GKS_THREAD_LOCAL ws_state_list *p;
 
 static const int predef_prec[] = {0, 1, 2, 2, 2, 2};
 static const int predef_ints[] = {0, 1, 3, 3, 3};
@@ -281,6 +402,228 @@ static void init_colors()
     }
 }
 
+static void discard_primitives()
+{
+  p->tiles.path_start = 0;
+  p->tiles.vertices.clear();
+  p->tiles.pixels.clear();
+  p->tiles.patterns.clear();
+  p->tiles.sprites.clear();
+  p->tiles.primitives.clear();
+}
+
+static int agg_thread_count()
+{
+  const char *env = gks_getenv("GKS_AGG_THREADS");
+  int num_threads = env != nullptr ? atoi(env) : 1;
+
+  if (num_threads > MAX_AGG_THREADS) num_threads = MAX_AGG_THREADS;
+  return num_threads < 1 ? 1 : num_threads;
+}
+
+static void blend_sprite(renderer_base_t &renderer, const marker_sprite_t *sprite, int x, int y, int ymin, int ymax,
+                         const agg::rgba8 &color, const agg::rgba8 &border_color)
+{
+  for (const auto &layer : sprite->layers)
+    {
+      const agg::rgba8 &layer_color = layer.border ? border_color : color;
+
+      for (size_t k = layer.first; k < layer.first + layer.count; k++)
+        {
+          const marker_span_t &span = sprite->spans[k];
+
+          if (span.y + y < ymin || span.y + y > ymax)
+            {
+              continue;
+            }
+          if (span.len < 0)
+            {
+              renderer.blend_hline(span.x + x, span.y + y, span.x + x - span.len - 1, layer_color,
+                                   sprite->covers[span.covers]);
+            }
+          else
+            {
+              renderer.blend_solid_hspan(span.x + x, span.y + y, span.len, layer_color, &sprite->covers[span.covers]);
+            }
+        }
+    }
+}
+
+static void read_encoder_options()
+{
+  static const struct
+  {
+    const char *name;
+    int filters;
+  } png_filters[] = {{"none", PNG_FILTER_NONE}, {"sub", PNG_FILTER_SUB},     {"up", PNG_FILTER_UP},
+                     {"avg", PNG_FILTER_AVG},   {"paeth", PNG_FILTER_PAETH}, {"all", PNG_ALL_FILTERS}};
+  const char *env;
+
+  p->options = encoder_options_t();
+
+  env = gks_getenv("GKS_PNG_COMPRESSION");
+  if (env != nullptr)
+    {
+      if (strcmp(env, "fast") == 0)
+        {
+          /* favor speed over size: least deflate effort and the cheap sub filter */
+          p->options.png_level = 1;
+          p->options.png_filters = PNG_FILTER_SUB;
+        }
+      else if (env[0] >= '0' && env[0] <= '9' && env[1] == '\0')
+        {
+          p->options.png_level = env[0] - '0';
+        }
+      else
+        {
+          fprintf(stderr, "GKS: Invalid PNG compression level %s\n", env);
+        }
+    }
+
+  env = gks_getenv("GKS_PNG_FILTER");
+  if (env != nullptr)
+    {
+      unsigned i;
+
+      for (i = 0; i < sizeof(png_filters) / sizeof(png_filters[0]); i++)
+        {
+          if (strcmp(env, png_filters[i].name) == 0)
+            {
+              p->options.png_filters = png_filters[i].filters;
+              break;
+            }
+        }
+      if (i == sizeof(png_filters) / sizeof(png_filters[0]))
+        {
+          fprintf(stderr, "GKS: Invalid PNG filter %s\n", env);
+        }
+    }
+
+  env = gks_getenv("GKS_JPEG_QUALITY");
+  if (env != nullptr)
+    {
+      int quality = atoi(env);
+
+      if (quality >= 1 && quality <= 100)
+        {
+          p->options.jpeg_quality = quality;
+        }
+      else
+        {
+          fprintf(stderr, "GKS: Invalid JPEG quality %s\n", env);
+        }
+    }
+}
+
+static void render_tile(const tile_queue_t *tiles, pix_fmt_t *pix_fmt, int ymin, int ymax)
+/*
+   Replay all recorded primitives which touch the rows ymin..ymax. Nothing
+   outside of these rows is modified, so tiles can be rendered concurrently.
+ */
+{
+  rasterizer_t rasterizer{1 << 14};
+  scanline_p8_t scanline;
+  renderer_base_t renderer(*pix_fmt);
+  renderer_aa_t renderer_aa(renderer);
+  agg::span_allocator<agg::rgba8> sa;
+
+  for (const auto &prim : tiles->primitives)
+    {
+      int y1 = prim.ymin > ymin ? prim.ymin : ymin;
+      int y2 = prim.ymax < ymax ? prim.ymax : ymax;
+
+      if (y1 > y2 || !renderer.clip_box(prim.clip_box.x1, y1, prim.clip_box.x2, y2))
+        {
+          continue;
+        }
+      if (prim.type == DEFERRED_PIXELS)
+        {
+          for (int j = y1; j <= y2; j++)
+            {
+              renderer.blend_color_hspan(prim.x, j, prim.width,
+                                         &tiles->pixels[prim.image + (size_t)(j - prim.y) * prim.width], nullptr);
+            }
+          continue;
+        }
+      if (prim.type == DEFERRED_SPRITE)
+        {
+          blend_sprite(renderer, tiles->sprites[prim.image].get(), prim.x, prim.y, y1, y2, prim.color,
+                       prim.border_color);
+          continue;
+        }
+
+      rasterizer.reset();
+      rasterizer.filling_rule(prim.filling_rule);
+      for (size_t k = prim.first; k < prim.first + prim.count; k++)
+        {
+          rasterizer.add_vertex(tiles->vertices[k].x, tiles->vertices[k].y, tiles->vertices[k].cmd);
+        }
+      if (!rasterizer.rewind_scanlines() ||
+          !rasterizer.navigate_scanline(y1 > rasterizer.min_y() ? y1 : rasterizer.min_y()))
+        {
+          continue;
+        }
+      scanline.reset(rasterizer.min_x(), rasterizer.max_x());
+      if (prim.type == DEFERRED_PATH)
+        {
+          renderer_aa.color(prim.color);
+          while (rasterizer.sweep_scanline(scanline) && scanline.y() <= y2)
+            {
+              renderer_aa.render(scanline);
+            }
+        }
+      else
+        {
+          agg::rendering_buffer pattern_rbuf(const_cast<agg::int8u *>(&tiles->patterns[prim.image]), 8, prim.height,
+                                             8 * pix_fmt_t::pix_width);
+          agg::pixfmt_rgba32 img_pixf(pattern_rbuf);
+          pattern_source_t img_src(img_pixf);
+          pattern_span_t sg(img_src, 0, 0);
+
+          sg.prepare();
+          while (rasterizer.sweep_scanline(scanline) && scanline.y() <= y2)
+            {
+              agg::render_scanline_aa(scanline, renderer, sa, sg);
+            }
+        }
+    }
+}
+
+static void flush_primitives()
+{
+  tile_queue_t *tiles = &p->tiles;
+  int num_threads = tiles->num_threads;
+  std::vector<std::thread> threads;
+
+  if (num_threads > p->height / MIN_ROWS_PER_THREAD)
+    {
+      num_threads = p->height / MIN_ROWS_PER_THREAD;
+    }
+  if (num_threads < 1)
+    {
+      num_threads = 1;
+    }
+  for (int i = 1; i < num_threads; i++)
+    {
+      int ymin = p->height * i / num_threads;
+      int ymax = p->height * (i + 1) / num_threads - 1;
+      try
+        {
+          threads.emplace_back(render_tile, tiles, &p->pix_fmt, ymin, ymax);
+        }
+      catch (const std::system_error &)
+        {
+          render_tile(tiles, &p->pix_fmt, ymin, ymax);
+        }
+    }
+  render_tile(tiles, &p->pix_fmt, 0, p->height / num_threads - 1);
+  for (auto &thread : threads)
+    {
+      thread.join();
+    }
+  discard_primitives();
+}
+
 static void open_page()
 {
   set_xform();
@@ -297,110 +640,183 @@ static void open_page()
   p->transparency = 1;
 }
 
-static void write_page()
+static void write_ppm(const page_job_t *job, FILE *fd)
 {
-  char path[MAXPATHLEN];
-
-  p->current_page_written = 1;
-  p->page_counter++;
+  std::vector<unsigned char> row((size_t)job->width * 3);
 
-  if (p->wtype == 170)
+  fprintf(fd, "P6 %d %d 255 ", job->width, job->height);
+  for (int j = 0; j < job->height; j++)
     {
-      /* PPM (p6) output */
-      gks_filepath(path, p->file_path, "ppm", p->page_counter, 0);
+      const unsigned char *pixel = &job->pixels[(size_t)j * job->width * pix_fmt_t::pix_width];
 
-      FILE *fd = fopen(path, "wb");
-      if (fd)
+      for (int i = 0; i < job->width; i++, pixel += pix_fmt_t::pix_width)
         {
-          fprintf(fd, "P6 %d %d 255 ", p->width, p->height);
-          for (int i = 0; i < p->width * p->height; i++)
-            {
-              int alpha = p->image_buffer[4 * i + 3];
-              for (int j = 2; j >= 0; j--)
-                {
-                  fputc(255 - alpha + p->image_buffer[4 * i + j], fd);
-                }
-            }
-          fclose(fd);
+          int alpha = pixel[3];
+
+          row[i * 3 + 0] = (unsigned char)(255 - alpha + pixel[2]);
+          row[i * 3 + 1] = (unsigned char)(255 - alpha + pixel[1]);
+          row[i * 3 + 2] = (unsigned char)(255 - alpha + pixel[0]);
         }
+      fwrite(row.data(), 1, row.size(), fd);
+    }
+}
+
+static void write_png(const page_job_t *job, FILE *fd)
+{
+  png_structp png_ptr;
+  png_infop info_ptr;
+
+  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  if (!png_ptr)
+    {
+      gks_perror("Cannot create PNG write struct.");
+      return;
+    }
+  info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr)
+    {
+      png_destroy_write_struct(&png_ptr, (png_infopp) nullptr);
+      gks_perror("Cannot create PNG info struct.");
+      return;
+    }
+  if (setjmp(png_jmpbuf(png_ptr)))
+    {
+      png_destroy_write_struct(&png_ptr, &info_ptr);
+      gks_perror("Cannot write PNG file.");
+      return;
     }
-  else if (p->wtype == 171)
+  png_init_io(png_ptr, fd);
+  if (job->options.png_level >= 0)
     {
-      /* PNG output */
-      png_structp png_ptr;
-      png_infop info_ptr;
-      png_bytepp row_pointers;
+      png_set_compression_level(png_ptr, job->options.png_level);
+    }
+  if (job->options.png_filters >= 0)
+    {
+      png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, job->options.png_filters);
+    }
+  png_set_IHDR(png_ptr, info_ptr, job->width, job->height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png_ptr, info_ptr);
+  png_set_bgr(png_ptr);
+  for (int j = 0; j < job->height; j++)
+    {
+      png_write_row(png_ptr, &job->pixels[(size_t)j * job->width * pix_fmt_t::pix_width]);
+    }
+  png_write_end(png_ptr, info_ptr);
+  png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+
+static void write_jpeg(const page_job_t *job, FILE *fd)
+{
+  std::vector<unsigned char> row((size_t)job->width * 3);
+  JSAMPROW row_pointer = row.data();
+  jpeg_compress_struct cinfo = {};
+  jpeg_error_mgr jerr = {};
+
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  jpeg_stdio_dest(&cinfo, fd);
+
+  cinfo.image_width = job->width;
+  cinfo.image_height = job->height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, job->options.jpeg_quality, TRUE);
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height)
+    {
+      const unsigned char *pixel = &job->pixels[(size_t)cinfo.next_scanline * job->width * pix_fmt_t::pix_width];
+
+      for (int i = 0; i < job->width; i++, pixel += pix_fmt_t::pix_width)
+        {
+          int alpha = pixel[3];
+
+          row[i * 3 + 0] = (unsigned char)(255 - alpha + pixel[2]);
+          row[i * 3 + 1] = (unsigned char)(255 - alpha + pixel[1]);
+          row[i * 3 + 2] = (unsigned char)(255 - alpha + pixel[0]);
+        }
+      jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+    }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+}
 
-      gks_filepath(path, p->file_path, "png", p->page_counter, 0);
-      FILE *fd = fopen(path, "wb");
+static void encode_page(page_job_t *job)
+/*
+   Write a copy of a finished page. This runs on the encoder thread and must
+   not access the workstation state.
+ */
+{
+  FILE *fd = fopen(job->path.c_str(), "wb");
 
-      png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-      if (!png_ptr)
+  if (fd != nullptr)
+    {
+      setvbuf(fd, nullptr, _IOFBF, 1 << 16);
+      if (job->wtype == 170)
         {
-          fclose(fd);
-          gks_perror("Cannot create PNG write struct.");
+          write_ppm(job, fd);
         }
-      info_ptr = png_create_info_struct(png_ptr);
-      if (!info_ptr)
+      else if (job->wtype == 171)
         {
-          fclose(fd);
-          png_destroy_write_struct(&png_ptr, (png_infopp) nullptr);
-          gks_perror("Cannot create PNG info struct.");
+          write_png(job, fd);
         }
-      png_init_io(png_ptr, fd);
-      png_set_IHDR(png_ptr, info_ptr, p->width, p->height, 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
-                   PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-
-      row_pointers = new png_bytep[p->height];
-      for (int i = 0; i < p->height; i++)
+      else
         {
-          row_pointers[i] = p->render_buffer.row_ptr(i);
+          write_jpeg(job, fd);
         }
-      png_set_rows(png_ptr, info_ptr, row_pointers);
-      png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_BGR, nullptr);
-
-      png_destroy_write_struct(&png_ptr, &info_ptr);
       fclose(fd);
-      delete[] row_pointers;
     }
-  else if (p->wtype == 172)
+  else
     {
-      /* JPG output */
-      auto *row = new unsigned char[p->width * 3];
-      jpeg_compress_struct cinfo = {};
-      jpeg_error_mgr jerr = {};
+      gks_perror("can't open image file");
+    }
+  delete job;
+}
 
-      gks_filepath(path, p->file_path, "jpg", p->page_counter, 0);
-      FILE *fd = fopen(path, "wb");
+static void wait_for_encoder()
+{
+  if (p->encoder.joinable())
+    {
+      p->encoder.join();
+    }
+}
 
-      cinfo.err = jpeg_std_error(&jerr);
-      jpeg_create_compress(&cinfo);
-      jpeg_stdio_dest(&cinfo, fd);
+static void write_page()
+{
+  char path[MAXPATHLEN];
 
-      cinfo.image_width = p->width;
-      cinfo.image_height = p->height;
-      cinfo.input_components = 3;
-      cinfo.in_color_space = JCS_RGB;
-      jpeg_set_defaults(&cinfo);
-      jpeg_set_quality(&cinfo, 100, TRUE);
+  if (!p->tiles.primitives.empty())
+    {
+      flush_primitives();
+    }
+  p->current_page_written = 1;
+  p->page_counter++;
 
-      jpeg_start_compress(&cinfo, TRUE);
-      while (cinfo.next_scanline < cinfo.image_height)
+  if (p->wtype == 170 || p->wtype == 171 || p->wtype == 172)
+    {
+      page_job_t *job = new page_job_t;
+
+      gks_filepath(path, p->file_path, p->wtype == 170 ? "ppm" : p->wtype == 171 ? "png" : "jpg", p->page_counter,
+                   0);
+      job->wtype = p->wtype;
+      job->path = path;
+      job->width = p->width;
+      job->height = p->height;
+      job->pixels.assign(p->image_buffer, p->image_buffer + (size_t)p->width * p->height * pix_fmt_t::pix_width);
+      job->options = p->options;
+
+      /* pages are encoded one at a time so that the files are written in order */
+      wait_for_encoder();
+      try
         {
-          for (int i = 0; i < p->width; i++)
-            {
-              int alpha = p->render_buffer.row_ptr((int)cinfo.next_scanline)[i * 4 + 3];
-              for (int j = 0; j < 3; j++)
-                {
-                  row[i * 3 + j] = 255 - alpha + p->render_buffer.row_ptr((int)cinfo.next_scanline)[i * 4 + (2 - j)];
-                }
-            }
-          jpeg_write_scanlines(&cinfo, &row, 1);
+          p->encoder = std::thread(encode_page, job);
+        }
+      catch (const std::system_error &)
+        {
+          encode_page(job);
         }
-      jpeg_finish_compress(&cinfo);
-      jpeg_destroy_compress(&cinfo);
-      fclose(fd);
-      delete[] row;
     }
   else if (p->wtype == 173)
     {
@@ -463,19 +879,277 @@ static void write_page()
 
 static void close_page()
 {
+  discard_primitives();
   p->renderer.reset_clipping(true);
   delete[] p->image_buffer;
 }
 
+static void record_primitive(deferred_primitive_t &prim)
+{
+  tile_queue_t *tiles = &p->tiles;
+  size_t size;
+
+  prim.clip_box = p->renderer.clip_box();
+  if (prim.ymin < prim.clip_box.y1)
+    {
+      prim.ymin = prim.clip_box.y1;
+    }
+  if (prim.ymax > prim.clip_box.y2)
+    {
+      prim.ymax = prim.clip_box.y2;
+    }
+  if (prim.ymin <= prim.ymax)
+    {
+      tiles->primitives.push_back(prim);
+    }
+  tiles->path_start = tiles->vertices.size();
+
+  size = tiles->vertices.size() * sizeof(deferred_vertex_t) + tiles->pixels.size() * sizeof(agg::rgba8) +
+         tiles->patterns.size() + tiles->sprites.size() * sizeof(tiles->sprites[0]) +
+         tiles->primitives.size() * sizeof(deferred_primitive_t);
+  if (size > MAX_DEFERRED_BYTES)
+    {
+      flush_primitives();
+    }
+}
+
+static void record_path(deferred_primitive_t &prim)
+{
+  tile_queue_t *tiles = &p->tiles;
+  double ymin = HUGE_VAL, ymax = -HUGE_VAL;
+  bool bounded = true;
+  size_t num_vertices = 0;
+
+  prim.filling_rule = p->filling_rule;
+  prim.first = tiles->path_start;
+  prim.count = tiles->vertices.size() - tiles->path_start;
+  for (size_t k = prim.first; k < prim.first + prim.count; k++)
+    {
+      if (agg::is_vertex(tiles->vertices[k].cmd))
+        {
+          double y = tiles->vertices[k].y;
+          num_vertices++;
+          if (!(fabs(y) < 1e6))
+            {
+              bounded = false;
+            }
+          else
+            {
+              if (y < ymin) ymin = y;
+              if (y > ymax) ymax = y;
+            }
+        }
+    }
+  if (num_vertices == 0)
+    {
+      tiles->vertices.resize(tiles->path_start);
+      return;
+    }
+  if (bounded)
+    {
+      /* the rasterizer may touch the rows adjacent to the outline */
+      prim.ymin = (int)floor(ymin) - 1;
+      prim.ymax = (int)floor(ymax) + 1;
+    }
+  else
+    {
+      prim.ymin = p->renderer.ymin();
+      prim.ymax = p->renderer.ymax();
+    }
+  record_primitive(prim);
+}
+
+static bool same_color(const agg::rgba8 &c1, const agg::rgba8 &c2)
+{
+  return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b && c1.a == c2.a;
+}
+
+static void capture_spans(const agg::rgba8 &color)
+/*
+   Append the coverage of the current outline to the marker sprite which is
+   being captured instead of rendering it.
+ */
+{
+  marker_sprite_t *sprite = p->capture;
+  marker_layer_t layer{!same_color(color, p->fill_col), sprite->spans.size(), 0};
+
+  if (p->rasterizer.rewind_scanlines())
+    {
+      p->scanline.reset(p->rasterizer.min_x(), p->rasterizer.max_x());
+      while (p->rasterizer.sweep_scanline(p->scanline))
+        {
+          int y = p->scanline.y();
+          unsigned num_spans = p->scanline.num_spans();
+          scanline_p8_t::const_iterator span = p->scanline.begin();
+
+          if (sprite->ymin > sprite->ymax)
+            {
+              sprite->ymin = sprite->ymax = y;
+            }
+          if (y < sprite->ymin) sprite->ymin = y;
+          if (y > sprite->ymax) sprite->ymax = y;
+          for (;;)
+            {
+              sprite->spans.push_back({span->x, y, span->len, sprite->covers.size()});
+              sprite->covers.insert(sprite->covers.end(), span->covers, span->covers + (span->len < 0 ? 1 : span->len));
+              if (--num_spans == 0)
+                {
+                  break;
+                }
+              ++span;
+            }
+        }
+    }
+  layer.count = sprite->spans.size() - layer.first;
+  if (layer.count > 0)
+    {
+      sprite->layers.push_back(layer);
+    }
+}
+
+static void reset_path()
+{
+  if (p->capture != nullptr)
+    {
+      p->rasterizer.reset();
+    }
+  else if (p->tiles.num_threads > 1)
+    {
+      p->tiles.vertices.resize(p->tiles.path_start);
+    }
+  else
+    {
+      p->rasterizer.reset();
+    }
+}
+
+template <class VertexSource> static void add_path(VertexSource &vs)
+{
+  if (p->tiles.num_threads > 1 && p->capture == nullptr)
+    {
+      double x, y;
+      unsigned cmd;
+
+      vs.rewind(0);
+      while (!agg::is_stop(cmd = vs.vertex(&x, &y)))
+        {
+          p->tiles.vertices.push_back({x, y, cmd});
+        }
+    }
+  else
+    {
+      p->rasterizer.add_path(vs);
+    }
+}
+
+static void set_filling_rule(agg::filling_rule_e filling_rule)
+{
+  p->filling_rule = filling_rule;
+  p->rasterizer.filling_rule(filling_rule);
+}
+
+static void render_path(const agg::rgba8 &color)
+{
+  if (p->capture != nullptr)
+    {
+      capture_spans(color);
+    }
+  else if (p->tiles.num_threads > 1)
+    {
+      deferred_primitive_t prim{};
+
+      prim.type = DEFERRED_PATH;
+      prim.color = color;
+      record_path(prim);
+    }
+  else
+    {
+      p->renderer_aa.color(color);
+      agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
+    }
+}
+
+static void render_pattern(agg::int8u *pattern, int size)
+{
+  if (p->tiles.num_threads > 1)
+    {
+      deferred_primitive_t prim{};
+
+      prim.type = DEFERRED_PATTERN;
+      prim.image = p->tiles.patterns.size();
+      prim.height = size;
+      p->tiles.patterns.insert(p->tiles.patterns.end(), pattern, pattern + 8 * size * pix_fmt_t::pix_width);
+      record_path(prim);
+    }
+  else
+    {
+      agg::rendering_buffer pattern_rbuf(pattern, 8, size, 8 * pix_fmt_t::pix_width);
+      agg::pixfmt_rgba32 img_pixf(pattern_rbuf);
+      agg::span_allocator<agg::rgba8> sa;
+      pattern_source_t img_src(img_pixf);
+      pattern_span_t sg(img_src, 0, 0);
+
+      agg::render_scanlines_aa(p->rasterizer, p->scanline, p->renderer, sa, sg);
+    }
+}
+
+static void blend_pixels(int x, int y, int width, int height, const agg::rgba8 *colors)
+{
+  if (p->capture != nullptr)
+    {
+      marker_sprite_t *sprite = p->capture;
+
+      for (int j = 0; j < height; j++)
+        {
+          for (int i = 0; i < width; i++)
+            {
+              bool border = !same_color(colors[(size_t)j * width + i], p->fill_col);
+
+              sprite->layers.push_back({border, sprite->spans.size(), 1});
+              sprite->spans.push_back({x + i, y + j, -1, sprite->covers.size()});
+              sprite->covers.push_back(agg::cover_full);
+            }
+        }
+      if (sprite->ymin > sprite->ymax)
+        {
+          sprite->ymin = y;
+          sprite->ymax = y + height - 1;
+        }
+      if (y < sprite->ymin) sprite->ymin = y;
+      if (y + height - 1 > sprite->ymax) sprite->ymax = y + height - 1;
+    }
+  else if (p->tiles.num_threads > 1)
+    {
+      deferred_primitive_t prim{};
+
+      prim.type = DEFERRED_PIXELS;
+      prim.image = p->tiles.pixels.size();
+      prim.x = x;
+      prim.y = y;
+      prim.width = width;
+      prim.height = height;
+      prim.ymin = y;
+      prim.ymax = y + height - 1;
+      p->tiles.pixels.insert(p->tiles.pixels.end(), colors, colors + (size_t)width * height);
+      record_primitive(prim);
+    }
+  else
+    {
+      for (int j = 0; j < height; j++)
+        {
+          p->renderer.blend_color_hspan(x, y + j, width, colors + (size_t)j * width, nullptr);
+        }
+    }
+}
+
 static void fill_path(agg::path_storage &path)
 {
   path.close_polygon();
-  p->rasterizer.reset();
-  p->rasterizer.add_path(p->curve);
-  p->renderer_aa.color(p->fill_col);
-  p->rasterizer.filling_rule(agg::fill_even_odd);
-  agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
-  p->rasterizer.filling_rule(agg::fill_non_zero);
+  reset_path();
+  add_path(p->curve);
+  set_filling_rule(agg::fill_even_odd);
+  render_path(p->fill_col);
+  set_filling_rule(agg::fill_non_zero);
   p->path.remove_all();
 }
 
@@ -485,26 +1159,23 @@ static void stroke_path(agg::path_storage &path, bool close = true)
     {
       path.close_polygon();
     }
-  p->rasterizer.reset();
-  p->rasterizer.add_path(p->stroke);
-  p->renderer_aa.color(p->stroke_col);
-  agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
+  reset_path();
+  add_path(p->stroke);
+  render_path(p->stroke_col);
   p->path.remove_all();
 }
 
 static void fill_stroke_path(agg::path_storage &path)
 {
   path.close_polygon();
-  p->rasterizer.reset();
-  p->rasterizer.add_path(p->curve);
-  p->renderer_aa.color(p->fill_col);
-  p->rasterizer.filling_rule(agg::fill_even_odd);
-  agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
-  p->rasterizer.filling_rule(agg::fill_non_zero);
-  p->rasterizer.reset();
-  p->rasterizer.add_path(p->stroke);
-  p->renderer_aa.color(p->stroke_col);
-  agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
+  reset_path();
+  add_path(p->curve);
+  set_filling_rule(agg::fill_even_odd);
+  render_path(p->fill_col);
+  set_filling_rule(agg::fill_non_zero);
+  reset_path();
+  add_path(p->stroke);
+  render_path(p->stroke_col);
   p->path.remove_all();
 }
 
@@ -515,14 +1186,14 @@ static void text_routine(double x, double y, int nchars, char *chars)
   int height = p->height;
   int px, py;
   unsigned char *alpha_pixels;
-  unsigned char *bgra_pixels;
+  agg::rgba8 *colors;
   double red, green, blue;
 
   NDC_to_DC(x, y, px, py);
   py = p->height - py;
 
   alpha_pixels = gks_ft_get_bitmap(&px, &py, &width, &height, gkss, chars, nchars);
-  bgra_pixels = new unsigned char[pix_fmt_t::pix_width * height * width];
+  colors = new agg::rgba8[height * width];
 
   gks_inq_rgb(p->color, &red, &green, &blue);
   for (i = 0; i < height; i++)
@@ -530,11 +1201,11 @@ static void text_routine(double x, double y, int nchars, char *chars)
       for (j = 0; j < width; j++)
         {
           double alpha = alpha_pixels[i * width + j] / 255.0;
-          p->renderer.blend_pixel(px + j, p->height - py - height + i, agg::rgba(red, green, blue, alpha),
-                                  agg::cover_full);
+          colors[i * width + j] = agg::rgba(red, green, blue, alpha);
         }
     }
-  delete[] bgra_pixels;
+  blend_pixels(px, p->height - py - height, width, height, colors);
+  delete[] colors;
   gks_free(alpha_pixels);
 }
 
@@ -564,12 +1235,11 @@ static void line_routine(int n, double *px, double *py, int linetype, int tnr)
         {
           dashes.add_dash(gks_dashes[i + 1], gks_dashes[i + 2]);
         }
-      p->rasterizer.reset();
+      reset_path();
       agg::conv_stroke<agg::conv_dash<agg::conv_curve<agg::path_storage>>> stroke(dashes);
       stroke.width(p->linewidth);
-      p->rasterizer.add_path(stroke);
-      p->renderer_aa.color(p->stroke_col);
-      agg::render_scanlines(p->rasterizer, p->scanline, p->renderer_aa);
+      add_path(stroke);
+      render_path(p->stroke_col);
       p->path.remove_all();
     }
   else
@@ -630,11 +1300,6 @@ static void fill_routine(int n, double *px, double *py, int tnr)
       gks_inq_pattern_array(fl_style, gks_pattern);
       size = gks_pattern[0];
 
-      typedef agg::wrap_mode_repeat wrap_x_type;
-      typedef agg::wrap_mode_repeat wrap_y_type;
-      typedef agg::image_accessor_wrap<agg::pixfmt_rgba32, wrap_x_type, wrap_y_type> img_source_type;
-      typedef agg::span_pattern_rgba<img_source_type> span_gen_type;
-
       auto *m_pattern = new agg::int8u[8 * size * pix_fmt_t::pix_width];
       agg::rendering_buffer m_pattern_rbuf(m_pattern, 8, size, 8 * pix_fmt_t::pix_width);
       agg::pixfmt_rgba32 img_pixf(m_pattern_rbuf);
@@ -658,15 +1323,12 @@ static void fill_routine(int n, double *px, double *py, int tnr)
             }
         }
 
-      agg::span_allocator<agg::rgba8> sa;
-      img_source_type img_src(img_pixf);
-      span_gen_type sg(img_src, 0, 0);
-
       p->path.close_polygon();
-      p->rasterizer.reset();
-      p->rasterizer.add_path(p->path);
-      agg::render_scanlines_aa(p->rasterizer, p->scanline, p->renderer, sa, sg);
+      reset_path();
+      add_path(p->path);
+      render_pattern(m_pattern, size);
       p->path.remove_all();
+      delete[] m_pattern;
       return;
     }
 
@@ -677,7 +1339,7 @@ static void fill_routine(int n, double *px, double *py, int tnr)
     }
   else
     {
-      p->rasterizer.filling_rule(agg::fill_non_zero);
+      set_filling_rule(agg::fill_non_zero);
       p->stroke.width(p->linewidth);
       p->stroke.line_cap(agg::round_cap);
       p->stroke.line_join(agg::round_join);
@@ -727,30 +1389,14 @@ static void polyline(int n, double *px, double *py)
   line_routine(n, px, py, ln_type, gkss->cntnr);
 }
 
-static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+static void emit_marker(double x, double y, int mtype, double r, double scale)
 {
-  double x, y;
-  double scale, xr, yr, x1, x2, y1, y2;
+  double xr, yr, x1, x2, y1, y2;
   int pc, op, i;
-  double r;
 
 #include "marker.h"
 
-  mscale *= p->nominal_size;
-  r = 3 * mscale;
-  scale = 0.01 * mscale / 3.0;
-
-  xr = r;
-  yr = 0;
-  seg_xform_rel(xr, yr);
-  r = sqrt(xr * xr + yr * yr);
-  NDC_to_DC(xn, yn, x, y);
-
   pc = 0;
-  mtype = (r > 0) ? mtype + marker_off : marker_off + 1;
-
-  p->stroke_col = p->fill_col = agg::rgba(p->rgb[mcolor][0], p->rgb[mcolor][1], p->rgb[mcolor][2], p->transparency);
-  p->stroke.width(gkss->bwidth * p->nominal_size);
 
   do
     {
@@ -758,7 +1404,7 @@ static void draw_marker(double xn, double yn, int mtype, double mscale, int mcol
       switch (op)
         {
         case 1: /* point */
-          p->renderer.blend_pixel((int)round(x), (int)round(y), p->fill_col, agg::cover_full);
+          blend_pixels((int)round(x), (int)round(y), 1, 1, &p->fill_col);
           break;
 
         case 2: /* line */
@@ -852,6 +1498,139 @@ static void draw_marker(double xn, double yn, int mtype, double mscale, int mcol
   while (op != 0);
 }
 
+static std::shared_ptr<marker_sprite_t> marker_sprite(double x, double y, int mtype, double mscale, double r,
+                                                      double scale, bool border, int &ix, int &iy)
+{
+  double bwidth = gkss->bwidth * p->nominal_size, qx, qy;
+  int phase_x, phase_y;
+  unsigned hash;
+  marker_sprite_t *sprite;
+
+  if (!(fabs(x) < 1e6 && fabs(y) < 1e6) || !(2 * r + bwidth < MAX_MARKER_EXTENT))
+    {
+      return nullptr;
+    }
+  qx = floor(x * MARKER_PHASES + 0.5);
+  qy = floor(y * MARKER_PHASES + 0.5);
+  ix = (int)floor(qx / MARKER_PHASES);
+  iy = (int)floor(qy / MARKER_PHASES);
+  phase_x = (int)qx - ix * MARKER_PHASES;
+  phase_y = (int)qy - iy * MARKER_PHASES;
+
+  hash = (unsigned)mtype * 31u + (unsigned)(phase_x * MARKER_PHASES + phase_y) * 67u + (unsigned)(mscale * 8) * 257u +
+         (border ? 1u : 0u);
+  std::shared_ptr<marker_sprite_t> &entry = p->markers[hash % MARKER_CACHE_SIZE];
+
+  sprite = entry.get();
+  if (sprite != nullptr && sprite->mtype == mtype && sprite->phase_x == phase_x && sprite->phase_y == phase_y &&
+      sprite->mscale == mscale && sprite->bwidth == bwidth && sprite->mat[0][0] == gkss->mat[0][0] &&
+      sprite->mat[0][1] == gkss->mat[0][1] && sprite->mat[1][0] == gkss->mat[1][0] &&
+      sprite->mat[1][1] == gkss->mat[1][1] && sprite->line_cap == p->stroke.line_cap() &&
+      sprite->line_join == p->stroke.line_join() && sprite->border == border)
+    {
+      return entry;
+    }
+
+  /* sprites which are still queued for tiled rendering are kept alive by the queue, others are recycled */
+  if (sprite != nullptr && entry.use_count() == 1)
+    {
+      sprite->ymin = 1;
+      sprite->ymax = 0;
+      sprite->layers.clear();
+      sprite->spans.clear();
+      sprite->covers.clear();
+    }
+  else
+    {
+      entry = std::make_shared<marker_sprite_t>();
+      sprite = entry.get();
+    }
+  sprite->mtype = mtype;
+  sprite->phase_x = phase_x;
+  sprite->phase_y = phase_y;
+  sprite->mscale = mscale;
+  sprite->bwidth = bwidth;
+  sprite->mat[0][0] = gkss->mat[0][0];
+  sprite->mat[0][1] = gkss->mat[0][1];
+  sprite->mat[1][0] = gkss->mat[1][0];
+  sprite->mat[1][1] = gkss->mat[1][1];
+  sprite->line_cap = p->stroke.line_cap();
+  sprite->line_join = p->stroke.line_join();
+  sprite->border = border;
+
+  p->capture = sprite;
+  emit_marker((double)phase_x / MARKER_PHASES, (double)phase_y / MARKER_PHASES, mtype, r, scale);
+  p->capture = nullptr;
+
+  return entry;
+}
+
+static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+{
+  double x, y;
+  double scale, xr, yr;
+  double r;
+  int ix, iy;
+  agg::rgba8 border_col;
+  std::shared_ptr<marker_sprite_t> sprite;
+
+  mscale *= p->nominal_size;
+  r = 3 * mscale;
+  scale = 0.01 * mscale / 3.0;
+
+  xr = r;
+  yr = 0;
+  seg_xform_rel(xr, yr);
+  r = sqrt(xr * xr + yr * yr);
+  NDC_to_DC(xn, yn, x, y);
+
+  mtype = (r > 0) ? mtype + marker_off : marker_off + 1;
+
+  p->stroke_col = p->fill_col = agg::rgba(p->rgb[mcolor][0], p->rgb[mcolor][1], p->rgb[mcolor][2], p->transparency);
+  p->stroke.width(gkss->bwidth * p->nominal_size);
+
+  /* dots are a single pixel and not worth caching */
+  if (mtype == marker_off + 1)
+    {
+      emit_marker(x, y, mtype, r, scale);
+      return;
+    }
+
+  border_col = p->fill_col;
+  if (gkss->bcoli != gkss->pmcoli)
+    {
+      border_col = agg::rgba(p->rgb[gkss->bcoli][0], p->rgb[gkss->bcoli][1], p->rgb[gkss->bcoli][2], p->transparency);
+    }
+  sprite = marker_sprite(x, y, mtype, mscale, r, scale, !same_color(border_col, p->fill_col), ix, iy);
+  if (sprite == nullptr)
+    {
+      emit_marker(x, y, mtype, r, scale);
+    }
+  else if (sprite->ymin <= sprite->ymax)
+    {
+      if (p->tiles.num_threads > 1)
+        {
+          deferred_primitive_t prim{};
+
+          prim.type = DEFERRED_SPRITE;
+          prim.image = p->tiles.sprites.size();
+          prim.color = p->fill_col;
+          prim.border_color = border_col;
+          prim.x = ix;
+          prim.y = iy;
+          prim.ymin = sprite->ymin + iy;
+          prim.ymax = sprite->ymax + iy;
+          p->tiles.sprites.push_back(sprite);
+          record_primitive(prim);
+        }
+      else
+        {
+          blend_sprite(p->renderer, sprite.get(), ix, iy, p->renderer.ymin(), p->renderer.ymax(), p->fill_col,
+                       border_col);
+        }
+    }
+}
+
 static void polymarker(int n, const double *px, const double *py)
 {
   int mk_type, mk_color, i;
@@ -874,9 +1653,9 @@ static void fillarea(int n, double *px, double *py)
   p->linewidth = gkss->bwidth * p->nominal_size;
   p->color = gkss->asf[12] ? gkss->facoli : 1;
 
-  p->rasterizer.filling_rule(agg::fill_even_odd);
+  set_filling_rule(agg::fill_even_odd);
   fill_routine(n, px, py, gkss->cntnr);
-  p->rasterizer.filling_rule(agg::fill_non_zero);
+  set_filling_rule(agg::fill_non_zero);
 }
 
 static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx, int dy, int dimx, int *colia,
@@ -886,9 +1665,10 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   int x, y;
   int ix1, ix2, iy1, iy2;
   int width, height;
-  int i, j, ix, iy, ind;
+  int i, j, ix, iy;
   int swapx, swapy;
   unsigned char *data;
+  agg::rgba8 *colors;
 
   WC_to_NDC(xmin, ymax, gkss->cntnr, x1, y1);
   seg_xform(x1, y1);
@@ -907,29 +1687,53 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   swapx = ix1 > ix2;
   swapy = iy1 < iy2;
 
+  /* the image is blended row by row, one span per row */
+  colors = new agg::rgba8[width];
   if (true_color)
     {
       data = new unsigned char[width * height * pix_fmt_t::pix_width];
       gks_resample((unsigned char *)colia, data, (size_t)dx, (size_t)dy, (size_t)width, (size_t)height, (size_t)dimx,
                    swapx, swapy, gkss->resample_method);
-      for (i = width - 1; i >= 0; i--)
+      for (j = 0; j < height; j++)
         {
-          for (j = height - 1; j >= 0; j--)
+          const unsigned char *row = data + (size_t)j * width * pix_fmt_t::pix_width;
+          if (p->transparency == 1)
             {
-              int red, green, blue, alpha;
-              red = data[(j * width + i) * pix_fmt_t::pix_width + 0];
-              green = data[(j * width + i) * pix_fmt_t::pix_width + 1];
-              blue = data[(j * width + i) * pix_fmt_t::pix_width + 2];
-              alpha = (int)(data[(j * width + i) * pix_fmt_t::pix_width + 3] * p->transparency);
-
-              agg::rgba8 col = agg::rgba8(red, green, blue, alpha);
-              p->renderer.blend_pixel(x + i, y + j, col, agg::cover_full);
+              /* the resampled RGBA bytes already have the memory layout of agg::rgba8 */
+              blend_pixels(x, y + j, width, 1, reinterpret_cast<const agg::rgba8 *>(row));
+              continue;
             }
+          for (i = 0; i < width; i++)
+            {
+              colors[i] = agg::rgba8(row[4 * i + 0], row[4 * i + 1], row[4 * i + 2],
+                                     (int)(row[4 * i + 3] * p->transparency));
+            }
+          blend_pixels(x, y + j, width, 1, colors);
         }
       delete[] data;
     }
   else
     {
+      auto *colormap = new agg::rgba8[MAX_COLOR];
+      auto *columns = new int[width];
+      int last_iy = -1;
+
+      for (i = 0; i < MAX_COLOR; i++)
+        {
+          double alpha = p->transparency;
+          colormap[i] = agg::rgba(alpha * p->rgb[i][0], alpha * p->rgb[i][1], alpha * p->rgb[i][2], alpha);
+        }
+      /* source column of each target column, computed by integer stepping */
+      ix = 0;
+      for (i = 0, j = 0; i < width; i++, j += dx)
+        {
+          while (j >= width)
+            {
+              j -= width;
+              ix++;
+            }
+          columns[i] = swapx ? dx - 1 - ix : ix;
+        }
       for (j = 0; j < height; j++)
         {
           iy = dy * j / height;
@@ -937,26 +1741,22 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
             {
               iy = dy - 1 - iy;
             }
-          for (i = 0; i < width; i++)
+          if (iy != last_iy)
             {
-              double red, green, blue, alpha;
-              ix = dx * i / width;
-              if (swapx)
+              const int *row = colia + (size_t)iy * dimx;
+              for (i = 0; i < width; i++)
                 {
-                  ix = dx - 1 - ix;
+                  int ind = row[columns[i]];
+                  colors[i] = colormap[FIX_COLORIND(ind)];
                 }
-              ind = colia[iy * dimx + ix];
-              ind = FIX_COLORIND(ind);
-              alpha = p->transparency;
-              red = alpha * p->rgb[ind][0];
-              green = alpha * p->rgb[ind][1];
-              blue = alpha * p->rgb[ind][2];
-
-              agg::rgba col = agg::rgba(red, green, blue, alpha);
-              p->renderer.blend_pixel(x + i, y + j, col, agg::cover_full);
+              last_iy = iy;
             }
+          blend_pixels(x, y + j, width, 1, colors);
         }
+      delete[] columns;
+      delete[] colormap;
     }
+  delete[] colors;
 }
 
 static void to_DC(int n, double *x, double *y)
@@ -1313,6 +2113,12 @@ static void gdp(int n, double *px, double *py, int primid, int nc, int *codes)
     case GKS_K_GDP_FILL_POLYGONS:
       fill_polygons(n, px, py, nc, codes);
       break;
+    case GKS_K_GDP_DRAW_POLYLINES:
+      gks_emul_polylines(n, px, py, nc, codes, &gkss->plcoli, polyline);
+      break;
+    case GKS_K_GDP_FILL_AREAS:
+      gks_emul_fillareas(n, px, py, nc, codes, &gkss->facoli, fillarea);
+      break;
     default:
       gks_perror("invalid drawing primitive ('%d')", primid);
       exit(1);
@@ -1328,6 +2134,14 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
 
   p = (ws_state_list *)*ptr;
 
+  if (fctid != 2 && p != nullptr && p->gkss != gkss)
+    {
+      /* the workstation belongs to another GKS context */
+      gkss = p->gkss;
+      gks_init_core(gkss);
+      init_norm_xform();
+    }
+
   switch (fctid)
     {
     case 2:
@@ -1335,9 +2149,12 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
       gks_init_core(gkss);
 
       p = new ws_state_list;
+      p->gkss = gkss;
       p->wtype = i_arr[2];
       p->file_path = c_arr;
       p->page_counter = 0;
+      p->tiles.num_threads = agg_thread_count();
+      read_encoder_options();
 
       if (p->wtype == 170 || p->wtype == 171 || p->wtype == 172)
         {
@@ -1438,6 +2255,7 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
         }
 
       close_page();
+      wait_for_encoder();
       delete p;
       break;
 
@@ -1453,6 +2271,7 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
 
     case 6:
       /* clear workstation */
+      discard_primitives();
       p->renderer.reset_clipping(true);
       p->renderer.clear(agg::rgba(0, 0, 0, 0));
       break;
@@ -1586,6 +2405,15 @@ void gks_aggplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_ar
       set_transparency(f_arr_1[0]);
       break;
 
+    case 205:
+      /* configure workstation: pick up changed GKS_PNG_COMPRESSION, GKS_PNG_FILTER and GKS_JPEG_QUALITY settings */
+      read_encoder_options();
+      f_arr_1[0] = p->mw;
+      f_arr_2[0] = p->mh;
+      i_arr[0] = p->width;
+      i_arr[1] = p->height;
+      break;
+
     default:
       break;
     }
@@ -25,6 +25,7 @@
 #include <string.h>
 #ifdef _MSC_VER
 typedef __int64 int64_t;
+typedef unsigned __int32 uint32_t;
 #else
 #include <stdint.h>
 #endif
@@ -87,6 +88,8 @@ DLLEXPORT void gks_cairoplugin(int fctid, int dx, int dy, int dimx, int *i_arr,
 #ifndef NO_CAIRO
 
 #define MAX_POINTS 2048
+#define SIMPLIFY_THRESHOLD 1024
+#define SIMPLIFY_TOLERANCE 0.5
 #define PATTERNS 120
 #define HATCH_STYLE 108
 
@@ -100,6 +103,10 @@ DLLEXPORT void gks_cairoplugin(int fctid, int dx, int dy, int dimx, int *i_arr,
 
 #define MAX_TNR 9
 
+#define MARKER_CACHE_SIZE 256
+#define MARKER_PHASES 4
+#define MAX_MARKER_SPRITE 256
+
 #define HEIGHT_IN_CELLS 24
 
 #define STR(x) #x
@@ -139,9 +146,9 @@ DLLEXPORT void gks_cairoplugin(int fctid, int dx, int dy, int dimx, int *i_arr,
 /* set this flag so that the exit handler won't try to use Cairo X11 support */
 static int exit_due_to_x11_support_ = 0;
 
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss;
 
-static double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
+static GKS_THREAD_LOCAL double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
 
 #ifndef _WIN32
 enum tmux_state_t
@@ -160,6 +167,14 @@ typedef struct cairo_point_t
   double x, y;
 } cairo_point;
 
+typedef struct
+{
+  cairo_surface_t *surface;
+  int mtype, phase_x, phase_y, line_cap, line_join;
+  double mscale, bwidth, line_width, mat[2][2];
+  double rgb[3], border_rgb[3], transparency;
+} marker_sprite_t;
+
 typedef struct ws_state_list_t
 {
   int conid, state, wtype;
@@ -199,9 +214,11 @@ typedef struct ws_state_list_t
   unsigned char *patterns;
   int pattern_counter, use_symbols;
   double dashes[10];
+  marker_sprite_t markers[MARKER_CACHE_SIZE];
+  gks_state_list_t *gkss;
 } ws_state_list;
 
-static ws_state_list *p;
+static GKS_THREAD_LOCAL ws_state_list *p;
 
 static int idle = 0;
 
@@ -301,26 +318,13 @@ static void set_line_width(double width)
   cairo_set_line_width(p->cr, width > 1 / 16. ? width : 1 / 16.);
 }
 
-static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+static void emit_marker(double x, double y, int mtype, double r, double scale, int mcolor)
 {
-  double x, y;
-  double scale, xr, yr, x1, x2, y1, y2;
+  double xr, yr, x1, x2, y1, y2;
   int pc, op, i;
-  double r;
 
 #include "marker.h"
 
-  mscale *= p->nominal_size;
-  r = 3 * mscale;
-  scale = 0.01 * mscale / 3.0;
-
-  xr = r;
-  yr = 0;
-  seg_xform_rel(&xr, &yr);
-  r = sqrt(xr * xr + yr * yr);
-
-  NDC_to_DC(xn, yn, x, y);
-
   pc = 0;
   mtype = (r > 0) ? mtype + marker_off : marker_off + 1;
 
@@ -427,6 +431,163 @@ static void draw_marker(double xn, double yn, int mtype, double mscale, int mcol
   while (op != 0);
 }
 
+static cairo_surface_t *marker_sprite(double x, double y, int mtype, double mscale, double r, double scale, int mcolor,
+                                      double *sx, double *sy)
+/*
+   Return a prerendered image of the given marker and its position on the
+   page. Sprites are cached by marker type, size, segment transformation,
+   colors, the stroke state inherited from the page and the subpixel phase of
+   the marker center, which is rounded to 1/MARKER_PHASES of a pixel. Returns
+   NULL if the marker is too large.
+ */
+{
+  marker_sprite_t *m;
+  double bwidth = gkss->bwidth * p->nominal_size, extent, ex, ey, border_rgb[3];
+  double mat[2][2], line_width = cairo_get_line_width(p->cr);
+  int ix, iy, phase_x, phase_y, origin, size, border = gkss->bcoli != gkss->pmcoli;
+  int line_cap = (int)cairo_get_line_cap(p->cr), line_join = (int)cairo_get_line_join(p->cr);
+  unsigned int hash;
+  cairo_t *cr, *saved_cr;
+
+  mat[0][0] = gkss->mat[0][0];
+  mat[0][1] = gkss->mat[0][1];
+  mat[1][0] = gkss->mat[1][0];
+  mat[1][1] = gkss->mat[1][1];
+
+  /* marker coordinates range from -1000 to 1000 in units of scale */
+  ex = 1000 * scale * (fabs(mat[0][0]) + fabs(mat[0][1]));
+  ey = 1000 * scale * (fabs(mat[1][0]) + fabs(mat[1][1]));
+  extent = max(r, max(ex, ey)) + max(bwidth, p->nominal_size) + 2;
+  if (!(extent < MAX_MARKER_SPRITE / 2) || !(fabs(x) < 1e6 && fabs(y) < 1e6)) return NULL;
+  origin = (int)ceil(extent);
+  size = 2 * origin + 2;
+
+  ix = (int)floor(x);
+  iy = (int)floor(y);
+  phase_x = (int)floor((x - ix) * MARKER_PHASES + 0.5);
+  phase_y = (int)floor((y - iy) * MARKER_PHASES + 0.5);
+  if (phase_x == MARKER_PHASES)
+    {
+      ix++;
+      phase_x = 0;
+    }
+  if (phase_y == MARKER_PHASES)
+    {
+      iy++;
+      phase_y = 0;
+    }
+  *sx = ix - origin;
+  *sy = iy - origin;
+
+  if (border)
+    {
+      memmove(border_rgb, p->rgb[gkss->bcoli], sizeof(border_rgb));
+    }
+  else
+    {
+      border_rgb[0] = border_rgb[1] = border_rgb[2] = -1;
+    }
+
+  hash = (unsigned int)(mtype + marker_off) * 31u + (unsigned int)(phase_x * MARKER_PHASES + phase_y) * 17u +
+         (unsigned int)(mscale * 64) + (unsigned int)(p->rgb[mcolor][0] * 255) * 7u +
+         (unsigned int)(p->rgb[mcolor][1] * 255) * 13u + (unsigned int)(p->rgb[mcolor][2] * 255) * 19u;
+  m = p->markers + hash % MARKER_CACHE_SIZE;
+
+  if (m->surface != NULL && m->mtype == mtype && m->phase_x == phase_x && m->phase_y == phase_y &&
+      m->mscale == mscale && m->bwidth == bwidth && m->line_width == line_width && m->line_cap == line_cap &&
+      m->line_join == line_join && m->transparency == p->transparency &&
+      memcmp(m->mat, mat, sizeof(mat)) == 0 && memcmp(m->rgb, p->rgb[mcolor], sizeof(m->rgb)) == 0 &&
+      memcmp(m->border_rgb, border_rgb, sizeof(border_rgb)) == 0)
+    {
+      return m->surface;
+    }
+
+  if (m->surface != NULL)
+    {
+      cairo_surface_destroy(m->surface);
+      m->surface = NULL;
+    }
+  m->surface = cairo_surface_create_similar(cairo_get_target(p->cr), CAIRO_CONTENT_COLOR_ALPHA, size, size);
+  if (cairo_surface_status(m->surface) != CAIRO_STATUS_SUCCESS)
+    {
+      cairo_surface_destroy(m->surface);
+      m->surface = NULL;
+      return NULL;
+    }
+
+  m->mtype = mtype;
+  m->phase_x = phase_x;
+  m->phase_y = phase_y;
+  m->mscale = mscale;
+  m->bwidth = bwidth;
+  m->line_width = line_width;
+  m->line_cap = line_cap;
+  m->line_join = line_join;
+  m->transparency = p->transparency;
+  memmove(m->mat, mat, sizeof(mat));
+  memmove(m->rgb, p->rgb[mcolor], sizeof(m->rgb));
+  memmove(m->border_rgb, border_rgb, sizeof(border_rgb));
+
+  /* render the marker with the regular drawing code and the current stroke state into the sprite */
+  cr = cairo_create(m->surface);
+  cairo_set_line_width(cr, line_width);
+  cairo_set_line_cap(cr, (cairo_line_cap_t)line_cap);
+  cairo_set_line_join(cr, (cairo_line_join_t)line_join);
+  saved_cr = p->cr;
+  p->cr = cr;
+  emit_marker(origin + (double)phase_x / MARKER_PHASES, origin + (double)phase_y / MARKER_PHASES, mtype, r, scale,
+              mcolor);
+  p->cr = saved_cr;
+  cairo_destroy(cr);
+
+  return m->surface;
+}
+
+static void free_marker_sprites(void)
+{
+  int i;
+
+  for (i = 0; i < MARKER_CACHE_SIZE; i++)
+    {
+      if (p->markers[i].surface != NULL)
+        {
+          cairo_surface_destroy(p->markers[i].surface);
+          p->markers[i].surface = NULL;
+        }
+    }
+}
+
+static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+{
+  double x, y, sx, sy;
+  double scale, xr, yr;
+  double r;
+  cairo_surface_t *sprite;
+
+  mscale *= p->nominal_size;
+  r = 3 * mscale;
+  scale = 0.01 * mscale / 3.0;
+
+  xr = r;
+  yr = 0;
+  seg_xform_rel(&xr, &yr);
+  r = sqrt(xr * xr + yr * yr);
+
+  NDC_to_DC(xn, yn, x, y);
+
+  sprite = marker_sprite(x, y, mtype, mscale, r, scale, mcolor, &sx, &sy);
+  if (sprite != NULL)
+    {
+      cairo_set_source_surface(p->cr, sprite, sx, sy);
+      cairo_paint(p->cr);
+      set_color(mcolor);
+    }
+  else
+    {
+      emit_marker(x, y, mtype, r, scale, mcolor);
+    }
+}
+
 static void polymarker(int n, double *px, double *py)
 {
   int mk_type, mk_color, i;
@@ -445,10 +606,134 @@ static void polymarker(int n, double *px, double *py)
     }
 }
 
+/*
+   Long solid polylines are simplified in device space before they are
+   handed to Cairo. If x is monotone, each pixel column is reduced to its
+   first, lowest, highest and last point, which covers the same pixels.
+   Other paths drop points closer than a quarter pixel to their predecessor
+   and are then reduced with the Douglas-Peucker algorithm at a quarter
+   pixel tolerance, so the result stays within half a pixel of the input.
+ */
+
+static int decimate_columns(cairo_point *points, int n)
+{
+  int i, j, k, m, start, dir = 0, idx[4], t;
+  double column;
+
+  for (i = 1; i < n; i++)
+    {
+      if (points[i].x == points[i - 1].x) continue;
+      if (dir == 0)
+        dir = points[i].x > points[i - 1].x ? 1 : -1;
+      else if ((points[i].x - points[i - 1].x) * dir < 0)
+        return 0;
+    }
+
+  m = 0;
+  for (start = 0; start < n; start = i)
+    {
+      column = floor(points[start].x);
+      idx[0] = idx[1] = idx[2] = start;
+      for (i = start + 1; i < n && floor(points[i].x) == column; i++)
+        {
+          if (points[i].y < points[idx[1]].y) idx[1] = i;
+          if (points[i].y > points[idx[2]].y) idx[2] = i;
+        }
+      idx[3] = i - 1;
+
+      /* emit the selected points in path order */
+      for (j = 1; j < 4; j++)
+        for (k = j; k > 0 && idx[k] < idx[k - 1]; k--)
+          {
+            t = idx[k];
+            idx[k] = idx[k - 1];
+            idx[k - 1] = t;
+          }
+      for (j = 0; j < 4; j++)
+        if (j == 0 || idx[j] != idx[j - 1]) points[m++] = points[idx[j]];
+    }
+  return m;
+}
+
+static double segment_distance(cairo_point *a, cairo_point *b, cairo_point *c)
+{
+  double dx = b->x - a->x, dy = b->y - a->y, len = dx * dx + dy * dy;
+
+  if (len == 0) return sqrt((c->x - a->x) * (c->x - a->x) + (c->y - a->y) * (c->y - a->y));
+
+  return fabs(dy * (c->x - a->x) - dx * (c->y - a->y)) / sqrt(len);
+}
+
+static int simplify_path(cairo_point *points, int n)
+{
+  int i, m, first, last, farthest, sp;
+  int *stack;
+  unsigned char *keep;
+  double d, dmax, dx, dy;
+
+  m = decimate_columns(points, n);
+  if (m > 0) return m;
+
+  m = 1;
+  for (i = 1; i < n - 1; i++)
+    {
+      dx = points[i].x - points[m - 1].x;
+      dy = points[i].y - points[m - 1].y;
+      if (dx * dx + dy * dy > 0.25 * SIMPLIFY_TOLERANCE * SIMPLIFY_TOLERANCE) points[m++] = points[i];
+    }
+  points[m++] = points[n - 1];
+  n = m;
+  if (n < 3) return n;
+
+  keep = (unsigned char *)gks_malloc(n);
+  stack = (int *)gks_malloc(2 * n * sizeof(int));
+  keep[0] = keep[n - 1] = 1;
+
+  sp = 0;
+  stack[sp++] = 0;
+  stack[sp++] = n - 1;
+  while (sp > 0)
+    {
+      last = stack[--sp];
+      first = stack[--sp];
+      dmax = 0;
+      farthest = first;
+      for (i = first + 1; i < last; i++)
+        {
+          d = segment_distance(points + first, points + last, points + i);
+          if (d > dmax)
+            {
+              dmax = d;
+              farthest = i;
+            }
+        }
+      if (dmax > 0.5 * SIMPLIFY_TOLERANCE)
+        {
+          keep[farthest] = 1;
+          stack[sp++] = first;
+          stack[sp++] = farthest;
+          stack[sp++] = farthest;
+          stack[sp++] = last;
+        }
+    }
+
+  m = 0;
+  for (i = 0; i < n; i++)
+    if (keep[i]) points[m++] = points[i];
+
+  gks_free(stack);
+  gks_free(keep);
+
+  return m;
+}
+
 static void stroke(void)
 {
   int i;
 
+  if (p->npoints > SIMPLIFY_THRESHOLD && cairo_get_dash_count(p->cr) == 0)
+    p->npoints = simplify_path(p->points, p->npoints);
+
   cairo_move_to(p->cr, p->points[0].x, p->points[0].y);
   for (i = 1; i < p->npoints; i++)
     {
@@ -475,29 +760,28 @@ static void draw(double x, double y)
 
 static void line_routine(int n, double *px, double *py, int linetype, int tnr)
 {
-  double x, y, x0, y0, xi, yi;
+  double x, y;
   int i;
   GKS_UNUSED(linetype);
 
-  WC_to_NDC(px[0], py[0], tnr, x, y);
-  seg_xform(&x, &y);
-  NDC_to_DC(x, y, x0, y0);
+  if (n > p->max_points)
+    {
+      p->points = (cairo_point *)gks_realloc(p->points, n * sizeof(cairo_point));
+      p->max_points = n;
+    }
 
   cairo_set_line_cap(p->cr, CAIRO_LINE_CAP_ROUND);
   cairo_set_line_join(p->cr, CAIRO_LINE_JOIN_ROUND);
   set_line_width(p->linewidth);
 
-  cairo_move_to(p->cr, x0, y0);
-
-  for (i = 1; i < n; i++)
+  for (i = 0; i < n; i++)
     {
       WC_to_NDC(px[i], py[i], tnr, x, y);
       seg_xform(&x, &y);
-      NDC_to_DC(x, y, xi, yi);
-
-      cairo_line_to(p->cr, xi, yi);
+      NDC_to_DC(x, y, p->points[i].x, p->points[i].y);
     }
-  cairo_stroke(p->cr);
+  p->npoints = n;
+  stroke();
 }
 
 static void fill_routine(int n, double *px, double *py, int tnr)
@@ -713,10 +997,12 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   int ix1, ix2, iy1, iy2;
   int width, height;
   double red, green, blue, alpha;
-  int i, j, ix, iy, ind;
+  int i, j, ix, iy, ind, last_iy;
   int swapx, swapy;
   int stride;
-  unsigned char *data;
+  unsigned char *data, *src;
+  uint32_t *row, colormap[MAX_COLOR];
+  int *columns;
   cairo_surface_t *image;
 
   WC_to_NDC(xmin, ymax, gkss->cntnr, x1, y1);
@@ -738,28 +1024,69 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
   data = (unsigned char *)gks_malloc(stride * height);
 
+  /*
+     ARGB32 pixels are native endian 32-bit words with pre-multiplied alpha.
+     Rows are converted in place from the end, as the target stride is never
+     smaller than the source row size.
+   */
   if (true_color)
     {
       gks_resample((unsigned char *)colia, data, (size_t)dx, (size_t)dy, (size_t)width, (size_t)height, (size_t)dimx,
                    swapx, swapy, gkss->resample_method);
-      for (i = width - 1; i >= 0; i--)
+      for (j = height - 1; j >= 0; j--)
         {
-          for (j = height - 1; j >= 0; j--)
+          src = data + (size_t)j * width * 4;
+          row = (uint32_t *)(data + (size_t)j * stride);
+          for (i = width - 1; i >= 0; i--)
             {
-              red = data[(j * width + i) * 4 + 0];
-              green = data[(j * width + i) * 4 + 1];
-              blue = data[(j * width + i) * 4 + 2];
-              alpha = data[(j * width + i) * 4 + 3] * p->transparency;
-              /* ARGB32 format requires pre-multiplied alpha */
-              data[j * stride + i * 4 + 0] = (unsigned char)(blue * alpha / 255);
-              data[j * stride + i * 4 + 1] = (unsigned char)(green * alpha / 255);
-              data[j * stride + i * 4 + 2] = (unsigned char)(red * alpha / 255);
-              data[j * stride + i * 4 + 3] = (unsigned char)alpha;
+              unsigned int r = src[i * 4 + 0], g = src[i * 4 + 1], b = src[i * 4 + 2], a = src[i * 4 + 3];
+              if (p->transparency == 1)
+                {
+                  if (a != 255)
+                    {
+                      r = r * a / 255;
+                      g = g * a / 255;
+                      b = b * a / 255;
+                    }
+                }
+              else
+                {
+                  alpha = a * p->transparency;
+                  r = (unsigned char)(r * alpha / 255);
+                  g = (unsigned char)(g * alpha / 255);
+                  b = (unsigned char)(b * alpha / 255);
+                  a = (unsigned char)alpha;
+                }
+              row[i] = (uint32_t)a << 24 | (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
             }
         }
     }
   else
     {
+      alpha = 255 * p->transparency;
+      for (i = 0; i < MAX_COLOR; i++)
+        {
+          red = 255 * p->rgb[i][0];
+          green = 255 * p->rgb[i][1];
+          blue = 255 * p->rgb[i][2];
+          colormap[i] = (uint32_t)(unsigned char)alpha << 24 | (uint32_t)(unsigned char)(red * alpha / 255) << 16 |
+                        (uint32_t)(unsigned char)(green * alpha / 255) << 8 | (uint32_t)(unsigned char)(blue * alpha / 255);
+        }
+
+      /* source column of each target column, computed by integer stepping */
+      columns = (int *)gks_malloc(width * sizeof(int));
+      ix = 0;
+      for (i = 0, j = 0; i < width; i++, j += dx)
+        {
+          while (j >= width)
+            {
+              j -= width;
+              ix++;
+            }
+          columns[i] = swapx ? dx - 1 - ix : ix;
+        }
+
+      last_iy = -1;
       for (j = 0; j < height; j++)
         {
           iy = dy * j / height;
@@ -767,26 +1094,20 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
             {
               iy = dy - 1 - iy;
             }
+          row = (uint32_t *)(data + (size_t)j * stride);
+          if (iy == last_iy)
+            {
+              memcpy(row, data + (size_t)(j - 1) * stride, width * 4);
+              continue;
+            }
           for (i = 0; i < width; i++)
             {
-              ix = dx * i / width;
-              if (swapx)
-                {
-                  ix = dx - 1 - ix;
-                }
-              ind = colia[iy * dimx + ix];
-              ind = FIX_COLORIND(ind);
-              red = 255 * p->rgb[ind][0];
-              green = 255 * p->rgb[ind][1];
-              blue = 255 * p->rgb[ind][2];
-              alpha = 255 * p->transparency;
-              /* ARGB32 format requires pre-multiplied alpha */
-              data[j * stride + i * 4 + 0] = (unsigned char)(blue * alpha / 255);
-              data[j * stride + i * 4 + 1] = (unsigned char)(green * alpha / 255);
-              data[j * stride + i * 4 + 2] = (unsigned char)(red * alpha / 255);
-              data[j * stride + i * 4 + 3] = (unsigned char)alpha;
+              ind = colia[iy * dimx + columns[i]];
+              row[i] = colormap[FIX_COLORIND(ind)];
             }
+          last_iy = iy;
         }
+      gks_free(columns);
     }
 
   image = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, width, height, stride);
@@ -981,6 +1302,7 @@ static void open_page(void)
 
 static void close_page(void)
 {
+  free_marker_sprites();
   if (p->wtype != 142)
     {
       cairo_destroy(p->cr);
@@ -1113,11 +1435,11 @@ static oct_node pop_heap(node_heap *h)
   return ret;
 }
 
-static oct_node pool = NULL;
+static GKS_THREAD_LOCAL oct_node pool = NULL;
 
 static oct_node node_new(unsigned char idx, unsigned char depth, oct_node p)
 {
-  static int len = 0;
+  static GKS_THREAD_LOCAL int len = 0;
   oct_node x, n;
 
   if (len <= 1 || pool == NULL)
@@ -2135,6 +2457,12 @@ static void gdp(int n, double *px, double *py, int primid, int nc, int *codes)
     case GKS_K_GDP_FILL_POLYGONS:
       fill_polygons(n, px, py, nc, codes);
       break;
+    case GKS_K_GDP_DRAW_POLYLINES:
+      gks_emul_polylines(n, px, py, nc, codes, &gkss->plcoli, polyline);
+      break;
+    case GKS_K_GDP_FILL_AREAS:
+      gks_emul_fillareas(n, px, py, nc, codes, &gkss->facoli, fillarea);
+      break;
     default:
       gks_perror("invalid drawing primitive ('%d')", primid);
       exit(1);
@@ -2195,6 +2523,14 @@ void gks_cairoplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doub
 
   idle = 0;
 
+  if (fctid != 2 && p != NULL && p->gkss != gkss)
+    {
+      /* the workstation belongs to another GKS context */
+      gkss = p->gkss;
+      gks_init_core(gkss);
+      init_norm_xform();
+    }
+
   switch (fctid)
     {
     case 2:
@@ -2204,6 +2540,7 @@ void gks_cairoplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doub
       gks_init_core(gkss);
 
       p = (ws_state_list *)gks_malloc(sizeof(ws_state_list));
+      p->gkss = gkss;
 
       p->conid = ia[1];
       p->path = chars;
@@ -5,11 +5,19 @@
   (((a)[2] - (b)[0]) * ((a)[2] - (b)[0]) + ((a)[1] - (b)[1]) * ((a)[1] - (b)[1]) + \
    ((a)[0] - (b)[2]) * ((a)[0] - (b)[2]))
 
-static int compare_color_component(const void *left, const void *right)
+static int compare_red(const void *left, const void *right)
 {
-  int l = ((const unsigned char *)left)[0];
-  int r = ((const unsigned char *)right)[0];
-  return l - r;
+  return ((const unsigned char *)left)[0] - ((const unsigned char *)right)[0];
+}
+
+static int compare_green(const void *left, const void *right)
+{
+  return ((const unsigned char *)left)[1] - ((const unsigned char *)right)[1];
+}
+
+static int compare_blue(const void *left, const void *right)
+{
+  return ((const unsigned char *)left)[2] - ((const unsigned char *)right)[2];
 }
 
 void median_cut(unsigned char *pixels, unsigned char *color_table, int num_pixels, int num_colors, int num_channels)
@@ -79,7 +87,8 @@ void median_cut(unsigned char *pixels, unsigned char *color_table, int num_pixel
               cut_value = (minred + maxred) / 2;
             }
         }
-      qsort(pixels + cut_axis, num_pixels, num_channels, compare_color_component);
+      qsort(pixels, num_pixels, num_channels,
+            cut_axis == 0 ? compare_red : (cut_axis == 1 ? compare_green : compare_blue));
       for (left_pixels = num_colors / 2;
            (left_pixels < num_pixels - num_colors / 2) && pixels[left_pixels * num_channels + cut_axis] < cut_value;
            left_pixels++)
@@ -108,3 +117,25 @@ unsigned char color_index_for_rgb(const unsigned char *rgb_pixel, const unsigned
     }
   return closest_color_index;
 }
+
+void color_lookup_table(const unsigned char *color_table, int color_table_size, int num_channels,
+                        unsigned char *lookup)
+{
+  /* Fill a 15-bit RGB lookup table with the color index most closely matching the center of each cell, so that
+   * pixels can be mapped to the color table without searching it. */
+  unsigned char rgb[3];
+  int r, g, b;
+  for (r = 0; r < 32; r++)
+    {
+      rgb[0] = (unsigned char)(r * 8 + 4);
+      for (g = 0; g < 32; g++)
+        {
+          rgb[1] = (unsigned char)(g * 8 + 4);
+          for (b = 0; b < 32; b++)
+            {
+              rgb[2] = (unsigned char)(b * 8 + 4);
+              lookup[(r << 10) | (g << 5) | b] = color_index_for_rgb(rgb, color_table, color_table_size, num_channels);
+            }
+        }
+    }
+}
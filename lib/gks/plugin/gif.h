@@ -5,9 +5,15 @@
 extern "C" {
 #endif
 
+/* size of a 15-bit RGB color lookup table and the index of an RGB pixel in it */
+#define COLOR_LOOKUP_SIZE 32768
+#define color_lookup_index(rgb) ((((rgb)[0] >> 3) << 10) | (((rgb)[1] >> 3) << 5) | ((rgb)[2] >> 3))
+
 void median_cut(unsigned char *pixels, unsigned char *color_table, int num_pixels, int num_colors, int num_channels);
 unsigned char color_index_for_rgb(const unsigned char *rgb_pixel, const unsigned char *color_table,
                                   int color_table_size, int num_channels);
+void color_lookup_table(const unsigned char *color_table, int color_table_size, int num_channels,
+                        unsigned char *lookup);
 
 #ifdef __cplusplus
 }
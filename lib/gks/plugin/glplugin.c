@@ -65,6 +65,8 @@ DLLEXPORT void gks_glplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int
 
 #define MAX_TNR 9
 
+#define MARKER_CACHE_SIZE 256
+
 #define WC_to_NDC(xw, yw, tnr, xn, yn) \
   xn = a[tnr] * (xw) + b[tnr];         \
   yn = c[tnr] * (yw) + d[tnr]
@@ -103,6 +105,14 @@ static gks_state_list_t *gkss;
 
 static double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
 
+typedef struct
+{
+  GLuint list;
+  int mtype, r;
+  double scale, mat[2][2];
+  float rgba[4], background[4];
+} marker_list_t;
+
 typedef struct ws_state_list_t
 {
   int state;
@@ -117,6 +127,7 @@ typedef struct ws_state_list_t
   float rgb[MAX_COLOR][3];
   float transparency;
   int rect[MAX_TNR][4];
+  marker_list_t markers[MARKER_CACHE_SIZE];
 } ws_state_list;
 
 static ws_state_list *p;
@@ -374,7 +385,7 @@ static void polyline(int num_points, double *x, double *y)
   glLineWidth(1.0);
 }
 
-static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+static void emit_marker(double x, double y, int mtype, int r, double scale, int mcolor)
 {
 
 #include "marker.h"
@@ -382,27 +393,13 @@ static void draw_marker(double xn, double yn, int mtype, double mscale, int mcol
   static int is_concav[37] = {0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0,
                               0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-  const double modelview_matrix[16] = {2.0 / p->width, 0, 0, -1, 0, -2.0 / p->height, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1};
-
-  int r, i, num_segments;
+  int i, num_segments;
   int pc, op;
-  double scale, x, y, xr, yr, c, s, tmp;
-
-  r = (int)(3 * mscale);
-  scale = 0.01 * mscale / 3.0;
-
-  xr = r;
-  yr = 0;
-  seg_xform_rel(&xr, &yr);
-  r = nint(sqrt(xr * xr + yr * yr));
-
-  NDC_to_DC(xn, yn, x, y);
+  double xr, yr, c, s, tmp;
 
   pc = 0;
   mtype = (2 * r > 1) ? mtype + marker_off : marker_off + 1;
 
-  glMatrixMode(GL_MODELVIEW);
-  glLoadTransposeMatrixd(modelview_matrix);
   set_color(mcolor);
 
   do
@@ -495,6 +492,101 @@ static void draw_marker(double xn, double yn, int mtype, double mscale, int mcol
       pc++;
     }
   while (op != 0);
+}
+
+static GLuint marker_list(int mtype, int r, double scale, int mcolor)
+/*
+   Return a display list which draws the given marker centered at the origin.
+   Lists are cached by marker type, size, segment transformation and colors,
+   so every distinct marker is only built once. Returns 0 if no list could
+   be created.
+ */
+{
+  marker_list_t *m;
+  float rgba[4], background[4];
+  unsigned int hash;
+  int i;
+
+  memmove(rgba, p->rgb[mcolor], 3 * sizeof(float));
+  rgba[3] = p->transparency;
+  memmove(background, p->rgb[0], 3 * sizeof(float));
+  background[3] = p->transparency;
+
+  hash = (unsigned int)(mtype + marker_off) * 31u + (unsigned int)r * 17u + (unsigned int)(scale * 1000);
+  for (i = 0; i < 3; i++) hash = hash * 31u + (unsigned int)(rgba[i] * 255);
+  m = p->markers + hash % MARKER_CACHE_SIZE;
+
+  if (m->list != 0 && m->mtype == mtype && m->r == r && m->scale == scale &&
+      memcmp(m->mat, gkss->mat, sizeof(m->mat)) == 0 && memcmp(m->rgba, rgba, sizeof(rgba)) == 0 &&
+      memcmp(m->background, background, sizeof(background)) == 0)
+    {
+      return m->list;
+    }
+
+  if (m->list == 0)
+    {
+      m->list = glGenLists(1);
+      if (m->list == 0) return 0;
+    }
+  m->mtype = mtype;
+  m->r = r;
+  m->scale = scale;
+  memmove(m->mat, gkss->mat, sizeof(m->mat));
+  memmove(m->rgba, rgba, sizeof(rgba));
+  memmove(m->background, background, sizeof(background));
+
+  glNewList(m->list, GL_COMPILE);
+  emit_marker(0, 0, mtype, r, scale, mcolor);
+  glEndList();
+
+  return m->list;
+}
+
+static void delete_marker_lists(void)
+{
+  int i;
+
+  for (i = 0; i < MARKER_CACHE_SIZE; i++)
+    {
+      if (p->markers[i].list != 0)
+        {
+          glDeleteLists(p->markers[i].list, 1);
+          p->markers[i].list = 0;
+        }
+    }
+}
+
+static void draw_marker(double xn, double yn, int mtype, double mscale, int mcolor)
+{
+  const double modelview_matrix[16] = {2.0 / p->width, 0, 0, -1, 0, -2.0 / p->height, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1};
+
+  int r;
+  double scale, x, y, xr, yr;
+  GLuint list;
+
+  r = (int)(3 * mscale);
+  scale = 0.01 * mscale / 3.0;
+
+  xr = r;
+  yr = 0;
+  seg_xform_rel(&xr, &yr);
+  r = nint(sqrt(xr * xr + yr * yr));
+
+  NDC_to_DC(xn, yn, x, y);
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadTransposeMatrixd(modelview_matrix);
+
+  list = marker_list(mtype, r, scale, mcolor);
+  if (list != 0)
+    {
+      glTranslated(x, y, 0);
+      glCallList(list);
+    }
+  else
+    {
+      emit_marker(x, y, mtype, r, scale, mcolor);
+    }
 
   glLoadIdentity();
 }
@@ -1181,6 +1273,7 @@ void gks_glplugin(int fctid, int dx, int dy, int dimx, int *i_arr, int len_f_arr
       break;
 
     case 3:
+      delete_marker_lists();
       close_window();
       gks_free(p);
       p = NULL;
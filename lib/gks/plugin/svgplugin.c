@@ -13,11 +13,17 @@
 #if !defined(VMS) && !defined(_WIN32)
 #include <unistd.h>
 #endif
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 #include "gks.h"
 #include "gkscore.h"
 
 #define MEMORY_INCREMENT 32768
+#define FLUSH_SIZE 1048576
+#define HEADER_SIZE 256
+#define MAX_PRECISION 6
 
 #define MAX_POINTS 2048
 #define PATTERNS 120
@@ -94,9 +100,9 @@ DLLEXPORT void gks_svgplugin(int fctid, int dx, int dy, int dimx, int *i_arr, in
 
 #define MAX_CLIP_RECTS 64
 
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss;
 
-static double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
+static GKS_THREAD_LOCAL double a[MAX_TNR], b[MAX_TNR], c[MAX_TNR], d[MAX_TNR];
 
 typedef struct SVG_stream_t
 {
@@ -118,6 +124,8 @@ typedef struct ws_state_list_t
 {
   int conid, state, wtype;
   char *path;
+  int fd, header_width, header_height;
+  char page_path[MAXPATHLEN];
   double a, b, c, d;
   double window[4], viewport[4];
   unsigned char rgb[MAX_COLOR + 1][3];
@@ -134,9 +142,17 @@ typedef struct ws_state_list_t
   SVG_clip_rect *cr;
   int clip_index, rect_index, max_clip_rects;
   double transparency;
+  int precision;
+  double scale;
+  int path_open, path_rect, path_color, path_points;
+  double path_linewidth, path_transparency, path_x, path_y;
+  char path_cmd;
+  unsigned char base64[3];
+  int base64_count, base64_column;
+  gks_state_list_t *gkss;
 } ws_state_list;
 
-static ws_state_list *p;
+static GKS_THREAD_LOCAL ws_state_list *p;
 
 static const char *fonts[] = {"Times New Roman,TimesNewRoman,Times,Baskerville,Georgia,serif",
                               "Arial,Helvetica Neue,Helvetica,sans-serif",
@@ -166,13 +182,15 @@ static int predef_ints[] = {0, 1, 3, 3, 3};
 
 static int predef_styli[] = {1, 1, 1, 2, 3};
 
-static int path_id = -1;
+static GKS_THREAD_LOCAL int path_id = -1;
+
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 static void svg_memcpy(SVG_stream *p, char *s, size_t n)
 {
   if (p->length + n >= p->size)
     {
-      while (p->length + n >= p->size) p->size += MEMORY_INCREMENT;
+      while (p->length + n >= p->size) p->size = p->size < MEMORY_INCREMENT ? MEMORY_INCREMENT : 2 * p->size;
       p->buffer = (unsigned char *)realloc(p->buffer, p->size);
     }
 
@@ -286,36 +304,42 @@ static void init_clip_rects(void)
     }
 }
 
-typedef struct WriteCallbackData_t
-{
-  png_bytep data_ptr;
-  png_size_t size;
-  png_size_t capacity;
-} WriteCallbackData;
-
-static WriteCallbackData current_write_data;
+/*
+   PNG images are base64 encoded while libpng produces them and go straight
+   into the page stream in lines of 76 characters.
+ */
 
-static void write_callback(png_structp png_ptr, png_bytep data, png_size_t num_bytes)
+static void write_base64_group(const unsigned char *input, int count)
 {
-  WriteCallbackData *write_data = (WriteCallbackData *)png_get_io_ptr(png_ptr);
-  png_size_t size_increment = 1000000;
-  if (num_bytes > size_increment)
-    {
-      size_increment = num_bytes;
-    }
-  if (!write_data->data_ptr)
+  char output[4];
+
+  output[0] = base64_digits[input[0] >> 2];
+  output[1] = base64_digits[((input[0] & 0x03) << 4) + (input[1] >> 4)];
+  output[2] = count > 1 ? base64_digits[((input[1] & 0x0f) << 2) + (input[2] >> 6)] : '=';
+  output[3] = count > 2 ? base64_digits[input[2] & 0x3f] : '=';
+  svg_memcpy(p->stream, output, 4);
+  p->base64_column += 4;
+  if (p->base64_column == 76)
     {
-      write_data->data_ptr = (png_bytep)gks_malloc(size_increment);
-      write_data->size = 0;
-      write_data->capacity = size_increment;
+      svg_memcpy(p->stream, "\n", 1);
+      p->base64_column = 0;
     }
-  if (write_data->size + num_bytes > write_data->capacity)
+}
+
+static void write_callback(png_structp png_ptr, png_bytep data, png_size_t num_bytes)
+{
+  png_size_t i;
+
+  (void)png_ptr;
+  for (i = 0; i < num_bytes; i++)
     {
-      write_data->data_ptr = (png_bytep)gks_realloc(write_data->data_ptr, write_data->capacity + size_increment);
-      write_data->capacity += size_increment;
+      p->base64[p->base64_count++] = data[i];
+      if (p->base64_count == 3)
+        {
+          write_base64_group(p->base64, 3);
+          p->base64_count = 0;
+        }
     }
-  memcpy(write_data->data_ptr + write_data->size, data, num_bytes);
-  write_data->size += num_bytes;
 }
 
 static void flush_callback(png_structp png_ptr)
@@ -323,6 +347,25 @@ static void flush_callback(png_structp png_ptr)
   (void)png_ptr;
 }
 
+static void begin_base64(void)
+{
+  p->base64_count = 0;
+  p->base64_column = 0;
+}
+
+static void end_base64(void)
+{
+  if (p->base64_count > 0)
+    {
+      memset(p->base64 + p->base64_count, 0, 3 - p->base64_count);
+      write_base64_group(p->base64, p->base64_count);
+    }
+  if (p->base64_column > 0)
+    {
+      svg_memcpy(p->stream, "\n", 1);
+    }
+}
+
 static void create_pattern(void)
 {
   int i, j, height;
@@ -356,12 +399,10 @@ static void create_pattern(void)
           ptr[4 * i + 3] = 255 * p->transparency;
         }
     }
-  current_write_data.data_ptr = NULL;
-  current_write_data.size = 0;
-  current_write_data.capacity = 0;
+  begin_base64();
   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   info_ptr = png_create_info_struct(png_ptr);
-  png_set_write_fn(png_ptr, &current_write_data, write_callback, flush_callback);
+  png_set_write_fn(png_ptr, NULL, write_callback, flush_callback);
   png_set_IHDR(png_ptr, info_ptr, 8, 8, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
                PNG_FILTER_TYPE_DEFAULT);
   png_write_info(png_ptr, info_ptr);
@@ -373,6 +414,7 @@ static void create_pattern(void)
     }
   free(row_pointers);
   png_destroy_write_struct(&png_ptr, &info_ptr);
+  end_base64();
 }
 
 static void resize_window(void)
@@ -598,6 +640,127 @@ static void stroke(void)
       (y) = SVG_MAX;          \
   }
 
+/*
+   With GKS_SVG_PRECISION=<digits> coordinates are rounded to the given
+   number of decimals and written as path data with relative commands.
+   Deltas are taken between rounded positions, so no error accumulates.
+   Consecutive solid polylines with the same style and clip region are
+   merged into a single <path> element.
+ */
+
+static void path_number(char *s, int *n, double v)
+{
+  double q = fabs(v), ip = floor(q / p->scale), fp = q - ip * p->scale;
+  int len = *n;
+
+  if (v < 0)
+    s[len++] = '-';
+  else if (len == 0 || (s[len - 1] != 'M' && s[len - 1] != 'l'))
+    s[len++] = ' ';
+  if (ip > 0 || fp == 0) len += sprintf(s + len, "%.0f", ip);
+  if (fp > 0)
+    {
+      len += sprintf(s + len, ".%0*.0f", p->precision, fp);
+      while (s[len - 1] == '0') len--;
+    }
+  s[len] = '\0';
+  *n = len;
+}
+
+static void path_point(double x, double y, int move)
+{
+  char s[80];
+  int n = 0;
+
+  x = floor(x * p->scale + 0.5);
+  y = floor(y * p->scale + 0.5);
+  if (move)
+    {
+      s[n++] = 'M';
+      path_number(s, &n, x);
+      path_number(s, &n, y);
+      p->path_cmd = 'M';
+    }
+  else
+    {
+      if (p->path_cmd != 'l') s[n++] = 'l';
+      path_number(s, &n, x - p->path_x);
+      path_number(s, &n, y - p->path_y);
+      p->path_cmd = 'l';
+    }
+  p->path_x = x;
+  p->path_y = y;
+  if (++p->path_points % 10 == 0) s[n++] = '\n';
+  svg_memcpy(p->stream, s, n);
+}
+
+static void end_path(void)
+{
+  if (p->path_open)
+    {
+      svg_printf(p->stream, "\"/>\n");
+      p->path_open = 0;
+    }
+}
+
+static void line_path(int n, double *px, double *py, int linetype, int tnr)
+{
+  double x, y, xi, yi, xim1 = 0, yim1 = 0;
+  int i, len, dashed = linetype < 0 || linetype > 1;
+  int dash_list[10];
+  char s[100], buf[20];
+
+  if (!p->path_open || dashed || p->path_rect != p->rect_index || p->path_color != p->color ||
+      p->path_linewidth != p->linewidth || p->path_transparency != p->transparency)
+    {
+      end_path();
+      svg_printf(p->stream,
+                 "<path clip-path=\"url(#clip%02d%d)\" style=\""
+                 "stroke:#%02x%02x%02x; stroke-linecap:round; stroke-linejoin:round; stroke-width:%g; "
+                 "stroke-opacity:%g; fill:none\" ",
+                 path_id, p->rect_index, p->rgb[p->color][0], p->rgb[p->color][1], p->rgb[p->color][2],
+                 p->linewidth, p->transparency);
+      if (dashed)
+        {
+          gks_get_dash_list(linetype, 0.5 * p->linewidth, dash_list);
+          len = dash_list[0];
+          *s = '\0';
+          for (i = 1; i <= len; i++)
+            {
+              snprintf(buf, 20, "%d%s", dash_list[i], i < len ? ", " : "");
+              strcat(s, buf);
+            }
+          svg_printf(p->stream, "stroke-dasharray=\"%s\" ", s);
+        }
+      svg_printf(p->stream, "d=\"\n");
+      p->path_open = 1;
+      p->path_rect = p->rect_index;
+      p->path_color = p->color;
+      p->path_linewidth = p->linewidth;
+      p->path_transparency = p->transparency;
+      p->path_points = 0;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      WC_to_NDC(px[i], py[i], tnr, x, y);
+      seg_xform(&x, &y);
+      NDC_to_DC(x, y, xi, yi);
+      fix_coordinates(xi, yi);
+
+      if (i == 0)
+        path_point(xi, yi, 1);
+      else if (i == 1 || xi != xim1 || yi != yim1)
+        path_point(xi, yi, 0);
+      xim1 = xi;
+      yim1 = yi;
+    }
+  if (linetype == 0) svg_memcpy(p->stream, "z", 1);
+
+  /* the dash pattern would restart at every subpath */
+  if (dashed) end_path();
+}
+
 static void line_routine(int n, double *px, double *py, int linetype, int tnr)
 {
   double x, y;
@@ -606,6 +769,12 @@ static void line_routine(int n, double *px, double *py, int linetype, int tnr)
   int dash_list[10];
   char s[100], buf[20];
 
+  if (p->precision >= 0)
+    {
+      line_path(n, px, py, linetype, tnr);
+      return;
+    }
+
   WC_to_NDC(px[0], py[0], tnr, x, y);
   seg_xform(&x, &y);
   NDC_to_DC(x, y, x0, y0);
@@ -658,10 +827,8 @@ static void line_routine(int n, double *px, double *py, int linetype, int tnr)
 
 static void fill_routine(int n, double *px, double *py, int tnr)
 {
-  int i, j, nan_found = 0;
+  int i, nan_found = 0;
   double x, y, ix, iy;
-  char *s, line[80];
-  size_t slen;
 
   const char *hatch_paths[] = {/* none */
                                "",
@@ -706,7 +873,6 @@ static void fill_routine(int n, double *px, double *py, int tnr)
         }
       else
         {
-          create_pattern();
           svg_printf(p->stream,
                      "<defs>\n  <pattern id=\"pattern%d\" patternUnits=\"userSpaceOn"
                      "Use\" x=\"0\" y=\"0\" width=\"%d\" height=\"%d\">\n"
@@ -714,27 +880,13 @@ static void fill_routine(int n, double *px, double *py, int tnr)
                      "xlink:href=\"data:image/png;base64,\n",
                      p->pattern_count, 8 * NOMINAL_POINTSIZE, 8 * NOMINAL_POINTSIZE, 8 * NOMINAL_POINTSIZE,
                      8 * NOMINAL_POINTSIZE);
-          slen = current_write_data.size * 4 / 3 + 4;
-          s = (char *)gks_malloc(slen);
-          gks_base64(current_write_data.data_ptr, current_write_data.size, s, slen);
-          gks_free(current_write_data.data_ptr);
-          i = j = 0;
-          while (s[j])
-            {
-              line[i++] = s[j++];
-              if (i == 76 || s[j] == '\0')
-                {
-                  line[i] = '\0';
-                  svg_printf(p->stream, "%s\n", line);
-                  i = 0;
-                }
-            }
-          free(s);
+          create_pattern();
           svg_printf(p->stream, "\"/>\n  </pattern>\n</defs>\n");
         }
     }
 
   svg_printf(p->stream, "<path clip-path=\"url(#clip%02d%d)\" d=\"\n", path_id, p->rect_index);
+  p->path_points = 0;
   for (i = 0; i < n; i++)
     {
       if (px[i] != px[i] && py[i] != py[i])
@@ -746,7 +898,13 @@ static void fill_routine(int n, double *px, double *py, int tnr)
       seg_xform(&x, &y);
       NDC_to_DC(x, y, ix, iy);
 
-      if (i == 0 || nan_found)
+      if (p->precision >= 0)
+        {
+          fix_coordinates(ix, iy);
+          path_point(ix, iy, i == 0 || nan_found);
+          nan_found = 0;
+        }
+      else if (i == 0 || nan_found)
         {
           svg_printf(p->stream, "M%g %g ", ix, iy);
           nan_found = 0;
@@ -755,7 +913,7 @@ static void fill_routine(int n, double *px, double *py, int tnr)
         {
           svg_printf(p->stream, "L%g %g ", ix, iy);
         }
-      if (!((i + 1) % 10))
+      if (p->precision < 0 && !((i + 1) % 10))
         {
           svg_printf(p->stream, "\n  ");
         }
@@ -986,8 +1144,6 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
   png_structp png_ptr;
   png_infop info_ptr;
   png_bytep *row_pointers;
-  char *s, line[80];
-  size_t slen;
 
   WC_to_NDC(xmin, ymax, gkss->cntnr, x1, y1);
   seg_xform(&x1, &y1);
@@ -1045,12 +1201,15 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
         }
     }
 
-  current_write_data.data_ptr = NULL;
-  current_write_data.size = 0;
-  current_write_data.capacity = 0;
+  svg_printf(p->stream,
+             "<g clip-path=\"url(#clip%02d%d)\">\n"
+             "<image width=\"%d\" height=\"%d\" "
+             "xlink:href=\"data:image/png;base64,\n",
+             path_id, p->rect_index, width, height);
+  begin_base64();
   png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   info_ptr = png_create_info_struct(png_ptr);
-  png_set_write_fn(png_ptr, &current_write_data, write_callback, flush_callback);
+  png_set_write_fn(png_ptr, NULL, write_callback, flush_callback);
   png_set_IHDR(png_ptr, info_ptr, width, height, bit_depth, color_type, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
                PNG_FILTER_TYPE_DEFAULT);
   png_write_info(png_ptr, info_ptr);
@@ -1062,28 +1221,8 @@ static void cellarray(double xmin, double xmax, double ymin, double ymax, int dx
     }
   free(row_pointers);
   png_destroy_write_struct(&png_ptr, &info_ptr);
-  slen = current_write_data.size * 4 / 3 + 4;
-  s = (char *)gks_malloc(slen);
-  gks_base64(current_write_data.data_ptr, current_write_data.size, s, slen);
-  gks_free(current_write_data.data_ptr);
-  svg_printf(p->stream,
-             "<g clip-path=\"url(#clip%02d%d)\">\n"
-             "<image width=\"%d\" height=\"%d\" "
-             "xlink:href=\"data:image/png;base64,\n",
-             path_id, p->rect_index, width, height);
-  i = j = 0;
-  while (s[j])
-    {
-      line[i++] = s[j++];
-      if (i == 76 || s[j] == '\0')
-        {
-          line[i] = '\0';
-          svg_printf(p->stream, "%s\n", line);
-          i = 0;
-        }
-    }
+  end_base64();
   svg_printf(p->stream, "\" transform=\"translate(%d, %d)\"/>\n</g>\n", x, y);
-  free(s);
 }
 
 static void to_DC(int n, double *x, double *y)
@@ -1467,6 +1606,12 @@ static void gdp(int n, double *px, double *py, int primid, int nc, int *codes)
     case GKS_K_GDP_FILL_POLYGONS:
       fill_polygons(n, px, py, nc, codes);
       break;
+    case GKS_K_GDP_DRAW_POLYLINES:
+      gks_emul_polylines(n, px, py, nc, codes, &gkss->plcoli, polyline);
+      break;
+    case GKS_K_GDP_FILL_AREAS:
+      gks_emul_fillareas(n, px, py, nc, codes, &gkss->facoli, fillarea);
+      break;
     default:
       gks_perror("invalid drawing primitive ('%d')", primid);
       exit(1);
@@ -1533,6 +1678,60 @@ static void set_clip_path(int tnr)
     }
 }
 
+static void write_header(int fd, int padded)
+{
+  char buf[HEADER_SIZE + 1];
+  int len;
+
+  len = snprintf(buf, HEADER_SIZE,
+                 "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                 "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                 "xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+                 "width=\"%g\" height=\"%g\" viewBox=\"0 0 %d %d\"",
+                 p->width / 4.0, p->height / 4.0, p->width, p->height);
+  if (padded)
+    {
+      /* leave room to rewrite the header if the workstation is resized later */
+      while (len < HEADER_SIZE - 2) buf[len++] = ' ';
+    }
+  buf[len++] = '>';
+  buf[len++] = '\n';
+  gks_write_file(fd, buf, len);
+  p->header_width = p->width;
+  p->header_height = p->height;
+}
+
+static void flush_page(void)
+/*
+   Large pages are written to their file while they are being generated
+   instead of being held in memory. This is not possible if the output goes
+   to a connection provided by the caller, which is written in one piece.
+ */
+{
+  if (p->conid != 0) return;
+
+  if (p->fd < 0)
+    {
+      gks_filepath(p->page_path, p->path, "svg", p->page_counter + 1, 0);
+      p->fd = gks_open_file(p->page_path, "w");
+      if (p->fd < 0) return;
+      write_header(p->fd, 1);
+    }
+  gks_write_file(p->fd, p->stream->buffer, p->stream->length);
+  p->stream->length = 0;
+}
+
+static void discard_page(void)
+{
+  p->stream->length = 0;
+  if (p->fd >= 0)
+    {
+      gks_close_file(p->fd);
+      remove(p->page_path);
+      p->fd = -1;
+    }
+}
+
 static void write_page(void)
 {
   char path[MAXPATHLEN], buf[256];
@@ -1540,6 +1739,22 @@ static void write_page(void)
 
   p->page_counter++;
 
+  if (p->fd >= 0)
+    {
+      gks_write_file(p->fd, p->stream->buffer, p->stream->length);
+      snprintf(buf, 256, "</svg>\n");
+      gks_write_file(p->fd, buf, strlen(buf));
+      if (p->header_width != p->width || p->header_height != p->height)
+        {
+          lseek(p->fd, 0, SEEK_SET);
+          write_header(p->fd, 1);
+        }
+      gks_close_file(p->fd);
+      p->fd = -1;
+      p->stream->length = 0;
+      return;
+    }
+
   if (p->conid == 0)
     {
       gks_filepath(path, p->path, "svg", p->page_counter, 0);
@@ -1550,13 +1765,7 @@ static void write_page(void)
 
   if (fd >= 0)
     {
-      snprintf(buf, 256,
-               "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-               "<svg xmlns=\"http://www.w3.org/2000/svg\" "
-               "xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
-               "width=\"%g\" height=\"%g\" viewBox=\"0 0 %d %d\">\n",
-               p->width / 4.0, p->height / 4.0, p->width, p->height);
-      gks_write_file(fd, buf, strlen(buf));
+      write_header(fd, 0);
       gks_write_file(fd, p->stream->buffer, p->stream->length);
       snprintf(buf, 256, "</svg>\n");
       gks_write_file(fd, buf, strlen(buf));
@@ -1585,6 +1794,20 @@ void gks_drv_js(
 
   p = (ws_state_list *)*ptr;
 
+  /* attribute settings do not interrupt a merged polyline path */
+  if (fctid != 12 && (fctid < 19 || fctid > 44) && fctid != 49 && fctid != 203 && p != NULL && p->path_open)
+    {
+      end_path();
+    }
+
+  if (fctid != 2 && p != NULL && p->gkss != gkss)
+    {
+      /* the workstation belongs to another GKS context */
+      gkss = p->gkss;
+      gks_init_core(gkss);
+      init_norm_xform();
+    }
+
   switch (fctid)
     {
       /* open workstation */
@@ -1594,9 +1817,20 @@ void gks_drv_js(
       gks_init_core(gkss);
 
       p = (ws_state_list *)calloc(1, sizeof(ws_state_list));
+      p->gkss = gkss;
 
       p->conid = ia[1];
       p->path = chars;
+      p->fd = -1;
+
+      p->precision = -1;
+      if (gks_getenv("GKS_SVG_PRECISION") != NULL)
+        {
+          p->precision = atoi(gks_getenv("GKS_SVG_PRECISION"));
+          if (p->precision < 0) p->precision = 0;
+          if (p->precision > MAX_PRECISION) p->precision = MAX_PRECISION;
+          p->scale = pow(10.0, p->precision);
+        }
 
       p->height = 2000;
       p->width = 2000;
@@ -1637,7 +1871,10 @@ void gks_drv_js(
 
       /* close workstation */
     case 3:
-      if (!p->empty) write_page();
+      if (!p->empty)
+        write_page();
+      else
+        discard_page();
 
       free(p->cr);
       free(p->stream->buffer);
@@ -1658,7 +1895,7 @@ void gks_drv_js(
 
       /* clear workstation */
     case 6:
-      p->stream->length = 0;
+      discard_page();
       p->empty = 1;
       init_clip_rects();
       break;
@@ -1787,4 +2024,6 @@ void gks_drv_js(
 
     default:;
     }
+
+  if (((fctid >= 12 && fctid <= 17) || fctid == DRAW_IMAGE) && p->stream->length > FLUSH_SIZE) flush_page();
 }
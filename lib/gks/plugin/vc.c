@@ -1,11 +1,44 @@
 #if !defined(NO_AV)
 
+#ifdef _MSC_VER
+#define NO_THREADS 1
+#endif
+
 #include <stdio.h>
+#include <string.h>
+
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
 
 #include "vc.h"
 #include "gif.h"
 #include "gkscore.h"
 
+#ifndef GKS_UNUSED
+#define GKS_UNUSED(x) (void)(x)
+#endif
+
+/* maximum number of frames and memory used to compute a global GIF palette, and number of sampled pixels */
+#define VC_GIF_SAMPLE_FRAMES 16
+#define VC_GIF_SAMPLE_MEMORY (64 * 1024 * 1024)
+#define VC_GIF_SAMPLE_PIXELS (1024 * 1024)
+
+/* number of frames which can be queued for encoding before the caller is blocked */
+#define VC_QUEUE_SIZE 2
+
+#ifndef NO_THREADS
+struct vc_queue_t_
+{
+  struct frame_t_ frame[VC_QUEUE_SIZE]; /* private copies of the queued frames */
+  size_t size[VC_QUEUE_SIZE];           /* allocated size of the frame buffers */
+  int first, count, finish;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+#endif
+
 static void encode_frame(movie_t movie)
 {
   int ret;
@@ -45,12 +78,86 @@ static void encode_frame(movie_t movie)
   av_packet_free(&pkt);
 }
 
-void vc_movie_append_frame(movie_t movie, frame_t frame)
+static void unshare_frame_buffers(movie_t movie)
+{
+  if (movie->frame && av_buffer_get_ref_count(movie->frame->buf[0]) > 1)
+    {
+      /* The 'apng' encoder requires access to the (ref-counted) last video frame for the inter-frame compression. This
+       * causes problems if the frame data pointers are re-used as it is possible with other codecs, therefore new
+       * buffers are created with `av_frame_get_buffer` and the old buffers are unreferenced. As `av_frame_unref` also
+       * resets metadata (width, height, ...) the relevant attributes are restored after unreferencing the buffers. */
+      int _format = movie->frame->format;
+      int _width = movie->frame->width;
+      int _height = movie->frame->height;
+      long _pts = movie->frame->pts;
+      av_frame_unref(movie->frame);
+      movie->frame->format = _format;
+      movie->frame->width = _width;
+      movie->frame->height = _height;
+      movie->frame->pts = _pts;
+      av_frame_get_buffer(movie->frame, 32);
+    }
+}
+
+static void encode_gif_frame(movie_t movie, const unsigned char *image)
+{
+  /* Map an RGBA image to the current palette and encode it. The color indices are written to the frame's own buffer,
+   * so the encoder can compare it with the previous frame and only store the changed rectangle. */
+  int height = movie->cdc_ctx->height;
+  int width = movie->cdc_ctx->width;
+  int i, j;
+  unsigned char *row;
+  const unsigned char *pixel = image;
+
+  unshare_frame_buffers(movie);
+  for (j = 0; j < height; j++)
+    {
+      row = movie->frame->data[0] + j * movie->frame->linesize[0];
+      for (i = 0; i < width; i++, pixel += 4)
+        {
+          row[i] = movie->gif_lookup[color_lookup_index(pixel)];
+        }
+    }
+  memcpy(movie->frame->data[1], movie->gif_palette, AVPALETTE_SIZE);
+
+  encode_frame(movie);
+  movie->frame->pts++;
+}
+
+static void build_global_palette(movie_t movie)
+{
+  /* Compute one palette for the whole movie from a subset of the pixels of the buffered frames and encode them. */
+  size_t frame_size = (size_t)movie->cdc_ctx->width * movie->cdc_ctx->height * 4;
+  size_t num_pixels = frame_size / 4 * movie->gif_num_frames;
+  size_t step = num_pixels / VC_GIF_SAMPLE_PIXELS + 1;
+  size_t i, num_samples = 0;
+  unsigned char *samples;
+  int k;
+
+  samples = (unsigned char *)gks_malloc((int)((num_pixels / step + 1) * 4));
+  for (i = 0; i < num_pixels; i += step)
+    {
+      memcpy(samples + 4 * num_samples++, movie->gif_frames + 4 * i, 4);
+    }
+  median_cut(samples, movie->gif_palette, (int)num_samples, AVPALETTE_COUNT, 4);
+  color_lookup_table(movie->gif_palette, AVPALETTE_COUNT, 4, movie->gif_lookup);
+  gks_free(samples);
+
+  movie->gif_palette_ready = 1;
+  for (k = 0; k < movie->gif_num_frames; k++)
+    {
+      encode_gif_frame(movie, movie->gif_frames + k * frame_size);
+    }
+  gks_free(movie->gif_frames);
+  movie->gif_frames = NULL;
+  movie->gif_num_frames = 0;
+}
+
+static void process_frame(movie_t movie, frame_t frame)
 {
   int is_gif = movie->cdc_ctx->pix_fmt == AV_PIX_FMT_PAL8;
   int height = movie->cdc_ctx->height;
   int width = movie->cdc_ctx->width;
-  int i;
 
   if (!movie->sws_ctx)
     {
@@ -68,23 +175,7 @@ void vc_movie_append_frame(movie_t movie, frame_t frame)
         }
     }
 
-  if (movie->frame && av_buffer_get_ref_count(movie->frame->buf[0]) > 1)
-    {
-      /* The 'apng' encoder requires access to the (ref-counted) last video frame for the inter-frame compression. This
-       * causes problems if the frame data pointers are re-used as it is possible with other codecs, therefore new
-       * buffers are created with `av_frame_get_buffer` and the old buffers are unreferenced. As `av_frame_unref` also
-       * resets metadata (width, height, ...) the relevant attributes are restored after unreferencing the buffers. */
-      int _format = movie->frame->format;
-      int _width = movie->frame->width;
-      int _height = movie->frame->height;
-      long _pts = movie->frame->pts;
-      av_frame_unref(movie->frame);
-      movie->frame->format = _format;
-      movie->frame->width = _width;
-      movie->frame->height = _height;
-      movie->frame->pts = _pts;
-      av_frame_get_buffer(movie->frame, 32);
-    }
+  unshare_frame_buffers(movie);
 
   int src_stride[4] = {4 * frame->width, 0, 0, 0};
   const unsigned char *src_slice[4] = {frame->data, 0, 0, 0};
@@ -94,29 +185,152 @@ void vc_movie_append_frame(movie_t movie, frame_t frame)
       int dst_stride[4] = {4 * width, 0, 0, 0};
       unsigned char *dst_slice[4] = {movie->gif_scaled_image, 0, 0, 0};
 
+      if ((movie->flags & VC_FLAGS_GIF_GLOBAL_PALETTE) && !movie->gif_palette_ready)
+        {
+          /* collect the first frames until there are enough samples for the global palette */
+          dst_slice[0] = movie->gif_frames + (size_t)movie->gif_num_frames * width * height * 4;
+          sws_scale(movie->sws_ctx, src_slice, src_stride, 0, frame->height, dst_slice, dst_stride);
+          if (++movie->gif_num_frames == movie->gif_max_frames)
+            {
+              build_global_palette(movie);
+            }
+          return;
+        }
+
       sws_scale(movie->sws_ctx, src_slice, src_stride, 0, frame->height, dst_slice, dst_stride);
 
-      memcpy(movie->gif_scaled_image_copy, movie->gif_scaled_image, width * height * 4);
-      median_cut(movie->gif_scaled_image_copy, movie->gif_palette, width * height, AVPALETTE_COUNT, 4);
+      if (!(movie->flags & VC_FLAGS_GIF_GLOBAL_PALETTE))
+        {
+          memcpy(movie->gif_scaled_image_copy, movie->gif_scaled_image, width * height * 4);
+          median_cut(movie->gif_scaled_image_copy, movie->gif_palette, width * height, AVPALETTE_COUNT, 4);
+          color_lookup_table(movie->gif_palette, AVPALETTE_COUNT, 4, movie->gif_lookup);
+        }
+      encode_gif_frame(movie, movie->gif_scaled_image);
+      return;
+    }
+
+  sws_scale(movie->sws_ctx, src_slice, src_stride, 0, frame->height, movie->frame->data, movie->frame->linesize);
+  encode_frame(movie);
+  movie->frame->pts++;
+}
 
-      for (i = 0; i < width * height; i++)
+#ifndef NO_THREADS
+static void *encoder_thread(void *arg)
+{
+  movie_t movie = (movie_t)arg;
+  struct vc_queue_t_ *queue = movie->queue;
+
+  pthread_mutex_lock(&queue->mutex);
+  for (;;)
+    {
+      while (queue->count == 0 && !queue->finish)
+        {
+          pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+      if (queue->count == 0)
         {
-          movie->gif_scaled_image[i] =
-              color_index_for_rgb(movie->gif_scaled_image + (i * 4), movie->gif_palette, AVPALETTE_COUNT, 4);
+          break;
         }
+      pthread_mutex_unlock(&queue->mutex);
 
-      movie->frame->data[0] = movie->gif_scaled_image;
-      movie->frame->data[1] = movie->gif_palette;
+      process_frame(movie, queue->frame + queue->first);
 
-      movie->frame->linesize[0] = width;
-      movie->frame->linesize[1] = 0;
+      pthread_mutex_lock(&queue->mutex);
+      queue->first = (queue->first + 1) % VC_QUEUE_SIZE;
+      queue->count--;
+      pthread_cond_broadcast(&queue->cond);
     }
-  else
+  pthread_mutex_unlock(&queue->mutex);
+
+  return NULL;
+}
+#endif
+
+static void start_encoder(movie_t movie)
+{
+#ifndef NO_THREADS
+  struct vc_queue_t_ *queue = (struct vc_queue_t_ *)gks_malloc(sizeof(struct vc_queue_t_));
+
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->cond, NULL);
+  movie->queue = queue;
+  if (pthread_create(&queue->thread, NULL, encoder_thread, movie) != 0)
     {
-      sws_scale(movie->sws_ctx, src_slice, src_stride, 0, frame->height, movie->frame->data, movie->frame->linesize);
+      /* fall back to encoding the frames on the calling thread */
+      pthread_cond_destroy(&queue->cond);
+      pthread_mutex_destroy(&queue->mutex);
+      gks_free(queue);
+      movie->queue = NULL;
     }
-  encode_frame(movie);
-  movie->frame->pts++;
+#else
+  movie->queue = NULL;
+#endif
+}
+
+static void stop_encoder(movie_t movie)
+{
+#ifndef NO_THREADS
+  struct vc_queue_t_ *queue = movie->queue;
+  int i;
+
+  if (queue == NULL)
+    {
+      return;
+    }
+  pthread_mutex_lock(&queue->mutex);
+  queue->finish = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+  pthread_join(queue->thread, NULL);
+
+  for (i = 0; i < VC_QUEUE_SIZE; i++)
+    {
+      gks_free(queue->frame[i].data);
+    }
+  pthread_cond_destroy(&queue->cond);
+  pthread_mutex_destroy(&queue->mutex);
+  gks_free(queue);
+  movie->queue = NULL;
+#else
+  GKS_UNUSED(movie);
+#endif
+}
+
+void vc_movie_append_frame(movie_t movie, frame_t frame)
+{
+#ifndef NO_THREADS
+  struct vc_queue_t_ *queue = movie->queue;
+  size_t size = (size_t)frame->width * frame->height * 4;
+  int i;
+
+  if (queue != NULL)
+    {
+      /* wait for a free slot, the frame is encoded in the background while the caller renders the next one */
+      pthread_mutex_lock(&queue->mutex);
+      while (queue->count == VC_QUEUE_SIZE)
+        {
+          pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+      i = (queue->first + queue->count) % VC_QUEUE_SIZE;
+      pthread_mutex_unlock(&queue->mutex);
+
+      if (queue->size[i] < size)
+        {
+          queue->frame[i].data = (unsigned char *)gks_realloc(queue->frame[i].data, (int)size);
+          queue->size[i] = size;
+        }
+      memcpy(queue->frame[i].data, frame->data, size);
+      queue->frame[i].width = frame->width;
+      queue->frame[i].height = frame->height;
+
+      pthread_mutex_lock(&queue->mutex);
+      queue->count++;
+      pthread_cond_broadcast(&queue->cond);
+      pthread_mutex_unlock(&queue->mutex);
+      return;
+    }
+#endif
+  process_frame(movie, frame);
 }
 
 movie_t vc_movie_create(const char *path, int framerate, int bitrate, int width, int height, int flags)
@@ -132,6 +346,9 @@ movie_t vc_movie_create(const char *path, int framerate, int bitrate, int width,
 #endif
 
   movie_t movie = (movie_t)gks_malloc(sizeof(struct movie_t_));
+  AVDictionary *codec_options = NULL;
+
+  movie->flags = flags;
 
   const char *format_name = NULL;
   if (strlen(path) >= 3 && strcmp(path + strlen(path) - 3, "mov") == 0)
@@ -200,6 +417,22 @@ movie_t vc_movie_create(const char *path, int framerate, int bitrate, int width,
       movie->gif_palette = (unsigned char *)gks_malloc(AVPALETTE_SIZE);
       movie->gif_scaled_image = (unsigned char *)gks_malloc(width * height * 4);
       movie->gif_scaled_image_copy = (unsigned char *)gks_malloc(width * height * 4);
+      movie->gif_lookup = (unsigned char *)gks_malloc(COLOR_LOOKUP_SIZE);
+      if (flags & VC_FLAGS_GIF_GLOBAL_PALETTE)
+        {
+          movie->gif_max_frames = VC_GIF_SAMPLE_MEMORY / (width * height * 4);
+          if (movie->gif_max_frames > VC_GIF_SAMPLE_FRAMES)
+            {
+              movie->gif_max_frames = VC_GIF_SAMPLE_FRAMES;
+            }
+          else if (movie->gif_max_frames < 1)
+            {
+              movie->gif_max_frames = 1;
+            }
+          movie->gif_frames = (unsigned char *)gks_malloc(movie->gif_max_frames * width * height * 4);
+        }
+      /* only store the rectangle which changed since the last frame, with unchanged pixels made transparent */
+      av_dict_set(&codec_options, "gifflags", "+offsetting+transdiff", 0);
     }
   else if (movie->fmt_ctx->oformat->video_codec == AV_CODEC_ID_APNG)
     {
@@ -218,7 +451,8 @@ movie_t vc_movie_create(const char *path, int framerate, int bitrate, int width,
   movie->video_st->time_base = movie->cdc_ctx->time_base;
   movie->video_st->r_frame_rate = movie->cdc_ctx->framerate;
 
-  ret = avcodec_open2(movie->cdc_ctx, codec, NULL);
+  ret = avcodec_open2(movie->cdc_ctx, codec, &codec_options);
+  av_dict_free(&codec_options);
   if (ret < 0)
     {
       fprintf(stderr, "Could not open video codec: %s\n", av_err2str(ret));
@@ -285,11 +519,21 @@ movie_t vc_movie_create(const char *path, int framerate, int bitrate, int width,
       return NULL;
     }
 
+  start_encoder(movie);
+
   return movie;
 }
 
 void vc_movie_finish(movie_t movie)
 {
+  /* encode all queued frames before the encoder is drained */
+  stop_encoder(movie);
+
+  if (movie->frame && movie->gif_num_frames > 0)
+    {
+      build_global_palette(movie);
+    }
+
   if (movie->frame)
     {
       /* drain encoder */
@@ -309,6 +553,8 @@ void vc_movie_finish(movie_t movie)
   gks_free(movie->gif_palette);
   gks_free(movie->gif_scaled_image);
   gks_free(movie->gif_scaled_image_copy);
+  gks_free(movie->gif_lookup);
+  gks_free(movie->gif_frames);
 
   if (movie->fmt_ctx && movie->cdc_ctx)
     {
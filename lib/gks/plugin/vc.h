@@ -16,6 +16,7 @@ extern "C" {
 #include <libswscale/swscale.h>
 
 #define VC_FLAGS_MOV_HIDPI (1 << 0)
+#define VC_FLAGS_GIF_GLOBAL_PALETTE (1 << 1)
 
 struct frame_t_
 {
@@ -36,6 +37,13 @@ struct movie_t_
   unsigned char *gif_scaled_image;
   unsigned char *gif_scaled_image_copy;
   unsigned char *gif_palette;
+  unsigned char *gif_lookup; /* 15-bit RGB to palette index table */
+  unsigned char *gif_frames; /* frames buffered until the global palette is known */
+  int gif_num_frames, gif_max_frames, gif_palette_ready;
+  int flags;
+
+  /* frame queue of the encoder thread, NULL if frames are encoded synchronously */
+  struct vc_queue_t_ *queue;
 };
 
 typedef struct movie_t_ *movie_t;
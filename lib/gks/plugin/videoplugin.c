@@ -130,16 +130,15 @@ static void write_page(void)
     {
       for (j = 0; j < width; j++)
         {
-          long ind = (i * width + j) * 4;
-          double alpha = mem[ind + 3] / 255.0;
+          long ind = ((long)i * width + j) * 4;
+          int alpha = mem[ind + 3];
+          if (alpha == 255)
+            {
+              continue;
+            }
           for (k = 0; k < 3; k++)
             {
-              double col = mem[ind + k] * alpha + bg[k] * (1 - alpha) + 0.5;
-              if (col > 255)
-                {
-                  col = 255;
-                }
-              mem[ind + k] = (unsigned char)col;
+              mem[ind + k] = (unsigned char)((mem[ind + k] * alpha + bg[k] * (255 - alpha) + 127) / 255);
             }
         }
     }
@@ -223,6 +222,12 @@ void gks_videoplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doub
         {
           p->video_flags |= VC_FLAGS_MOV_HIDPI;
         }
+      env = (char *)gks_getenv("GKS_GIF_PALETTE");
+      if (env && strcmp(env, "global") == 0)
+        {
+          /* GKS_GIF_PALETTE=global: use one palette for all frames of an animated GIF */
+          p->video_flags |= VC_FLAGS_GIF_GLOBAL_PALETTE;
+        }
 
       p->framerate = 24;
       p->width = 720;
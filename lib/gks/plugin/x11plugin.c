@@ -96,6 +96,7 @@ DLLEXPORT void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *i_arr, in
 #define MAX_SIZE 1000
 
 #define MAX_POINTS 2048
+#define MAX_DAMAGE 64
 #define MAX_SELECTIONS 100
 #define PATTERNS 120
 #define HATCH_STYLE 108
@@ -317,6 +318,8 @@ typedef struct ws_state_list_struct
   pthread_t master_thread;
   Pixmap pixmap, drawable, icon_pixmap;
   Bool double_buf;
+  Region damage;
+  int damage_x1, damage_y1, damage_x2, damage_y2, num_damage;
   int shape;
   XImage *shmimage;
 #ifdef XSHM
@@ -545,6 +548,16 @@ static void seg_xform_rel(double *x, double *y)
 }
 
 
+static void track_damage(int x, int y)
+{
+  if (x < p->damage_x1) p->damage_x1 = x;
+  if (x > p->damage_x2) p->damage_x2 = x;
+
+  if (y < p->damage_y1) p->damage_y1 = y;
+  if (y > p->damage_y2) p->damage_y2 = y;
+}
+
+
 static void update_bbox(int x, int y)
 {
   if (p->bb_update)
@@ -555,6 +568,61 @@ static void update_bbox(int x, int y)
       if (y < p->bb->y1) p->bb->y1 = y;
       if (y > p->bb->y2) p->bb->y2 = y;
     }
+  if (p->double_buf) track_damage(x, y);
+}
+
+
+static void reset_damage(void)
+{
+  p->damage_x1 = p->damage_y1 = 65535;
+  p->damage_x2 = p->damage_y2 = -65535;
+}
+
+
+static void add_damage(int margin)
+
+/*
+ *  Add the area touched by the last primitive to the damaged region. In
+ *  double buffered mode only this region is copied to the window on the
+ *  next update.
+ */
+
+{
+  XRectangle rt;
+  int x1, y1, x2, y2;
+
+  x1 = max(0, p->damage_x1 - margin);
+  y1 = max(0, p->damage_y1 - margin);
+  x2 = min(p->width - 1, p->damage_x2 + margin);
+  y2 = min(p->height - 1, p->damage_y2 + margin);
+  reset_damage();
+
+  if (x1 > x2 || y1 > y2) return;
+
+  rt.x = x1;
+  rt.y = y1;
+  rt.width = x2 - x1 + 1;
+  rt.height = y2 - y1 + 1;
+  XUnionRectWithRegion(&rt, p->damage, p->damage);
+
+  if (++p->num_damage > MAX_DAMAGE)
+    {
+      /* many scattered rectangles are cheaper to copy as one */
+      XClipBox(p->damage, &rt);
+      XDestroyRegion(p->damage);
+      p->damage = XCreateRegion();
+      XUnionRectWithRegion(&rt, p->damage, p->damage);
+      p->num_damage = 1;
+    }
+}
+
+
+static void damage_all(void)
+{
+  p->damage_x1 = p->damage_y1 = 0;
+  p->damage_x2 = p->width - 1;
+  p->damage_y2 = p->height - 1;
+  add_damage(0);
 }
 
 
@@ -983,6 +1051,7 @@ static void configure_viewport(XConfigureEvent *event)
           XFreePixmap(p->dpy, p->pixmap);
           p->pixmap = XCreatePixmap(p->dpy, XRootWindowOfScreen(p->screen), p->width, p->height, p->depth);
           XFillRectangle(p->dpy, p->pixmap, p->clear, 0, 0, p->width, p->height);
+          if (p->double_buf) damage_all();
         }
       if (p->drawable)
         {
@@ -1455,6 +1524,7 @@ static void configure_event(XConfigureEvent *event)
           XFreePixmap(p->dpy, p->pixmap);
           p->pixmap = XCreatePixmap(p->dpy, XRootWindowOfScreen(p->screen), p->width, p->height, p->depth);
           XFillRectangle(p->dpy, p->pixmap, p->clear, 0, 0, p->width, p->height);
+          if (p->double_buf) damage_all();
         }
       if (p->drawable)
         {
@@ -1475,6 +1545,29 @@ static void configure_event(XConfigureEvent *event)
 }
 
 
+static void copy_damage(void)
+
+/*
+ *  Copy the damaged region of the pixmap to the window
+ */
+
+{
+  XRectangle rt;
+
+  if (p->pixmap && !XEmptyRegion(p->damage))
+    {
+      XClipBox(p->damage, &rt);
+      XSetRegion(p->dpy, p->gc, p->damage);
+      XCopyArea(p->dpy, p->pixmap, p->win, p->gc, rt.x, rt.y, rt.width, rt.height, rt.x, rt.y);
+      set_clipping(True);
+      XSync(p->dpy, False);
+    }
+  XDestroyRegion(p->damage);
+  p->damage = XCreateRegion();
+  p->num_damage = 0;
+}
+
+
 static void handle_expose_event(ws_state_list *p)
 
 /*
@@ -2514,6 +2607,12 @@ static void draw_image(int x, int y, int width, int height, byte *ba, Bool true_
 
   set_clipping(False);
 
+  if (p->double_buf)
+    {
+      track_damage(x, y);
+      track_damage(x + width - 1, y + height - 1);
+    }
+
   dest = XCreatePixmap(p->dpy, XRootWindowOfScreen(p->screen), width, height, p->depth);
   XCopyArea(p->dpy, p->pixmap ? p->pixmap : p->win, dest, p->gc, x, y, width, height, 0, 0);
   to = XGetImage(p->dpy, dest, 0, 0, width, height, AllPlanes, ZPixmap);
@@ -3431,7 +3530,8 @@ static void cell_array(double xmin, double xmax, double ymin, double ymax, int d
 #ifdef XSHM
       if (image != NULL)
         {
-          XShmPutImage(p->dpy, p->win, p->gc, image, 0, 0, x, y, w, h, True);
+          if (p->pixmap) XShmPutImage(p->dpy, p->pixmap, p->gc, image, 0, 0, x, y, w, h, False);
+          if (!p->double_buf) XShmPutImage(p->dpy, p->win, p->gc, image, 0, 0, x, y, w, h, True);
           XSync(p->dpy, False);
           return;
         }
@@ -3499,6 +3599,7 @@ static void resize_window(void)
           XFreePixmap(p->dpy, p->pixmap);
           p->pixmap = XCreatePixmap(p->dpy, XRootWindowOfScreen(p->screen), p->width, p->height, p->depth);
           XFillRectangle(p->dpy, p->pixmap, p->clear, 0, 0, p->width, p->height);
+          if (p->double_buf) damage_all();
         }
       if (p->drawable)
         {
@@ -4027,6 +4128,9 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
 
       p->packed_ca = gks_getenv("GKS_PACKED_CELL_ARRAY") ? True : False;
       p->double_buf = gks_getenv("GKS_DOUBLE_BUF") ? True : False;
+      p->damage = XCreateRegion();
+      p->num_damage = 0;
+      reset_damage();
       p->shape = gks_getenv("GKS_CONVEX_SHAPE") ? Convex : Complex;
       p->widget = (Widget)NULL;
       p->conid = ia[1];
@@ -4224,6 +4328,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       if (p->pixmap) XFreePixmap(p->dpy, p->pixmap);
       if (p->drawable) XFreePixmap(p->dpy, p->drawable);
       if (p->bbox) free(p->bbox);
+      XDestroyRegion(p->damage);
 
       free_GC();
 #ifndef NO_XFT
@@ -4279,7 +4384,10 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
 
       if (p->pixmap) XFillRectangle(p->dpy, p->pixmap, p->clear, 0, 0, p->width, p->height);
       if (p->drawable) XFillRectangle(p->dpy, p->drawable, p->clear, 0, 0, p->width, p->height);
-      if (!p->double_buf) XClearWindow(p->dpy, p->win);
+      if (!p->double_buf)
+        XClearWindow(p->dpy, p->win);
+      else
+        damage_all();
 
       p->empty = True;
 
@@ -4292,7 +4400,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
        *  Update workstation
        */
       lock();
-      if (p->double_buf && (ia[1] & GKS_K_PERFORM_FLAG)) handle_expose_event(p);
+      if (p->double_buf && (ia[1] & GKS_K_PERFORM_FLAG)) copy_damage();
 
       update();
 
@@ -4328,6 +4436,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       if (p->state == GKS_K_WS_ACTIVE)
         {
           polyline(*ia, r1, r2);
+          if (p->double_buf) add_damage(p->lwidth + 2);
         }
       unlock();
       break;
@@ -4342,6 +4451,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       if (p->state == GKS_K_WS_ACTIVE)
         {
           polymarker(*ia, r1, r2);
+          if (p->double_buf) add_damage(p->lwidth + 2);
         }
       unlock();
       break;
@@ -4356,6 +4466,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       if (p->state == GKS_K_WS_ACTIVE)
         {
           text(*r1, *r2, strlen(chars), chars);
+          if (p->double_buf) add_damage(p->lwidth + 2);
         }
       unlock();
       break;
@@ -4370,6 +4481,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       if (p->state == GKS_K_WS_ACTIVE)
         {
           fill_area(*ia, r1, r2);
+          if (p->double_buf) add_damage(p->lwidth + 2);
         }
       unlock();
       break;
@@ -4387,6 +4499,7 @@ void gks_x11plugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
           int true_color = function_id == DRAW_IMAGE;
 
           cell_array(r1[0], r1[1], r2[0], r2[1], dx, dy, dimx, ia, true_color);
+          if (p->double_buf) add_damage(p->lwidth + 2);
         }
       unlock();
       break;
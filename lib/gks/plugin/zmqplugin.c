@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200112L
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +8,13 @@
 #include <zmq.h>
 #endif
 
+#if !defined(NO_ZMQ) && !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define HAVE_SHM
+#endif
+
 #include "gks.h"
 #include "gkscore.h"
 
@@ -34,18 +42,157 @@ DLLEXPORT void gks_zmqplugin(int fctid, int dx, int dy, int dimx, int *ia, int l
 #define GKS_UNUSED(x) (void)(x)
 #endif
 
+#define SHM_MAGIC "GKSSHM1"
+#define SHM_DEFAULT_SIZE 256 /* MiB */
+#define SHM_MAX_FRAMES 64
+#define SHM_ALIGN 64
+
+/*
+   With GKS_ZMQ_SHM=<MiB> each display list is copied into a POSIX shared
+   memory ring buffer and only a gks_shm_frame_t descriptor is pushed over
+   the socket instead of the size and the display list. Subscribers map the
+   segment named in the descriptor and read the frame in place. Before the
+   publisher overwrites older frames it raises the oldest valid generation in
+   the segment header, so a frame which has been used is known to have been
+   intact if its generation is still >= header->oldest afterwards. Frames
+   which do not fit into the ring are sent inline as before.
+ */
+
+typedef struct
+{
+  char magic[8];
+  unsigned long size;                /* size of the data area following the header */
+  volatile unsigned long generation; /* generation of the latest frame */
+  volatile unsigned long oldest;     /* oldest generation whose data is intact */
+} gks_shm_header_t;
+
+typedef struct
+{
+  char magic[8];
+  char name[32];
+  unsigned long offset; /* relative to the data area */
+  unsigned long length;
+  unsigned long generation;
+} gks_shm_frame_t;
 
 typedef struct
 {
   void *context;
   void *publisher;
   gks_display_list_t dl;
+  char shm_name[32];
+  gks_shm_header_t *shm;
+  char *shm_data;
+  size_t shm_size;
+  unsigned long write_offset;
+  unsigned long frame_offset[SHM_MAX_FRAMES], frame_length[SHM_MAX_FRAMES];
 } ws_state_list;
 
 #ifndef NO_ZMQ
 
 static gks_state_list_t *gkss;
 
+#ifdef HAVE_SHM
+
+static void memory_barrier(void)
+{
+#ifdef __GNUC__
+  __sync_synchronize();
+#endif
+}
+
+static void open_shm(ws_state_list *wss, const char *env)
+{
+  static int counter = 0;
+  long size = atol(env);
+  int fd;
+  void *map;
+
+  if (size <= 0) size = SHM_DEFAULT_SIZE;
+  sprintf(wss->shm_name, "/gks-zmq-%d-%d", (int)getpid(), counter++);
+  wss->shm_size = sizeof(gks_shm_header_t) + SHM_ALIGN + ((size_t)size << 20);
+
+  fd = shm_open(wss->shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    {
+      gks_perror("can't create shared memory segment %s", wss->shm_name);
+      return;
+    }
+  if (ftruncate(fd, (off_t)wss->shm_size) != 0 ||
+      (map = mmap(NULL, wss->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      gks_perror("can't map shared memory segment %s", wss->shm_name);
+      close(fd);
+      shm_unlink(wss->shm_name);
+      return;
+    }
+  close(fd);
+
+  wss->shm = (gks_shm_header_t *)map;
+  wss->shm_data = (char *)map + (sizeof(gks_shm_header_t) + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+  memcpy(wss->shm->magic, SHM_MAGIC, sizeof(wss->shm->magic));
+  wss->shm->size = (unsigned long)size << 20;
+  wss->shm->generation = 0;
+  wss->shm->oldest = 1;
+  wss->write_offset = 0;
+}
+
+static void close_shm(ws_state_list *wss)
+{
+  if (wss->shm != NULL)
+    {
+      munmap(wss->shm, wss->shm_size);
+      shm_unlink(wss->shm_name);
+      wss->shm = NULL;
+    }
+}
+
+static int publish_shm(ws_state_list *wss)
+{
+  gks_shm_header_t *shm = wss->shm;
+  gks_shm_frame_t frame;
+  unsigned long length = (unsigned long)wss->dl.nbytes, offset, generation, oldest, g;
+
+  if (shm == NULL || length > shm->size) return 0;
+
+  offset = wss->write_offset + length <= shm->size ? wss->write_offset : 0;
+  generation = shm->generation + 1;
+
+  /* invalidate the frames which are about to be overwritten before touching their data; after a wrap the live
+     frames are not ordered by offset, so every one of them has to be checked */
+  oldest = shm->oldest;
+  if (generation - oldest >= SHM_MAX_FRAMES) oldest = generation - SHM_MAX_FRAMES + 1;
+  for (g = oldest; g < generation; g++)
+    {
+      if (wss->frame_offset[g % SHM_MAX_FRAMES] < offset + length &&
+          offset < wss->frame_offset[g % SHM_MAX_FRAMES] + wss->frame_length[g % SHM_MAX_FRAMES])
+        {
+          oldest = g + 1;
+        }
+    }
+  shm->oldest = oldest;
+  memory_barrier();
+
+  memcpy(wss->shm_data + offset, wss->dl.buffer, length);
+  wss->frame_offset[generation % SHM_MAX_FRAMES] = offset;
+  wss->frame_length[generation % SHM_MAX_FRAMES] = length;
+  wss->write_offset = offset + length;
+  memory_barrier();
+  shm->generation = generation;
+
+  memset(&frame, 0, sizeof(frame));
+  memcpy(frame.magic, SHM_MAGIC, sizeof(frame.magic));
+  strcpy(frame.name, wss->shm_name);
+  frame.offset = offset;
+  frame.length = length;
+  frame.generation = generation;
+  zmq_send(wss->publisher, &frame, sizeof(frame), 0);
+
+  return 1;
+}
+
+#endif
+
 void gks_zmqplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double *r1, int lr2, double *r2, int lc,
                    char *chars, void **ptr)
 {
@@ -62,6 +209,12 @@ void gks_zmqplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       wss->context = zmq_ctx_new();
       wss->publisher = zmq_socket(wss->context, ZMQ_PUSH);
       zmq_bind(wss->publisher, "tcp://*:5556");
+#ifdef HAVE_SHM
+      if (gks_getenv("GKS_ZMQ_SHM") != NULL)
+        {
+          open_shm(wss, gks_getenv("GKS_ZMQ_SHM"));
+        }
+#endif
 
       gks_init_core(gkss);
 
@@ -69,6 +222,9 @@ void gks_zmqplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
       break;
 
     case 3:
+#ifdef HAVE_SHM
+      close_shm(wss);
+#endif
       zmq_close(wss->publisher);
       zmq_ctx_destroy(wss->context);
 
@@ -79,6 +235,9 @@ void gks_zmqplugin(int fctid, int dx, int dy, int dimx, int *ia, int lr1, double
     case 8:
       if (ia[1] & GKS_K_WRITE_PAGE_FLAG)
         {
+#ifdef HAVE_SHM
+          if (publish_shm(wss)) break;
+#endif
           zmq_send(wss->publisher, (char *)&wss->dl.nbytes, sizeof(int), 0);
           zmq_send(wss->publisher, wss->dl.buffer, wss->dl.nbytes, 0);
         }
@@ -18,6 +18,7 @@
 
 const int GKSConnection::window_shift = 30;
 unsigned int GKSConnection::index = 0;
+const int GKSConnection::protocol_version = 2;
 const unsigned int GKSServer::port = 8410;
 
 
@@ -37,12 +38,14 @@ inline QRect &operator-=(QRect &rect, const QMargins &margins)
 
 
 GKSConnection::GKSConnection(QTcpSocket *socket)
-    : socket(socket), widget(NULL), dl(NULL), dl_size(0), socket_function(SocketFunction::unknown)
+    : socket(socket), widget(NULL), dl(NULL), dl_size(0), socket_function(SocketFunction::unknown),
+      delta_header_read(false)
 {
   ++index;
   connect(socket, SIGNAL(readyRead()), this, SLOT(readClient()));
   connect(socket, SIGNAL(disconnected()), this, SLOT(disconnectedSocket()));
-  // send information about workstation back to client
+  // send information about workstation back to client, including the supported protocol version in the last byte of
+  // the name, which older servers always sent as the terminating zero of "gksqt" (older clients ignore the name)
   struct
   {
     int nbytes;
@@ -50,8 +53,10 @@ GKSConnection::GKSConnection(QTcpSocket *socket)
     double mheight;
     int width;
     int height;
-    char name[6];
-  } workstation_information = {sizeof(workstation_information), 0, 0, 0, 0, "gksqt"};
+    char name[5];
+    char protocol;
+  } workstation_information = {
+      sizeof(workstation_information), 0, 0, 0, 0, {'g', 'k', 's', 'q', 't'}, static_cast<char>(protocol_version)};
   GKSWidget::inqdspsize(&workstation_information.mwidth, &workstation_information.mheight,
                         &workstation_information.width, &workstation_information.height);
   socket->write(reinterpret_cast<const char *>(&workstation_information), workstation_information.nbytes);
@@ -104,6 +109,60 @@ void GKSConnection::readClient()
           dl_size = 0;
           socket_function = SocketFunction::unknown;
           break;
+        case SocketFunction::negotiate:
+          {
+            int request[2];
+            if (socket->bytesAvailable() < (long)sizeof(request)) return;
+            socket->read(reinterpret_cast<char *>(request), sizeof(request));
+            int version = request[0] < protocol_version ? request[0] : protocol_version;
+            int encodings = request[1] & SocketEncoding::zlib;
+            char reply[1 + 2 * sizeof(int)];
+            reply[0] = static_cast<char>(SocketFunction::negotiate);
+            memcpy(reply + 1, &version, sizeof(int));
+            memcpy(reply + 1 + sizeof(int), &encodings, sizeof(int));
+            socket->write(reply, sizeof(reply));
+            socket->flush();
+            display_list.clear();
+            socket_function = SocketFunction::unknown;
+          }
+          break;
+        case SocketFunction::draw_delta:
+          // header: offset of the update in the display list, number of bytes, payload size and encoding
+          if (!delta_header_read)
+            {
+              if (socket->bytesAvailable() < (long)sizeof(delta_header)) return;
+              socket->read(reinterpret_cast<char *>(delta_header), sizeof(delta_header));
+              delta_header_read = true;
+            }
+          if (socket->bytesAvailable() < delta_header[2]) return;
+          {
+            QByteArray payload = socket->read(delta_header[2]);
+            if (delta_header[3] == SocketEncoding::zlib)
+              {
+                payload = qUncompress(payload);
+              }
+            if (delta_header[0] < 0 || delta_header[0] > display_list.size() || payload.size() != delta_header[1])
+              {
+                qWarning("GKSserver: Received invalid display list update");
+              }
+            else
+              {
+                display_list.truncate(delta_header[0]);
+                display_list.append(payload);
+                dl = new char[display_list.size() + sizeof(int)];
+                memcpy(dl, display_list.constData(), display_list.size());
+                // The data buffer must be terminated by a zero integer -> `sizeof(int)` zero bytes
+                memset(dl + display_list.size(), 0, sizeof(int));
+                if (widget == NULL)
+                  {
+                    newWidget();
+                  }
+                emit(data(dl));
+              }
+            delta_header_read = false;
+            socket_function = SocketFunction::unknown;
+          }
+          break;
         case SocketFunction::is_alive:
           {
             char reply[1]{static_cast<char>(SocketFunction::is_alive)};
@@ -155,6 +214,8 @@ void GKSConnection::readClient()
           }
           break;
         default:
+          // ignore unknown requests instead of spinning on them
+          socket_function = SocketFunction::unknown;
           break;
         }
     }
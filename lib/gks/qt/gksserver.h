@@ -2,6 +2,7 @@
 #define _GKSSERVER_H_
 
 #include <list>
+#include <QByteArray>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <qstring.h>
@@ -19,7 +20,19 @@ struct SocketFunction
     is_alive = 3,
     close_window = 4,
     is_running = 5,
-    inq_ws_state = 6
+    inq_ws_state = 6,
+    negotiate = 7,
+    draw_delta = 8
+  };
+};
+
+
+struct SocketEncoding
+{
+  enum Enum
+  {
+    raw = 0,
+    zlib = 1
   };
 };
 
@@ -53,6 +66,10 @@ private:
   char *dl;
   unsigned int dl_size;
   SocketFunction::Enum socket_function;
+  static const int protocol_version;
+  QByteArray display_list;
+  int delta_header[4];
+  bool delta_header_read;
 };
 
 
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+
 #include "gkscore.h"
 #include "gks.h"
 
@@ -16,6 +17,39 @@
 #define round(x) ((x) < 0 ? ceil((x)-.5) : floor((x) + .5))
 #endif
 
+#define MAX_RESAMPLE_THREADS 64
+
+/* minimum number of target pixels per thread before work is split up */
+#define MIN_PIXELS_PER_THREAD 65536
+
+typedef struct
+{
+  int num_steps;
+  int *first;     /* first source index contributing to each target index */
+  int *count;     /* number of contributing source indices */
+  float *factors; /* num_steps normalized factors per target index */
+} resampling_factors_t;
+
+typedef struct
+{
+  const unsigned char *source_image;
+  float *temp_image;
+  unsigned char *target_image;
+  size_t source_width, source_height, target_width, target_height, stride;
+  int flip;
+  const resampling_factors_t *factors;
+} resample_args_t;
+
+typedef void (*resample_func_t)(const resample_args_t *args, size_t start, size_t end);
+
+typedef struct
+{
+  resample_func_t func;
+  const resample_args_t *args;
+  size_t num_rows;
+  int num_bands;
+} resample_job_t;
+
 static double lanczos(double x, int a)
 {
   if (x == 0.0)
@@ -60,8 +94,8 @@ static double calculate_linear_factor(double source_position, double target_posi
   return integrate_box(source_position - target_position - 0.5, source_position - target_position + 0.5, a);
 }
 
-static double *calculate_resampling_factors(size_t source_size, size_t target_size, int a, int flip,
-                                            double (*factor_func)(double, double, int))
+static void calculate_resampling_factors(resampling_factors_t *rf, size_t source_size, size_t target_size, int a,
+                                         int flip, double (*factor_func)(double, double, int))
 {
   size_t i;
   size_t i_flipped;
@@ -76,12 +110,17 @@ static double *calculate_resampling_factors(size_t source_size, size_t target_si
     {
       num_steps = a * 2;
     }
-  factors = (double *)gks_malloc((int)(sizeof(double) * target_size * num_steps));
+  factors = (double *)gks_malloc((int)(sizeof(double) * num_steps));
+  rf->num_steps = num_steps;
+  rf->first = (int *)gks_malloc((int)(sizeof(int) * target_size));
+  rf->count = (int *)gks_malloc((int)(sizeof(int) * target_size));
+  rf->factors = (float *)gks_malloc((int)(sizeof(float) * target_size * num_steps));
   for (i = 0; i < target_size; i++)
     {
       double sum = 0.0;
       double target_position;
       int source_index_offset;
+      int first = -1, count = 0;
 
       if (flip)
         {
@@ -127,199 +166,216 @@ static double *calculate_resampling_factors(size_t source_size, size_t target_si
             }
           factor = factor_func(source_position, target_position, a);
           sum += factor;
-          factors[i * num_steps + j] = factor;
+          if (first < 0) first = source_index;
+          factors[count++] = factor;
         }
-      for (j = 0; j < num_steps; j++)
+      rf->first[i] = first < 0 ? 0 : first;
+      rf->count[i] = count;
+      for (j = 0; j < (unsigned int)count; j++)
         {
-          factors[i * num_steps + j] /= sum;
+          rf->factors[i * num_steps + j] = (float)(factors[j] / sum);
         }
     }
-  return factors;
+  gks_free(factors);
 }
 
-static void resample_horizontal_rgba(const unsigned char *source_image, double *target_image, size_t source_width,
-                                     size_t source_height, size_t target_width, size_t stride, int a, int flip,
-                                     double (*factor_func)(double, double, int))
+static void free_resampling_factors(resampling_factors_t *rf)
 {
-  size_t ix;
-  size_t ix_flipped;
-  size_t iy;
-  int i, j;
-  int num_steps;
-  double *factors;
-  if (source_width > target_width)
-    {
-      num_steps = (int)ceil((double)source_width / target_width * a) * 2;
-    }
-  else
-    {
-      num_steps = a * 2;
-    }
-  factors = calculate_resampling_factors(source_width, target_width, a, flip, factor_func);
+  gks_free(rf->first);
+  gks_free(rf->count);
+  gks_free(rf->factors);
+}
 
-  for (iy = 0; iy < source_height; iy++)
+static int resample_thread_count(size_t num_pixels)
+{
+  int num_threads = gks_thread_count("GKS_RESAMPLE_THREADS", MAX_RESAMPLE_THREADS);
+
+  if ((size_t)num_threads > num_pixels / MIN_PIXELS_PER_THREAD) num_threads = (int)(num_pixels / MIN_PIXELS_PER_THREAD);
+  return num_threads < 1 ? 1 : num_threads;
+}
+
+static void resample_band(void *arg, int band)
+{
+  resample_job_t *job = (resample_job_t *)arg;
+
+  job->func(job->args, job->num_rows * band / job->num_bands, job->num_rows * (band + 1) / job->num_bands);
+}
+
+static void run_resample_func(resample_func_t func, const resample_args_t *args, size_t num_rows, size_t row_size)
+/*
+   Run func on all rows, split into contiguous bands processed by separate
+   threads if the image is large enough. Every row is computed by exactly
+   one thread, so the result does not depend on the number of threads.
+ */
+{
+  resample_job_t job;
+
+  job.func = func;
+  job.args = args;
+  job.num_rows = num_rows;
+  job.num_bands = resample_thread_count(num_rows * row_size);
+  if ((size_t)job.num_bands > num_rows) job.num_bands = num_rows > 0 ? (int)num_rows : 1;
+  gks_run_threads(job.num_bands, resample_band, &job);
+}
+
+static void resample_horizontal_rows(const resample_args_t *args, size_t start, size_t end)
+{
+  const resampling_factors_t *rf = args->factors;
+  size_t ix, iy;
+  int i;
+
+  for (iy = start; iy < end; iy++)
     {
-      for (ix = 0; ix < target_width; ix++)
-        {
-          int source_index_offset;
+      const unsigned char *source_row = args->source_image + iy * args->stride * 4;
+      float *target_row = args->temp_image + iy * args->target_width * 4;
 
-          if (flip)
-            {
-              ix_flipped = (int)target_width - 1 - ix;
-            }
-          else
-            {
-              ix_flipped = ix;
-            }
+      for (ix = 0; ix < args->target_width; ix++)
+        {
+          const unsigned char *source_pixel = source_row + (size_t)rf->first[ix] * 4;
+          const float *factors = rf->factors + ix * rf->num_steps;
+          float r = 0, g = 0, b = 0, a = 0;
 
-          if (source_width > target_width)
-            {
-              source_index_offset = (int)ceil((double)ix_flipped / (double)(target_width - 1) * (double)source_width -
-                                              0.5 - (double)source_width / (double)target_width * a);
-            }
-          else
+          for (i = 0; i < rf->count[ix]; i++)
             {
-              source_index_offset =
-                  (int)floor((double)ix_flipped / (double)(target_width - 1) * (double)source_width + 0.5 - a);
-            }
-          for (i = 0; i < num_steps; i++)
-            {
-              int source_index = source_index_offset + i;
-              double factor;
-
-              if (source_index < 0)
-                {
-                  continue;
-                }
-              if (source_index > (int)source_width - 1)
-                {
-                  break;
-                }
-              factor = factors[ix * num_steps + i];
-              for (j = 0; j < 4; j++)
-                {
-                  target_image[(iy * target_width + ix) * 4 + j] +=
-                      source_image[(iy * stride + source_index) * 4 + j] * factor;
-                }
+              r += source_pixel[i * 4 + 0] * factors[i];
+              g += source_pixel[i * 4 + 1] * factors[i];
+              b += source_pixel[i * 4 + 2] * factors[i];
+              a += source_pixel[i * 4 + 3] * factors[i];
             }
+          target_row[ix * 4 + 0] = r;
+          target_row[ix * 4 + 1] = g;
+          target_row[ix * 4 + 2] = b;
+          target_row[ix * 4 + 3] = a;
         }
     }
-  gks_free(factors);
 }
 
-static void resample_vertical_rgba(const double *source_image, unsigned char *target_image, size_t source_width,
-                                   size_t source_height, size_t target_height, size_t stride, int a, int flip,
-                                   double (*factor_func)(double, double, int))
+static void resample_horizontal_rgba(const unsigned char *source_image, float *target_image, size_t source_width,
+                                     size_t source_height, size_t target_width, size_t stride, int a, int flip,
+                                     double (*factor_func)(double, double, int))
 {
-  size_t ix;
-  size_t iy;
-  size_t iy_flipped;
-  int i, j;
-  int num_steps;
-  double *factors;
-  if (source_height > target_height)
-    {
-      num_steps = (int)ceil((double)source_height / target_height * a) * 2;
-    }
-  else
-    {
-      num_steps = 2 * a;
-    }
-  factors = calculate_resampling_factors(source_height, target_height, a, flip, factor_func);
+  resampling_factors_t rf;
+  resample_args_t args;
+
+  calculate_resampling_factors(&rf, source_width, target_width, a, flip, factor_func);
 
-  for (ix = 0; ix < source_width; ix++)
+  args.source_image = source_image;
+  args.temp_image = target_image;
+  args.target_width = target_width;
+  args.stride = stride;
+  args.factors = &rf;
+  run_resample_func(resample_horizontal_rows, &args, source_height, target_width);
+
+  free_resampling_factors(&rf);
+}
+
+static void resample_vertical_rows(const resample_args_t *args, size_t start, size_t end)
+{
+  const resampling_factors_t *rf = args->factors;
+  size_t ix, iy, row_size = args->source_width * 4;
+  float *result = (float *)gks_malloc((int)(sizeof(float) * row_size));
+  int i;
+
+  for (iy = start; iy < end; iy++)
     {
-      for (iy = 0; iy < target_height; iy++)
-        {
-          int source_index_offset;
-          double result[4] = {0};
+      const float *factors = rf->factors + iy * rf->num_steps;
+      unsigned char *target_row = args->target_image + iy * row_size;
 
-          if (flip)
-            {
-              iy_flipped = (int)target_height - 1 - iy;
-            }
-          else
-            {
-              iy_flipped = iy;
-            }
+      /* accumulate whole rows so that the inner loop runs over contiguous memory */
+      memset(result, 0, sizeof(float) * row_size);
+      for (i = 0; i < rf->count[iy]; i++)
+        {
+          const float *source_row = args->temp_image + ((size_t)rf->first[iy] + i) * args->stride * 4;
+          float factor = factors[i];
 
-          if (source_height > target_height)
+          for (ix = 0; ix < row_size; ix++)
             {
-              source_index_offset = (int)ceil((double)iy_flipped / (double)(target_height - 1) * (double)source_height -
-                                              0.5 - (double)source_height / target_height * a);
+              result[ix] += source_row[ix] * factor;
             }
-          else
+        }
+      for (ix = 0; ix < row_size; ix++)
+        {
+          float value = result[ix];
+          if (value > 255)
             {
-              source_index_offset =
-                  (int)floor((double)iy_flipped / (double)(target_height - 1) * (double)source_height + 0.5 - a);
+              value = 255;
             }
-
-          for (i = 0; i < num_steps; i++)
+          else if (value < 0)
             {
-              int source_index = source_index_offset + i;
-              double factor;
-
-              if (source_index < 0)
-                {
-                  continue;
-                }
-              if (source_index > (int)source_height - 1)
-                {
-                  break;
-                }
-              factor = factors[iy * num_steps + i];
-              for (j = 0; j < 4; j++)
-                {
-                  result[j] += source_image[(source_index * stride + ix) * 4 + j] * factor;
-                }
-            }
-          for (j = 0; j < 4; j++)
-            {
-              if (result[j] > 255)
-                {
-                  result[j] = 255;
-                }
-              else if (result[j] < 0)
-                {
-                  result[j] = 0;
-                }
-              target_image[(iy * source_width + ix) * 4 + j] = (unsigned char)round(result[j]);
+              value = 0;
             }
+          target_row[ix] = (unsigned char)(value + 0.5f);
         }
     }
-  gks_free(factors);
+  gks_free(result);
 }
 
+static void resample_vertical_rgba(const float *source_image, unsigned char *target_image, size_t source_width,
+                                   size_t source_height, size_t target_height, size_t stride, int a, int flip,
+                                   double (*factor_func)(double, double, int))
+{
+  resampling_factors_t rf;
+  resample_args_t args;
 
-static void resample_rgba_nearest(const unsigned char *source_image, unsigned char *target_image, size_t source_width,
-                                  size_t source_height, size_t target_width, size_t target_height, size_t stride,
-                                  int flip_x, int flip_y)
+  calculate_resampling_factors(&rf, source_height, target_height, a, flip, factor_func);
+
+  args.temp_image = (float *)source_image;
+  args.target_image = target_image;
+  args.source_width = source_width;
+  args.stride = stride;
+  args.factors = &rf;
+  run_resample_func(resample_vertical_rows, &args, target_height, source_width);
+
+  free_resampling_factors(&rf);
+}
+
+static void resample_nearest_rows(const resample_args_t *args, size_t start, size_t end)
 {
   size_t ix, iy, ix_flipped, iy_flipped;
-  for (iy = 0; iy < target_height; iy++)
+  const unsigned char *source_image = args->source_image;
+  unsigned char *target_image = args->target_image;
+  size_t source_width = args->source_width, source_height = args->source_height;
+  size_t target_width = args->target_width, target_height = args->target_height;
+
+  for (iy = start; iy < end; iy++)
     {
       iy_flipped = source_height * iy / target_height;
-      if (flip_y)
+      if (args->flip & 2)
         {
           iy_flipped = source_height - 1 - iy_flipped;
         }
       for (ix = 0; ix < target_width; ix++)
         {
           ix_flipped = source_width * ix / target_width;
-          if (flip_x)
+          if (args->flip & 1)
             {
               ix_flipped = source_width - 1 - ix_flipped;
             }
 
-          target_image[(iy * target_width + ix) * 4 + 0] = source_image[(iy_flipped * stride + ix_flipped) * 4 + 0];
-          target_image[(iy * target_width + ix) * 4 + 1] = source_image[(iy_flipped * stride + ix_flipped) * 4 + 1];
-          target_image[(iy * target_width + ix) * 4 + 2] = source_image[(iy_flipped * stride + ix_flipped) * 4 + 2];
-          target_image[(iy * target_width + ix) * 4 + 3] = source_image[(iy_flipped * stride + ix_flipped) * 4 + 3];
+          memcpy(target_image + (iy * target_width + ix) * 4,
+                 source_image + (iy_flipped * args->stride + ix_flipped) * 4, 4);
         }
     }
 }
 
-static void resample_horizontal_rgba_nearest(const unsigned char *source_image, double *target_image,
+static void resample_rgba_nearest(const unsigned char *source_image, unsigned char *target_image, size_t source_width,
+                                  size_t source_height, size_t target_width, size_t target_height, size_t stride,
+                                  int flip_x, int flip_y)
+{
+  resample_args_t args;
+
+  args.source_image = source_image;
+  args.target_image = target_image;
+  args.source_width = source_width;
+  args.source_height = source_height;
+  args.target_width = target_width;
+  args.target_height = target_height;
+  args.stride = stride;
+  args.flip = (flip_x ? 1 : 0) | (flip_y ? 2 : 0);
+  run_resample_func(resample_nearest_rows, &args, target_height, target_width);
+}
+
+static void resample_horizontal_rgba_nearest(const unsigned char *source_image, float *target_image,
                                              size_t source_width, size_t source_height, size_t target_width,
                                              size_t stride, int flip)
 {
@@ -343,24 +399,23 @@ static void resample_horizontal_rgba_nearest(const unsigned char *source_image,
 }
 
 
-static void resample_vertical_rgba_nearest(const double *source_image, unsigned char *target_image, size_t source_width,
+static void resample_vertical_rgba_nearest(const float *source_image, unsigned char *target_image, size_t source_width,
                                            size_t source_height, size_t target_height, size_t stride, int flip)
 {
   size_t ix, iy, iy_flipped, j;
-  for (ix = 0; ix < source_width; ix++)
+  for (iy = 0; iy < target_height; iy++)
     {
-      for (iy = 0; iy < target_height; iy++)
+      iy_flipped = source_height * iy / target_height;
+      if (flip)
         {
-          iy_flipped = source_height * iy / target_height;
-          if (flip)
-            {
-              iy_flipped = source_height - 1 - iy_flipped;
-            }
-
+          iy_flipped = source_height - 1 - iy_flipped;
+        }
 
+      for (ix = 0; ix < source_width; ix++)
+        {
           for (j = 0; j < 4; j++)
             {
-              double value = round(source_image[(iy_flipped * stride + ix) * 4 + j]);
+              float value = source_image[(iy_flipped * stride + ix) * 4 + j];
               if (value > 255)
                 {
                   value = 255;
@@ -369,7 +424,7 @@ static void resample_vertical_rgba_nearest(const double *source_image, unsigned
                 {
                   value = 0;
                 }
-              target_image[(iy * source_width + ix) * 4 + j] = (unsigned char)value;
+              target_image[(iy * source_width + ix) * 4 + j] = (unsigned char)(value + 0.5f);
             }
         }
     }
@@ -486,7 +541,7 @@ void gks_resample(const unsigned char *source_image, unsigned char *target_image
                   size_t source_height, size_t target_width, size_t target_height, size_t stride, int flip_x,
                   int flip_y, unsigned int resample_method)
 {
-  double *temp_image;
+  float *temp_image;
   const unsigned int resampling_methods[] = {GKS_K_RESAMPLE_DEFAULT, GKS_K_RESAMPLE_NEAREST, GKS_K_RESAMPLE_LINEAR,
                                              GKS_K_RESAMPLE_LANCZOS};
   unsigned int horizontal_resampling_method;
@@ -563,7 +618,7 @@ void gks_resample(const unsigned char *source_image, unsigned char *target_image
       return;
     }
 
-  temp_image = (double *)gks_malloc((int)sizeof(double) * 4 * (int)target_width * (int)source_height);
+  temp_image = (float *)gks_malloc((int)(sizeof(float) * 4 * target_width * source_height));
 
   switch (horizontal_resampling_method)
     {
@@ -23,6 +23,10 @@
 #include <windows.h>
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "gks.h"
 #include "gkscore.h"
 
@@ -34,6 +38,15 @@
 #define SOCKET_FUNCTION_CLOSE_WINDOW 4
 #define SOCKET_FUNCTION_IS_RUNNING 5
 #define SOCKET_FUNCTION_INQ_WS_STATE 6
+#define SOCKET_FUNCTION_NEGOTIATE 7
+#define SOCKET_FUNCTION_DRAW_DELTA 8
+
+/* Servers supporting protocol negotiation announce their version in the last byte of the workstation name, which
+ * older servers always send as the terminating zero of "gksqt". */
+#define SOCKET_PROTOCOL_VERSION 2
+
+#define SOCKET_ENCODING_RAW 0
+#define SOCKET_ENCODING_ZLIB 1
 
 
 #ifndef MAXPATHLEN
@@ -48,6 +61,7 @@ typedef struct
   int wstype;
   gks_display_list_t dl;
   double aspect_ratio;
+  int protocol, compression, sent;
 } ws_state_list;
 
 static gks_state_list_t *gkss;
@@ -365,6 +379,133 @@ static int close_socket(int s)
   return 0;
 }
 
+static void negotiate_protocol(ws_state_list *wss, int version)
+{
+  char request[1 + 2 * sizeof(int)], reply[1 + 2 * sizeof(int)];
+  int flags = 0;
+  const char *env;
+
+  if (version > SOCKET_PROTOCOL_VERSION) version = SOCKET_PROTOCOL_VERSION;
+#ifdef HAVE_ZLIB
+  env = gks_getenv("GKS_QT_COMPRESSION");
+  if (env != NULL && atoi(env) > 0) flags |= SOCKET_ENCODING_ZLIB;
+#else
+  env = NULL;
+#endif
+
+  request[0] = SOCKET_FUNCTION_NEGOTIATE;
+  memcpy(request + 1, &version, sizeof(int));
+  memcpy(request + 1 + sizeof(int), &flags, sizeof(int));
+  if (send_socket(wss->s, request, sizeof(request), 0) == sizeof(request) &&
+      read_socket(wss->s, reply, sizeof(reply), 0) == sizeof(reply) && reply[0] == SOCKET_FUNCTION_NEGOTIATE)
+    {
+      memcpy(&wss->protocol, reply + 1, sizeof(int));
+      memcpy(&flags, reply + 1 + sizeof(int), sizeof(int));
+      if (flags & SOCKET_ENCODING_ZLIB)
+        {
+          wss->compression = atoi(env);
+          if (wss->compression > 9) wss->compression = 9;
+        }
+    }
+}
+
+static void read_workstation_information(ws_state_list *wss, int *ia, double *r1, double *r2)
+{
+  int nbytes;
+  struct
+  {
+    int nbytes;
+    double mwidth;
+    double mheight;
+    int width;
+    int height;
+    char name[5];
+    char protocol;
+  } workstation_information = {sizeof(workstation_information), 0, 0, 0, 0, "", 0};
+
+  wss->protocol = 1;
+  wss->compression = 0;
+  wss->sent = 0;
+
+  if (read_socket(wss->s, (char *)&nbytes, sizeof(int), 0) == sizeof(int) && nbytes > (int)sizeof(int))
+    {
+      char *buf = gks_malloc(nbytes);
+      if (read_socket(wss->s, buf + sizeof(int), nbytes - (int)sizeof(int), 0) == nbytes - (int)sizeof(int) &&
+          nbytes == workstation_information.nbytes)
+        {
+          memcpy((char *)&workstation_information + sizeof(int), buf + sizeof(int), nbytes - sizeof(int));
+          if (ia != NULL)
+            {
+              ia[0] = workstation_information.width;
+              ia[1] = workstation_information.height;
+              r1[0] = workstation_information.mwidth;
+              r2[0] = workstation_information.mheight;
+            }
+          if (workstation_information.protocol >= 2)
+            {
+              negotiate_protocol(wss, workstation_information.protocol);
+            }
+        }
+      gks_free(buf);
+    }
+}
+
+static void send_display_list(ws_state_list *wss)
+{
+  char request_type;
+  int header[4]; /* offset, number of bytes, payload size, encoding */
+  char *payload, *buffer = NULL;
+
+  if (wss->wstype < 411 || wss->wstype > 413 || wss->protocol < 2)
+    {
+      request_type = SOCKET_FUNCTION_DRAW;
+      if (wss->wstype >= 411 && wss->wstype <= 413)
+        {
+          send_socket(wss->s, &request_type, 1, 0);
+        }
+      send_socket(wss->s, (char *)&wss->dl.nbytes, sizeof(int), 0);
+      send_socket(wss->s, wss->dl.buffer, wss->dl.nbytes, 0);
+      return;
+    }
+
+  /* only send the part of the display list which has been added since the last update */
+  if (wss->sent > wss->dl.nbytes) wss->sent = 0;
+  header[0] = wss->sent;
+  header[1] = header[2] = wss->dl.nbytes - wss->sent;
+  header[3] = SOCKET_ENCODING_RAW;
+  payload = wss->dl.buffer + wss->sent;
+
+#ifdef HAVE_ZLIB
+  if (wss->compression > 0 && header[1] > 0)
+    {
+      uLong length = compressBound(header[1]);
+
+      /* use the zlib format of qCompress: uncompressed size (big endian) followed by the zlib stream */
+      buffer = gks_malloc(length + 4);
+      if (compress2((Bytef *)buffer + 4, &length, (Bytef *)payload, header[1], wss->compression) == Z_OK &&
+          (int)length + 4 < header[1])
+        {
+          buffer[0] = (char)((header[1] >> 24) & 0xff);
+          buffer[1] = (char)((header[1] >> 16) & 0xff);
+          buffer[2] = (char)((header[1] >> 8) & 0xff);
+          buffer[3] = (char)(header[1] & 0xff);
+          payload = buffer;
+          header[2] = (int)length + 4;
+          header[3] = SOCKET_ENCODING_ZLIB;
+        }
+    }
+#endif
+
+  request_type = SOCKET_FUNCTION_DRAW_DELTA;
+  if (send_socket(wss->s, &request_type, 1, 0) == 1 &&
+      send_socket(wss->s, (char *)header, sizeof(header), 0) == sizeof(header) &&
+      send_socket(wss->s, payload, header[2], 0) == header[2])
+    {
+      wss->sent = wss->dl.nbytes;
+    }
+  if (buffer != NULL) gks_free(buffer);
+}
+
 static void check_socket_connection(ws_state_list *wss)
 {
   if (wss->s != -1 && wss->wstype >= 411 && wss->wstype <= 413)
@@ -383,14 +524,8 @@ static void check_socket_connection(ws_state_list *wss)
       wss->s = open_socket(wss->wstype);
       if (wss->s != -1 && wss->wstype >= 411 && wss->wstype <= 413)
         {
-          /* workstation information was already read during OPEN_WS */
-          int nbytes;
-          if (read_socket(wss->s, (char *)&nbytes, sizeof(int), 0) == sizeof(int))
-            {
-              char *buf = gks_malloc(nbytes - (int)sizeof(int));
-              read_socket(wss->s, buf, nbytes - (int)sizeof(int), 0);
-              gks_free(buf);
-            }
+          /* workstation information was already read during OPEN_WS, but the protocol has to be negotiated again */
+          read_workstation_information(wss, NULL, NULL, NULL);
         }
     }
 }
@@ -423,28 +558,13 @@ void gks_drv_socket(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
       else
         {
           *ptr = wss;
+          wss->protocol = 1;
+          wss->compression = 0;
+          wss->sent = 0;
           if (wss->wstype >= 411 && wss->wstype <= 413)
             {
-              /* get workstation information */
-              int nbytes;
-              struct
-              {
-                int nbytes;
-                double mwidth;
-                double mheight;
-                int width;
-                int height;
-                char name[6];
-              } workstation_information = {sizeof(workstation_information), 0, 0, 0, 0, ""};
-              if (read_socket(wss->s, (char *)&nbytes, sizeof(int), 0) == sizeof(int) &&
-                  nbytes == workstation_information.nbytes)
-                {
-                  read_socket(wss->s, (char *)&workstation_information + sizeof(int), nbytes - (int)sizeof(int), 0);
-                  ia[0] = workstation_information.width;
-                  ia[1] = workstation_information.height;
-                  r1[0] = workstation_information.mwidth;
-                  r2[0] = workstation_information.mheight;
-                }
+              /* get workstation information and negotiate the protocol version */
+              read_workstation_information(wss, ia, r1, r2);
             }
           wss->aspect_ratio = 1.0;
           /*
@@ -470,17 +590,16 @@ void gks_drv_socket(int fctid, int dx, int dy, int dimx, int *ia, int lr1, doubl
       wss = NULL;
       break;
 
+    case 6:
+      /* the display list is rewritten from the start */
+      wss->sent = 0;
+      break;
+
     case 8:
       if (ia[1] & GKS_K_PERFORM_FLAG)
         {
           check_socket_connection(wss);
-          request_type = SOCKET_FUNCTION_DRAW;
-          if (wss->wstype >= 411 && wss->wstype <= 413)
-            {
-              send_socket(wss->s, &request_type, 1, 0);
-            }
-          send_socket(wss->s, (char *)&wss->dl.nbytes, sizeof(int), 0);
-          send_socket(wss->s, wss->dl.buffer, wss->dl.nbytes, 0);
+          send_display_list(wss);
         }
       break;
 
@@ -0,0 +1,173 @@
+/*
+   In-process subscriber for the shared memory transport of the ZeroMQ plugin.
+
+   Publishes pages of different sizes through a GKS_ZMQ_SHM ring buffer of
+   1 MiB so that the ring wraps in various ways and checks after every page
+   that each frame whose generation is still >= header->oldest has not been
+   touched since it was published. The zmqplugin is loaded from $GRDIR/lib
+   as usual.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zmq.h>
+
+#include "gks.h"
+
+#define SHM_MAGIC "GKSSHM1"
+#define SHM_ALIGN 64
+#define MAX_PAGES 64
+#define MAX_POINTS 65536
+
+typedef struct
+{
+  char magic[8];
+  unsigned long size;
+  volatile unsigned long generation;
+  volatile unsigned long oldest;
+} gks_shm_header_t;
+
+typedef struct
+{
+  char magic[8];
+  char name[32];
+  unsigned long offset;
+  unsigned long length;
+  unsigned long generation;
+} gks_shm_frame_t;
+
+static gks_shm_header_t *header = NULL;
+static const char *data;
+static size_t map_size;
+
+static gks_shm_frame_t frames[MAX_PAGES];
+static unsigned long checksums[MAX_PAGES];
+static int num_frames = 0;
+
+static double x[MAX_POINTS], y[MAX_POINTS];
+
+/* approximate page sizes in units of 1/20 of the ring: the first five pages wrap twice so that an older frame at
+   the end of the ring lies between the two frames being overwritten */
+static int sizes[] = {10, 4, 5, 12, 10, 3, 7, 19, 2, 2, 9, 6, 11, 1, 15, 4, 8, 8, 8, 13, 5, 5, 5, 5, 17, 3};
+
+static unsigned long checksum(const gks_shm_frame_t *frame)
+{
+  unsigned long i, sum = 0;
+
+  for (i = 0; i < frame->length; i++) sum = sum * 31 + (unsigned char)data[frame->offset + i];
+
+  return sum;
+}
+
+static int map_segment(const char *name)
+{
+  struct stat st;
+  int fd;
+  void *map;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return 0;
+  if (fstat(fd, &st) != 0 || (map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      close(fd);
+      return 0;
+    }
+  close(fd);
+
+  header = (gks_shm_header_t *)map;
+  data = (const char *)map + (sizeof(gks_shm_header_t) + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+  map_size = (size_t)st.st_size;
+
+  return 1;
+}
+
+static int receive(void *subscriber)
+{
+  gks_shm_frame_t frame;
+  int i, nbytes, errors = 0;
+
+  nbytes = zmq_recv(subscriber, &frame, sizeof(frame), 0);
+  if (nbytes != (int)sizeof(frame) || memcmp(frame.magic, SHM_MAGIC, sizeof(frame.magic)) != 0)
+    {
+      fprintf(stderr, "expected a shared memory frame descriptor\n");
+      return 1;
+    }
+  if (header == NULL && !map_segment(frame.name))
+    {
+      fprintf(stderr, "can't map shared memory segment %s\n", frame.name);
+      return 1;
+    }
+  if (frame.generation < header->oldest || frame.offset + frame.length > header->size)
+    {
+      fprintf(stderr, "frame %lu is invalid on arrival\n", frame.generation);
+      return 1;
+    }
+
+  frames[num_frames] = frame;
+  checksums[num_frames] = checksum(&frame);
+  num_frames++;
+
+  for (i = 0; i < num_frames; i++)
+    {
+      if (frames[i].generation >= header->oldest && checksum(frames + i) != checksums[i])
+        {
+          fprintf(stderr, "frame %lu was overwritten while generation %lu is still valid\n", frames[i].generation,
+                  header->oldest);
+          errors++;
+        }
+    }
+
+  return errors;
+}
+
+int main(void)
+{
+  void *context, *subscriber;
+  int page, i, n, errors = 0;
+
+  setenv("GKS_ZMQ_SHM", "1", 1);
+
+  gks_open_gks(6);
+  gks_open_ws(1, GKS_K_CONID_DEFAULT, 415);
+  gks_activate_ws(1);
+
+  context = zmq_ctx_new();
+  subscriber = zmq_socket(context, ZMQ_PULL);
+  zmq_connect(subscriber, "tcp://localhost:5556");
+
+  for (page = 0; page < (int)(sizeof(sizes) / sizeof(sizes[0])); page++)
+    {
+      /* a polyline item takes 16 bytes per point */
+      n = (int)((1L << 20) / 20 * sizes[page] / 16) - 64;
+      for (i = 0; i < n; i++)
+        {
+          x[i] = (double)i / n;
+          y[i] = (double)((page * 7919 + i * 104729) % 1000) / 1000;
+        }
+      gks_clear_ws(1, GKS_K_CLEAR_ALWAYS);
+      gks_polyline(n, x, y);
+      gks_update_ws(1, GKS_K_WRITE_PAGE_FLAG);
+
+      errors += receive(subscriber);
+    }
+
+  gks_deactivate_ws(1);
+  gks_close_ws(1);
+  gks_close_gks();
+
+  if (header != NULL) munmap(header, map_size);
+  zmq_close(subscriber);
+  zmq_ctx_destroy(context);
+
+  printf("%d frames, %d errors\n", num_frames, errors);
+
+  return errors != 0;
+}
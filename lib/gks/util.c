@@ -3,6 +3,10 @@
 #define _POSIX_C_SOURCE 200112L
 #endif
 
+#ifdef _MSC_VER
+#define NO_THREADS 1
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,6 +21,10 @@
 #include <io.h>
 #endif
 
+#ifndef NO_THREADS
+#include <pthread.h>
+#endif
+
 #ifdef __APPLE__
 #include <crt_externs.h>
 #endif
@@ -45,6 +53,10 @@
 #define M_PI 3.14159265358979323846
 #endif
 
+#ifndef GKS_UNUSED
+#define GKS_UNUSED(x) (void)(x)
+#endif
+
 #define LEFT (1 << 0)
 #define RIGHT (1 << 1)
 #define BOTTOM (1 << 2)
@@ -502,9 +514,9 @@ static const char *symbol2utf[256] = {
     "\xef\xa3\xbc", "\xef\xa3\xbd", "\xef\xa3\xbe", "\x3f",
 };
 
-static double rx = 0, ry = 0, seglen = 0;
+static GKS_THREAD_LOCAL double rx = 0, ry = 0, seglen = 0;
 
-static int newseg = 0, idash = 0, dtype = 0;
+static GKS_THREAD_LOCAL int newseg = 0, idash = 0, dtype = 0;
 
 static int dash_table[35][10] = {
     {8, 4, 2, 4, 2, 4, 2, 4, 6, 0},  {6, 4, 2, 4, 2, 4, 6, 0, 0, 0}, {4, 4, 2, 4, 6, 0, 0, 0, 0, 0},
@@ -520,7 +532,7 @@ static int dash_table[35][10] = {
     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0},  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, {2, 8, 5, 0, 0, 0, 0, 0, 0, 0},
     {2, 1, 2, 0, 0, 0, 0, 0, 0, 0},  {4, 8, 4, 1, 4, 0, 0, 0, 0, 0}};
 
-static int dash_list[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static GKS_THREAD_LOCAL int dash_list[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 static int roman[4] = {3, 12, 16, 11};
 
@@ -532,15 +544,15 @@ static double yfac[4] = {0, 0, 1, -1};
 
 static char Base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static double cxl, cxr, cyb, cyt;
+static GKS_THREAD_LOCAL double cxl, cxr, cyb, cyt;
 
-static double bx = 1, by = 0, ux = 0, uy = 1;
+static GKS_THREAD_LOCAL double bx = 1, by = 0, ux = 0, uy = 1;
 
-static double sin_f = 0, cos_f = 1;
+static GKS_THREAD_LOCAL double sin_f = 0, cos_f = 1;
 
-static double cur_wn[4], cur_vp[4];
+static GKS_THREAD_LOCAL double cur_wn[4], cur_vp[4];
 
-static gks_state_list_t *gkss = NULL;
+static GKS_THREAD_LOCAL gks_state_list_t *gkss = NULL;
 
 void gks_init_core(gks_state_list_t *list)
 {
@@ -1074,6 +1086,36 @@ void gks_emul_polyline(int n, double *px, double *py, int ltype, int tnr, void (
     }
 }
 
+static void emul_primitive_list(int n, double *px, double *py, int nc, int *codes, int minpoints, int *coli,
+                                void (*primitive)(int n, double *px, double *py))
+{
+  int i, j = 0, len, saved_coli = *coli;
+
+  /* codes holds (number of points, color index) pairs, a negative color index keeps the current color */
+  for (i = 0; i + 1 < nc; i += 2)
+    {
+      len = codes[i];
+      if (len < 0 || j + len > n) break;
+
+      *coli = codes[i + 1] >= 0 ? FIX_COLORIND(codes[i + 1]) : saved_coli;
+      if (len >= minpoints) primitive(len, px + j, py + j);
+      j += len;
+    }
+  *coli = saved_coli;
+}
+
+void gks_emul_polylines(int n, double *px, double *py, int nc, int *codes, int *plcoli,
+                        void (*polyline)(int n, double *px, double *py))
+{
+  emul_primitive_list(n, px, py, nc, codes, 2, plcoli, polyline);
+}
+
+void gks_emul_fillareas(int n, double *px, double *py, int nc, int *codes, int *facoli,
+                        void (*fillarea)(int n, double *px, double *py))
+{
+  emul_primitive_list(n, px, py, nc, codes, 3, facoli, fillarea);
+}
+
 void gks_emul_polymarker(int n, double *px, double *py, void (*marker)(double x, double y, int mtype))
 {
   int i;
@@ -2358,3 +2400,94 @@ char *gks_strdup(const char *str)
       return NULL;
     }
 }
+
+int gks_thread_count(const char *env, int max_threads)
+/*
+   Return the number of threads for a parallel operation: the value of the
+   environment variable env if it is set, otherwise the number of online
+   processors, limited to 1..max_threads. Without thread support the result
+   is always 1.
+ */
+{
+  int num_threads = 1;
+#ifndef NO_THREADS
+  const char *value = env != NULL ? gks_getenv(env) : NULL;
+
+  if (value != NULL)
+    {
+      num_threads = atoi(value);
+    }
+  else
+    {
+#ifdef _WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      num_threads = (int)info.dwNumberOfProcessors;
+#else
+      num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    }
+  if (num_threads > max_threads) num_threads = max_threads;
+#else
+  GKS_UNUSED(env);
+  GKS_UNUSED(max_threads);
+#endif
+  return num_threads < 1 ? 1 : num_threads;
+}
+
+#ifndef NO_THREADS
+
+typedef struct
+{
+  void (*func)(void *arg, int index);
+  void *arg;
+  int index, started;
+  pthread_t thread;
+} thread_job_t;
+
+static void *run_thread_job(void *arg)
+{
+  thread_job_t *job = (thread_job_t *)arg;
+
+  job->func(job->arg, job->index);
+  return NULL;
+}
+
+#endif
+
+void gks_run_threads(int num_threads, void (*func)(void *arg, int index), void *arg)
+/*
+   Call func(arg, index) for each index from 0 to num_threads - 1 and wait
+   for all calls to return. Index 0 runs on the calling thread, every other
+   index on a thread of its own, or on the calling thread as well if that
+   thread can't be started.
+ */
+{
+  int i;
+#ifndef NO_THREADS
+  thread_job_t *jobs;
+
+  if (num_threads > 1)
+    {
+      jobs = (thread_job_t *)gks_malloc(num_threads * sizeof(thread_job_t));
+      for (i = 1; i < num_threads; i++)
+        {
+          jobs[i].func = func;
+          jobs[i].arg = arg;
+          jobs[i].index = i;
+          jobs[i].started = pthread_create(&jobs[i].thread, NULL, run_thread_job, jobs + i) == 0;
+        }
+      func(arg, 0);
+      for (i = 1; i < num_threads; i++)
+        {
+          if (jobs[i].started)
+            pthread_join(jobs[i].thread, NULL);
+          else
+            func(arg, i);
+        }
+      gks_free(jobs);
+      return;
+    }
+#endif
+  for (i = 0; i < num_threads; i++) func(arg, i);
+}
@@ -10,14 +10,16 @@
 #include "gks.h"
 #include "gkscore.h"
 
-#define SEGM_SIZE 262144 /* 256K */
+#define SEGM_SIZE 4096 /* initial size of a segment buffer */
 
-#define COPY(s, n)                              \
-  memmove(p->buffer + p->nbytes, (void *)s, n); \
-  p->nbytes += n
-#define PAD(n)                         \
-  memset(p->buffer + p->nbytes, 0, n); \
-  p->nbytes += n
+#define HASH_SIZE 1024 /* number of hash buckets, must be a power of two */
+
+#define COPY(s, n)                                  \
+  memmove(seg->buffer + seg->nbytes, (void *)s, n); \
+  seg->nbytes += n
+#define PAD(n)                             \
+  memset(seg->buffer + seg->nbytes, 0, n); \
+  seg->nbytes += n
 
 #define RESOLVE(arg, type, nbytes) \
   arg = (type *)(s + sp);          \
@@ -27,51 +29,117 @@
 #define GKS_UNUSED(x) (void)(x)
 #endif
 
+typedef struct segment_struct
+{
+  int segn;
+  char *buffer;
+  int size, nbytes;
+  struct segment_struct *next;        /* next segment in the same hash bucket */
+  struct segment_struct *prev, *succ; /* neighbours in order of creation */
+} segment_t;
+
 typedef struct ws_state_list_struct
 {
   int conid, state;
   int segn;
   int empty;
-  char *buffer;
-  int size, nbytes;
+  segment_t *table[HASH_SIZE];
+  segment_t *first, *last;
+  segment_t *free_list, *current;
 } ws_state_list;
 
-static ws_state_list *p;
-static gks_state_list_t *gkss;
+static GKS_THREAD_LOCAL ws_state_list *p;
 static int wkid = 1;
 static int unused_variable = 0;
 
-static void reallocate(int len)
+static void reallocate(segment_t *seg, int len)
+/*
+   Grow a segment buffer geometrically, so that recording n bytes into
+   one segment costs O(n) copying in total.
+ */
 {
-  while (p->nbytes + len > p->size) p->size += SEGM_SIZE;
+  int size = seg->size > 0 ? seg->size : SEGM_SIZE;
 
-  p->buffer = (char *)gks_realloc(p->buffer, p->size + 1);
-  if (p->buffer == NULL)
+  while (seg->nbytes + len > size) size *= 2;
+
+  seg->size = size;
+  seg->buffer = (char *)gks_realloc(seg->buffer, seg->size);
+  if (seg->buffer == NULL)
     {
       gks_perror("memory allocation failed");
       exit(1);
     }
 }
 
-#if 0
+static segment_t **bucket(int segn)
+{
+  return &p->table[(unsigned int)segn & (HASH_SIZE - 1)];
+}
 
-static
-int cksum(void)
+static segment_t *find_seg(int segn)
 {
-  int i, crc = 0;
+  segment_t *seg;
+
+  for (seg = *bucket(segn); seg != NULL; seg = seg->next)
+    if (seg->segn == segn) return seg;
 
-  for (i = 0; i < p->nbytes; i++)
+  return NULL;
+}
+
+static segment_t *get_seg(int segn)
+/*
+   Return the storage of the given segment, creating it if necessary.
+   Storage of deleted segments is recycled from the free list.
+ */
+{
+  segment_t *seg, **head;
+
+  if ((seg = find_seg(segn)) != NULL) return seg;
+
+  if (p->free_list != NULL)
     {
-      if (crc & 1)
-        crc |= 0x10000;
-      crc = ((crc >> 1) + p->buffer[i]) & 0xffff;
+      seg = p->free_list;
+      p->free_list = seg->next;
     }
-  return crc;
+  else
+    seg = (segment_t *)gks_malloc(sizeof(segment_t));
+
+  seg->segn = segn;
+  seg->nbytes = 0;
+
+  head = bucket(segn);
+  seg->next = *head;
+  *head = seg;
+
+  seg->prev = p->last;
+  seg->succ = NULL;
+  if (p->last != NULL)
+    p->last->succ = seg;
+  else
+    p->first = seg;
+  p->last = seg;
+
+  return seg;
 }
 
-#endif
+static void release_seg(segment_t *seg)
+{
+  if (seg->prev != NULL)
+    seg->prev->succ = seg->succ;
+  else
+    p->first = seg->succ;
+  if (seg->succ != NULL)
+    seg->succ->prev = seg->prev;
+  else
+    p->last = seg->prev;
+
+  if (p->current == seg) p->current = NULL;
+
+  seg->next = p->free_list;
+  p->free_list = seg;
+}
 
-static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1, double *f_arr_1,
+static void write_item(segment_t *seg, int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1, double *f_arr_1,
                        int len_farr_2, double *f_arr_2, int len_c_arr, char *c_arr)
 {
   char s[GKS_K_TEXT_MAX_SIZE];
@@ -87,10 +155,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 15: /* fill area */
 
       len = 4 * sizeof(int) + 2 * i_arr[0] * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, sizeof(int));
       COPY(f_arr_1, i_arr[0] * sizeof(double));
@@ -100,14 +168,14 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 14: /* text */
 
       len = 4 * sizeof(int) + 2 * sizeof(double) + GKS_K_TEXT_MAX_SIZE;
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       memset((void *)s, 0, GKS_K_TEXT_MAX_SIZE);
       slen = strlen(c_arr);
       memcpy(s, c_arr, slen < GKS_K_TEXT_MAX_SIZE ? slen : GKS_K_TEXT_MAX_SIZE);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, sizeof(double));
       COPY(f_arr_2, sizeof(double));
@@ -119,10 +187,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 201: /* draw image */
 
       len = (6 + dimx * dy) * sizeof(int) + 4 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, 2 * sizeof(double));
       COPY(f_arr_2, 2 * sizeof(double));
@@ -136,10 +204,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
 
     case 17: /* GDP */
       len = (3 + 3 + i_arr[2]) * sizeof(int) + 2 * i_arr[0] * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, (3 + i_arr[2]) * sizeof(int));
       COPY(f_arr_1, i_arr[0] * sizeof(double));
@@ -163,10 +231,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 208: /* select clipping transformation */
 
       len = 4 * sizeof(int);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, sizeof(int));
       break;
@@ -175,10 +243,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 34: /* set text alignment */
 
       len = 5 * sizeof(int);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, 2 * sizeof(int));
       break;
@@ -193,10 +261,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 206: /* set border width */
 
       len = 3 * sizeof(int) + sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, sizeof(double));
       break;
@@ -204,10 +272,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 32: /* set character up vector */
 
       len = 3 * sizeof(int) + 2 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, sizeof(double));
       COPY(f_arr_2, sizeof(double));
@@ -216,10 +284,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 41: /* set aspect source flags */
 
       len = 3 * sizeof(int) + 13 * sizeof(int);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, 13 * sizeof(int));
       break;
@@ -227,10 +295,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 48: /* set color representation */
 
       len = 4 * sizeof(int) + 3 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(&i_arr[1], sizeof(int));
       COPY(f_arr_1, 3 * sizeof(double));
@@ -242,10 +310,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 55: /* set workstation viewport */
 
       len = 4 * sizeof(int) + 4 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(i_arr, sizeof(int));
       COPY(f_arr_1, 2 * sizeof(double));
@@ -255,10 +323,10 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 202: /* set shadow */
 
       len = 3 * sizeof(int) + 3 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, 3 * sizeof(double));
       break;
@@ -266,47 +334,55 @@ static void write_item(int sgnum, int fctid, int dx, int dy, int dimx, int *i_ar
     case 204: /* set coord xform */
 
       len = 3 * sizeof(int) + 6 * sizeof(double);
-      if (p->nbytes + len > p->size) reallocate(len);
+      if (seg->nbytes + len > seg->size) reallocate(seg, len);
 
       COPY(&len, sizeof(int));
-      COPY(&sgnum, sizeof(int));
+      COPY(&seg->segn, sizeof(int));
       COPY(&fctid, sizeof(int));
       COPY(f_arr_1, 6 * sizeof(double));
       break;
     }
 }
 
-static void delete_seg(char *str, int segn)
+static void delete_seg(int segn)
 {
-  char *s, *d;
-  int sp = 0, *len, *sgnum, dp = 0, saved_sp;
-
-  s = d = str;
+  segment_t *seg, **link;
+
+  for (link = bucket(segn); (seg = *link) != NULL; link = &seg->next)
+    if (seg->segn == segn)
+      {
+        *link = seg->next;
+        release_seg(seg);
+        break;
+      }
+}
 
-  saved_sp = sp;
-  RESOLVE(len, int, sizeof(int));
+static void clear_segs(void)
+{
+  segment_t *seg, *succ;
 
-  while (*len)
+  for (seg = p->first; seg != NULL; seg = succ)
     {
-      RESOLVE(sgnum, int, sizeof(int));
-      sp = saved_sp;
-
-      if (*sgnum != 0 && segn != *sgnum)
-        {
-          if (sp > dp) memmove(d + dp, s + sp, *len);
-          dp += *len;
-        }
-      sp += *len;
-
-      saved_sp = sp;
-      RESOLVE(len, int, sizeof(int));
+      succ = seg->succ;
+      seg->next = p->free_list;
+      p->free_list = seg;
     }
+  memset(p->table, 0, sizeof(p->table));
+  p->first = p->last = p->current = NULL;
+}
+
+static void free_segs(void)
+{
+  segment_t *seg, *next;
 
-  if (sp > dp)
+  clear_segs();
+  for (seg = p->free_list; seg != NULL; seg = next)
     {
-      memset(d + dp, 0, sp - dp);
-      p->nbytes = dp;
+      next = seg->next;
+      free(seg->buffer);
+      free(seg);
     }
+  p->free_list = NULL;
 }
 
 void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_1, double *f_arr_1, int len_farr_2,
@@ -318,8 +394,6 @@ void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_
     {
     case 2: /* open workstation */
 
-      gkss = (gks_state_list_t *)*ptr;
-
       p = (ws_state_list *)gks_malloc(sizeof(ws_state_list));
 
       p->conid = i_arr[1];
@@ -327,16 +401,12 @@ void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_
       p->segn = 0;
       p->empty = 1;
 
-      p->buffer = (char *)gks_malloc(SEGM_SIZE);
-      p->size = SEGM_SIZE;
-      p->nbytes = 0;
-
       *ptr = p;
       break;
 
     case 3: /* close workstation */
 
-      free(p->buffer);
+      free_segs();
       free(p);
 
       p = NULL;
@@ -354,9 +424,8 @@ void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_
 
     case 6: /* clear workstation */
 
-      p->nbytes = 0;
+      clear_segs();
       p->empty = 1;
-      memset(p->buffer, 0, p->size);
       break;
 
     case 8: /* update workstation */
@@ -411,19 +480,9 @@ void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_
         {
           if (p->segn != 0)
             {
-              int len = 3 * sizeof(int) + sizeof(gks_state_list_t);
-
-              if (p->nbytes == 0)
-                {
-                  int fctid = 2, sgnum = 0;
+              if (p->current == NULL) p->current = get_seg(p->segn);
 
-                  COPY(&len, sizeof(int));
-                  COPY(&sgnum, sizeof(int));
-                  COPY(&fctid, sizeof(int));
-                  COPY(gkss, sizeof(gks_state_list_t));
-                }
-
-              write_item(p->segn, fctid, dx, dy, dimx, i_arr, len_farr_1, f_arr_1, len_farr_2, f_arr_2, len_c_arr,
+              write_item(p->current, fctid, dx, dy, dimx, i_arr, len_farr_1, f_arr_1, len_farr_2, f_arr_2, len_c_arr,
                          c_arr);
             }
         }
@@ -432,24 +491,25 @@ void gks_drv_wiss(int fctid, int dx, int dy, int dimx, int *i_arr, int len_farr_
     case 56: /* create segment */
 
       p->segn = i_arr[0];
+      p->current = get_seg(p->segn);
       break;
 
     case 57: /* close segment */
 
       p->segn = 0;
+      p->current = NULL;
       break;
 
     case 58: /* delete segment */
 
-      delete_seg(p->buffer, i_arr[0]);
+      delete_seg(i_arr[0]);
       break;
     }
 }
 
-static void interp(char *str, int segn)
+static void interp(segment_t *seg)
 {
   char *s;
-  gks_state_list_t *gkss = NULL;
   int sp = 0, *len, *sgnum, *fctid, sx = 1, sy = 1;
   int *i_arr = NULL, *dx = NULL, *dy = NULL, *dimx = NULL, *len_c_arr = NULL;
   int *n = NULL, *primid = NULL, *ldr = NULL;
@@ -458,24 +518,17 @@ static void interp(char *str, int segn)
   int saved_sp;
   double mat[3][2];
 
-  s = str;
-
-  saved_sp = sp;
-  RESOLVE(len, int, sizeof(int));
+  s = seg->buffer;
 
-  while (*len)
+  while (sp < seg->nbytes)
     {
+      saved_sp = sp;
+      RESOLVE(len, int, sizeof(int));
       RESOLVE(sgnum, int, sizeof(int));
       RESOLVE(fctid, int, sizeof(int));
 
       switch (*fctid)
         {
-        case 2:
-
-          RESOLVE(gkss, gks_state_list_t, sizeof(gks_state_list_t));
-          unused_variable = gkss->ltype;
-          break;
-
         case 12: /* polyline */
         case 13: /* polymarker */
         case 15: /* fill area */
@@ -598,7 +651,7 @@ static void interp(char *str, int segn)
           exit(1);
         }
 
-      if (segn == 0 || *sgnum == segn)
+      if (*sgnum == seg->segn)
         {
           switch (*fctid)
             {
@@ -738,15 +791,29 @@ static void interp(char *str, int segn)
               break;
             }
         }
-
-      saved_sp = sp;
-      RESOLVE(len, int, sizeof(int));
     }
 }
 
 void gks_wiss_dispatch(int fctid, int wkid, int segn)
+/*
+   Replay the given segment or, if segn is zero, all segments in the
+   order of their creation.
+ */
 {
+  segment_t *seg, *succ;
   GKS_UNUSED(fctid);
   GKS_UNUSED(wkid);
-  interp(p->buffer, segn);
+
+  if (segn != 0)
+    {
+      if ((seg = find_seg(segn)) != NULL) interp(seg);
+    }
+  else
+    {
+      for (seg = p->first; seg != NULL; seg = succ)
+        {
+          succ = seg->succ;
+          interp(seg);
+        }
+    }
 }
@@ -69,6 +69,7 @@ typedef __int64 int64_t;
 #include "cm.h"
 #include "boundary.h"
 #include "threadpool.h"
+#include "shade.h"
 
 #ifndef R_OK
 #define R_OK 4
@@ -205,6 +206,14 @@ typedef struct
   int approximative_calculation;
 } volume_t;
 
+typedef struct
+{
+  int w, h, *bins;
+  double roi[4];
+  int pending;
+  double x, y;
+} shade_t;
+
 typedef struct
 {
   char *name;
@@ -246,6 +255,8 @@ tri_linear_t interp_tri_linear_data = {1, 1, 1};
 
 static volume_t vt = {1, 0, 1.25, 1000, 1000, NULL, 1};
 
+static shade_t sh = {0, 0, NULL, {0, 1, 0, 1}, 0, 0, 0};
+
 static norm_xform nx = {1, 0, 1, 0};
 
 static linear_xform lx = {0, 0, 1, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 10, 10, 10, "10", "10", "10"};
@@ -286,7 +297,7 @@ static int arrow_style = 0;
 
 static double arrow_size = 1;
 
-static int flag_printing = 0, flag_stream = 0, flag_graphics = 0;
+static int flag_printing = 0, flag_stream = 0, flag_graphics = 0, flag_base64 = 0;
 
 static text_node_t *text, *head;
 
@@ -326,6 +337,7 @@ static unsigned int rgb[MAX_COLOR], used[MAX_COLOR];
 #define WC 1
 
 #define POINT_INC 2048
+#define NAN_BLOCK 4096
 
 /* Path definitions */
 #define STOP 0
@@ -1026,6 +1038,70 @@ static double y_lin(double y)
   return (result);
 }
 
+static double *lin_array(int n, double *v, double *buf, int log_scale, int flip, double a, double b, double base,
+                         double vmin, double vmax, int *nan_found)
+{
+  double scale;
+  int i, found = 0;
+
+  /* the scale options are tested once, so that each loop can be vectorized */
+  if (log_scale)
+    {
+      scale = 1.0 / log(base);
+      if (flip)
+        for (i = 0; i < n; i++)
+          {
+            buf[i] = vmax - (v[i] > 0 ? a * (log(v[i]) * scale) + b : NAN) + vmin;
+            found |= is_nan(buf[i]);
+          }
+      else
+        for (i = 0; i < n; i++)
+          {
+            buf[i] = v[i] > 0 ? a * (log(v[i]) * scale) + b : NAN;
+            found |= is_nan(buf[i]);
+          }
+    }
+  else if (flip)
+    {
+      for (i = 0; i < n; i++)
+        {
+          buf[i] = vmax - v[i] + vmin;
+          found |= is_nan(buf[i]);
+        }
+    }
+  else
+    return v;
+
+  *nan_found |= found;
+  return buf;
+}
+
+static int has_nan(int n, double *x, double *y)
+{
+  int i, j, found = 0;
+
+  /* scan in blocks, so that the search can stop early */
+  for (i = 0; i < n && !found; i += NAN_BLOCK)
+    for (j = i; j < min(n, i + NAN_BLOCK); j++) found |= is_nan(x[j]) | is_nan(y[j]);
+
+  return found;
+}
+
+static int xy_lin(int n, double *x, double *y, double **xres, double **yres)
+{
+  int nan_found = 0;
+
+  *xres = lin_array(n, x, xpoint, OPTION_X_LOG & lx.scale_options, OPTION_FLIP_X & lx.scale_options, lx.a, lx.b,
+                    lx.basex, lx.xmin, lx.xmax, &nan_found);
+  *yres = lin_array(n, y, ypoint, OPTION_Y_LOG & lx.scale_options, OPTION_FLIP_Y & lx.scale_options, lx.c, lx.d,
+                    lx.basey, lx.ymin, lx.ymax, &nan_found);
+
+  /* untransformed coordinates have not been checked yet */
+  if (!nan_found && (*xres == x || *yres == y)) nan_found = has_nan(n, *xres, *yres);
+
+  return nan_found;
+}
+
 static double z_lin(double z)
 {
   double result;
@@ -1415,6 +1491,7 @@ static void initialize(int state)
 
   debug = gks_getenv("GR_DEBUG");
   flag_stream = flag_graphics || debug != NULL;
+  flag_base64 = gks_getenv("GR_STREAM_ENCODING") != NULL && strcmp(gks_getenv("GR_STREAM_ENCODING"), "base64") == 0;
 
   setscale(options);
 }
@@ -1753,13 +1830,7 @@ static void fillarea(int n, double *x, double *y)
     {
       if (npoints >= maxpath) reallocate(npoints);
 
-      px = xpoint;
-      py = ypoint;
-      for (i = 0; i < npoints; i++)
-        {
-          px[i] = x_lin(x[i]);
-          py[i] = y_lin(y[i]);
-        }
+      xy_lin(npoints, x, y, &px, &py);
     }
 
   gks_inq_fill_int_style(&errind, &style);
@@ -1780,10 +1851,63 @@ static void fillarea(int n, double *x, double *y)
     }
 }
 
+/*
+ * With GR_STREAM_ENCODING=base64 arrays are written as
+ *
+ *   name="base64:<type><count>:<data>"
+ *
+ * where type is d (double), i (32-bit int), b (byte) or v (pair of doubles)
+ * and data holds the values in little-endian byte order. This is lossless
+ * and much faster than formatting every value.
+ */
+
+static void print_base64(char *name, char type, int n, void *data, int width, int nbytes)
+{
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  unsigned char chunk[3 * 1024], *src = (unsigned char *)data, t;
+  char out[4 * 1024];
+  int i, j, len, m, little_endian = 1;
+
+  little_endian = *(char *)&little_endian;
+
+  gr_writestream(" %s=\"base64:%c%d:", name, type, n);
+  while (nbytes > 0)
+    {
+      len = min(nbytes, (int)sizeof(chunk));
+      memcpy(chunk, src, len);
+      if (!little_endian)
+        for (i = 0; i + width <= len; i += width)
+          for (j = 0; j < width / 2; j++)
+            {
+              t = chunk[i + j];
+              chunk[i + j] = chunk[i + width - 1 - j];
+              chunk[i + width - 1 - j] = t;
+            }
+      m = 0;
+      for (i = 0; i < len; i += 3)
+        {
+          out[m++] = digits[chunk[i] >> 2];
+          out[m++] = digits[((chunk[i] & 0x03) << 4) | (i + 1 < len ? chunk[i + 1] >> 4 : 0)];
+          out[m++] = i + 1 < len ? digits[((chunk[i + 1] & 0x0f) << 2) | (i + 2 < len ? chunk[i + 2] >> 6 : 0)] : '=';
+          out[m++] = i + 2 < len ? digits[chunk[i + 2] & 0x3f] : '=';
+        }
+      gr_writestreamdata(out, m);
+      src += len;
+      nbytes -= len;
+    }
+  gr_writestream("\"");
+}
+
 static void print_int_array(char *name, int n, int *data)
 {
   int i;
 
+  if (flag_base64)
+    {
+      print_base64(name, 'i', n, data, sizeof(int), n * sizeof(int));
+      return;
+    }
+
   gr_writestream(" %s=\"", name);
   for (i = 0; i < n; i++)
     {
@@ -1797,6 +1921,12 @@ static void print_float_array(char *name, int n, double *data)
 {
   int i;
 
+  if (flag_base64)
+    {
+      print_base64(name, 'd', n, data, sizeof(double), n * sizeof(double));
+      return;
+    }
+
   gr_writestream(" %s=\"", name);
   for (i = 0; i < n; i++)
     {
@@ -1810,6 +1940,12 @@ static void print_vertex_array(char *name, int n, vertex_t *vertices)
 {
   int i;
 
+  if (flag_base64)
+    {
+      print_base64(name, 'v', n, vertices, sizeof(double), n * sizeof(vertex_t));
+      return;
+    }
+
   gr_writestream(" %s=\"", name);
   for (i = 0; i < n; i++)
     {
@@ -1823,6 +1959,12 @@ static void print_byte_array(char *name, int n, unsigned char *data)
 {
   int i;
 
+  if (flag_base64)
+    {
+      print_base64(name, 'b', n, data, 1, n);
+      return;
+    }
+
   gr_writestream(" %s=\"", name);
   for (i = 0; i < n; i++)
     {
@@ -1842,26 +1984,49 @@ static void primitive(char *name, int n, double *x, double *y)
 
 static void polyline(int n, double *x, double *y)
 {
-  int i, npoints;
+  int i, npoints, nlines;
+  double *px, *py;
 
   if (n >= maxpath) reallocate(n);
 
-  npoints = 0;
+  if (!xy_lin(n, x, y, &px, &py))
+    {
+      if (n != 0) gks_polyline(n, px, py);
+      return;
+    }
+
+  /* NaN separated segments are collected in xpoint/ypoint with their start
+     offsets in code, so that they can be passed to GKS in a single call */
+  npoints = nlines = 0;
+  code[0] = 0;
   for (i = 0; i < n; i++)
     {
-      xpoint[npoints] = x_lin(x[i]);
-      ypoint[npoints] = y_lin(y[i]);
+      xpoint[npoints] = px[i];
+      ypoint[npoints] = py[i];
       if (is_nan(xpoint[npoints]) || is_nan(ypoint[npoints]))
         {
-          if (npoints >= 2) gks_polyline(npoints, xpoint, ypoint);
-
-          npoints = 0;
+          if (npoints - code[nlines] >= 2)
+            code[++nlines] = npoints;
+          else
+            npoints = code[nlines];
         }
       else
         npoints++;
     }
 
-  if (npoints != 0) gks_polyline(npoints, xpoint, ypoint);
+  if (nlines == 0)
+    {
+      if (npoints != 0) gks_polyline(npoints, xpoint, ypoint);
+    }
+  else
+    {
+      if (npoints - code[nlines] >= 2) code[++nlines] = npoints;
+
+      if (nlines == 1)
+        gks_polyline(code[1], xpoint, ypoint);
+      else
+        gks_polyline_list(nlines, code, xpoint, ypoint, NULL);
+    }
 }
 
 /*!
@@ -1888,14 +2053,21 @@ void gr_polyline(int n, double *x, double *y)
 static void polymarker(int n, double *x, double *y)
 {
   int i, npoints;
+  double *px, *py;
 
   if (n >= maxpath) reallocate(n);
 
+  if (!xy_lin(n, x, y, &px, &py))
+    {
+      if (n != 0) gks_polymarker(n, px, py);
+      return;
+    }
+
   npoints = 0;
   for (i = 0; i < n; i++)
     {
-      xpoint[npoints] = x_lin(x[i]);
-      ypoint[npoints] = y_lin(y[i]);
+      xpoint[npoints] = px[i];
+      ypoint[npoints] = py[i];
       if (is_nan(xpoint[npoints]) || is_nan(ypoint[npoints]))
         {
           if (npoints >= 1) gks_polymarker(npoints, xpoint, ypoint);
@@ -2663,7 +2835,6 @@ void gr_gdp(int n, double *x, double *y, int primid, int ldr, int *datrec)
 {
   int npoints = n;
   double *px = x, *py = y;
-  int i;
 
   check_autoinit;
 
@@ -2671,13 +2842,7 @@ void gr_gdp(int n, double *x, double *y, int primid, int ldr, int *datrec)
     {
       if (npoints >= maxpath) reallocate(npoints);
 
-      px = xpoint;
-      py = ypoint;
-      for (i = 0; i < npoints; i++)
-        {
-          px[i] = x_lin(x[i]);
-          py[i] = y_lin(y[i]);
-        }
+      xy_lin(npoints, x, y, &px, &py);
     }
 
   gks_gdp(npoints, px, py, primid, ldr, datrec);
@@ -12083,39 +12248,258 @@ void gr_reducepoints(int n, const double *x, const double *y, int points, double
     }
 }
 
+#define LOD_BLOCK 16
+#define LOD_MAX_LEVELS 32
+
+struct gr_lod
+{
+  int n;
+  const double *x, *y;
+  int num_levels;
+  int num_blocks[LOD_MAX_LEVELS];
+  int *min_index[LOD_MAX_LEVELS], *max_index[LOD_MAX_LEVELS];
+};
+
+static void lod_merge(const double *y, int *imin, int *imax, int jmin, int jmax)
+{
+  if (*imin < 0 || y[jmin] < y[*imin] || is_nan(y[*imin])) *imin = jmin;
+  if (*imax < 0 || y[jmax] > y[*imax] || is_nan(y[*imax])) *imax = jmax;
+}
+
 /*!
- * Display a point set as a aggregated and rasterized image.
+ * Create a multi-resolution min/max index for a (long) series of points.
  *
  * \param[in] n The number of points
- * \param[in] x A pointer to the X coordinates
+ * \param[in] x A pointer to the X coordinates, which must be in ascending order
  * \param[in] y A pointer to the Y coordinates
- * \param[in] xform The transformation type used for color mapping
- * \param[in] w The width of the grid used for rasterization
- * \param[in] h The height of the grid used for rasterization
- *
- * The values for `x` and `y` are in world coordinates.
- *
- * \verbatim embed:rst:leading-asterisk
+ * \return the index, which must be released with `gr_destroylod`
  *
- * The available transformation types are:
+ * Each level of the index holds the positions of the minimum and maximum Y values of blocks of 16, 32, 64, ...
+ * points, which takes about one byte per point. The data itself is not copied, so `x` and `y` (which may point
+ * into a memory mapped file) have to stay valid as long as the index is used.
+ */
+gr_lod_t *gr_createlod(int n, const double *x, const double *y)
+{
+  gr_lod_t *lod;
+  int level, i, num_blocks, *imin, *imax;
+
+  lod = (gr_lod_t *)xcalloc(1, sizeof(gr_lod_t));
+  lod->n = n;
+  lod->x = x;
+  lod->y = y;
+
+  num_blocks = n / LOD_BLOCK;
+  for (level = 0; level < LOD_MAX_LEVELS && num_blocks > 0; level++)
+    {
+      imin = (int *)xmalloc(num_blocks * sizeof(int));
+      imax = (int *)xmalloc(num_blocks * sizeof(int));
+      for (i = 0; i < num_blocks; i++)
+        {
+          imin[i] = imax[i] = -1;
+          if (level == 0)
+            {
+              int j;
+              for (j = i * LOD_BLOCK; j < (i + 1) * LOD_BLOCK; j++) lod_merge(y, imin + i, imax + i, j, j);
+            }
+          else
+            {
+              lod_merge(y, imin + i, imax + i, lod->min_index[level - 1][2 * i], lod->max_index[level - 1][2 * i]);
+              lod_merge(y, imin + i, imax + i, lod->min_index[level - 1][2 * i + 1],
+                        lod->max_index[level - 1][2 * i + 1]);
+            }
+        }
+      lod->num_blocks[level] = num_blocks;
+      lod->min_index[level] = imin;
+      lod->max_index[level] = imax;
+      num_blocks /= 2;
+    }
+  lod->num_levels = level;
+
+  return lod;
+}
+
+/*!
+ * Release a min/max index created with `gr_createlod`.
+ */
+void gr_destroylod(gr_lod_t *lod)
+{
+  int level;
+
+  if (lod == NULL) return;
+
+  for (level = 0; level < lod->num_levels; level++)
+    {
+      free(lod->min_index[level]);
+      free(lod->max_index[level]);
+    }
+  free(lod);
+}
+
+static void lod_range(gr_lod_t *lod, int start, int end, int *imin, int *imax)
+{
+  int i = start, level, size;
+
+  *imin = *imax = -1;
+  while (i < end)
+    {
+      if (i % LOD_BLOCK != 0 || i + LOD_BLOCK > end)
+        {
+          lod_merge(lod->y, imin, imax, i, i);
+          i++;
+          continue;
+        }
+      /* take the largest block that is aligned at i and ends within the range */
+      level = 0;
+      size = LOD_BLOCK;
+      while (level + 1 < lod->num_levels && i % (2 * size) == 0 && i + 2 * size <= end)
+        {
+          level++;
+          size *= 2;
+        }
+      lod_merge(lod->y, imin, imax, lod->min_index[level][i / size], lod->max_index[level][i / size]);
+      i += size;
+    }
+}
+
+static int lod_search(gr_lod_t *lod, double value, int upper)
+{
+  int low = 0, high = lod->n;
+
+  /* index of the first point with x >= value (or x > value for the upper bound) */
+  while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      if (lod->x[mid] < value || (upper && lod->x[mid] == value))
+        low = mid + 1;
+      else
+        high = mid;
+    }
+  return low;
+}
+
+/*!
+ * Reduce the points of a min/max index within an X range.
+ *
+ * \param[in] lod The index created with `gr_createlod`
+ * \param[in] xmin The lower bound of the X range
+ * \param[in] xmax The upper bound of the X range
+ * \param[in] points The maximum number of points to return (at least 2)
+ * \param[out] x_array The return array for the x values
+ * \param[out] y_array The return array for the y values
+ * \return the number of points stored in `x_array` and `y_array`
+ *
+ * The range is extended by one point on each side, so that a polyline drawn from the result reaches its
+ * borders. If it holds no more than `points` points, they are copied unchanged. Otherwise it is split into
+ * `points` / 2 intervals like in `gr_reducepoints` and the minimum and maximum of each interval are returned in
+ * the order of the original data. The cost depends on the number of requested points, not on the size of the
+ * range.
+ */
+int gr_reducelod(gr_lod_t *lod, double xmin, double xmax, int points, double *x_array, double *y_array)
+{
+  int start, end, count, num_intervals, interval, lo, hi, imin, imax, num_points = 0;
+
+  if (points < 2)
+    {
+      fprintf(stderr, "invalid number of points\n");
+      return 0;
+    }
+
+  start = lod_search(lod, xmin, 0);
+  if (start > 0) start--;
+  end = lod_search(lod, xmax, 1);
+  if (end < lod->n) end++;
+
+  count = end - start;
+  if (count <= points)
+    {
+      if (count > 0)
+        {
+          memcpy(x_array, lod->x + start, sizeof(double) * count);
+          memcpy(y_array, lod->y + start, sizeof(double) * count);
+        }
+      return max(count, 0);
+    }
+
+  num_intervals = points / 2;
+  for (interval = 0; interval < num_intervals; interval++)
+    {
+      lo = start + (int)((double)count * interval / num_intervals);
+      hi = start + (int)((double)count * (interval + 1) / num_intervals);
+      lod_range(lod, lo, hi, &imin, &imax);
+      if (imax < imin)
+        {
+          int tmp = imin;
+          imin = imax;
+          imax = tmp;
+        }
+      x_array[num_points] = lod->x[imin];
+      y_array[num_points] = lod->y[imin];
+      num_points++;
+      if (imax != imin)
+        {
+          x_array[num_points] = lod->x[imax];
+          y_array[num_points] = lod->y[imax];
+          num_points++;
+        }
+    }
+  return num_points;
+}
+
+/*!
+ * Draw the visible part of a min/max index as a polyline.
  *
- * +----------------+---+--------------------+
- * |XFORM_BOOLEAN   |  0|boolean             |
- * +----------------+---+--------------------+
- * |XFORM_LINEAR    |  1|linear              |
- * +----------------+---+--------------------+
- * |XFORM_LOG       |  2|logarithmic         |
- * +----------------+---+--------------------+
- * |XFORM_LOGLOG    |  3|double logarithmic  |
- * +----------------+---+--------------------+
- * |XFORM_CUBIC     |  4|cubic               |
- * +----------------+---+--------------------+
- * |XFORM_EQUALIZED |  5|histogram equalized |
- * +----------------+---+--------------------+
+ * \param[in] lod The index created with `gr_createlod`
  *
- * \endverbatim
+ * The points within the current window are reduced to two points per device pixel of the current viewport before
+ * they are drawn, so panning and zooming through very long time series stays fast.
  */
-void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
+void gr_polylinelod(gr_lod_t *lod)
+{
+  int errind, tnr, ol, wkid, conid, wtype, dcunit, width = 0, height = 0, points, n;
+  double wn[4], vp[4], mwidth, mheight, *x, *y;
+
+  check_autoinit;
+
+  gks_inq_current_xformno(&errind, &tnr);
+  gks_inq_xform(tnr, &errind, wn, vp);
+  gks_inq_open_ws(1, &errind, &ol, &wkid);
+  if (errind == GKS_K_NO_ERROR && ol > 0)
+    {
+      gks_inq_ws_conntype(wkid, &errind, &conid, &wtype);
+      if (errind == GKS_K_NO_ERROR)
+        gks_inq_max_ds_size(wtype, &errind, &dcunit, &mwidth, &mheight, &width, &height);
+    }
+  if (errind != GKS_K_NO_ERROR || width <= 0) width = height = 2000;
+
+  points = 2 * max(100, (int)((vp[1] - vp[0]) * max(width, height)));
+
+  x = (double *)xmalloc(points * sizeof(double));
+  y = (double *)xmalloc(points * sizeof(double));
+
+  n = gr_reducelod(lod, lx.xmin, lx.xmax, points, x, y);
+  if (n > 1)
+    {
+      polyline(n, x, y);
+
+      if (flag_stream) primitive("polyline", n, x, y);
+    }
+
+  free(y);
+  free(x);
+}
+
+static int system_processor_count();
+
+static int shade_threads(void)
+{
+#ifndef NO_THREADS
+  return vt.max_threads > 0 ? vt.max_threads : system_processor_count();
+#else
+  return 1;
+#endif
+}
+
+static int shade_cellarray(int n, const void *x, const void *y, int type, int lines, int xform, int w, int h)
 {
   int *bins;
   double roi[4];
@@ -12123,19 +12507,19 @@ void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
   if (n <= 2)
     {
       fprintf(stderr, "invalid number of points\n");
-      return;
+      return 0;
     }
 
   if (xform < 0 || xform > 5)
     {
       fprintf(stderr, "invalid transfer function\n");
-      return;
+      return 0;
     }
 
   if (w < 1 || h < 1)
     {
       fprintf(stderr, "invalid dimensions\n");
-      return;
+      return 0;
     }
 
   check_autoinit;
@@ -12146,12 +12530,65 @@ void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
   roi[3] = lx.ymax;
   bins = (int *)xcalloc(w * h, sizeof(int));
 
-  gr_shade(n, x, y, 0, xform, roi, w, h, bins);
+  gr_shade_accumulate(n, x, y, type, lines, roi, w, h, bins, shade_threads());
+  gr_shade_transfer(w, h, bins, xform);
 
   gks_cellarray(lx.xmin, lx.ymax, lx.xmax, lx.ymin, w, h, 1, 1, w, h, bins);
 
   free(bins);
 
+  return 1;
+}
+
+static void print_single_array(char *name, int n, float *data)
+{
+  double *values;
+  int i;
+
+  values = (double *)xmalloc(n * sizeof(double));
+  for (i = 0; i < n; i++) values[i] = data[i];
+  print_float_array(name, n, values);
+  free(values);
+}
+
+/*!
+ * Display a point set as a aggregated and rasterized image.
+ *
+ * \param[in] n The number of points
+ * \param[in] x A pointer to the X coordinates
+ * \param[in] y A pointer to the Y coordinates
+ * \param[in] xform The transformation type used for color mapping
+ * \param[in] w The width of the grid used for rasterization
+ * \param[in] h The height of the grid used for rasterization
+ *
+ * The values for `x` and `y` are in world coordinates.
+ * Large point sets are distributed over the number of threads set with `gr_setthreadnumber` (by default, all
+ * available processors).
+ *
+ * \verbatim embed:rst:leading-asterisk
+ *
+ * The available transformation types are:
+ *
+ * +----------------+---+--------------------+
+ * |XFORM_BOOLEAN   |  0|boolean             |
+ * +----------------+---+--------------------+
+ * |XFORM_LINEAR    |  1|linear              |
+ * +----------------+---+--------------------+
+ * |XFORM_LOG       |  2|logarithmic         |
+ * +----------------+---+--------------------+
+ * |XFORM_LOGLOG    |  3|double logarithmic  |
+ * +----------------+---+--------------------+
+ * |XFORM_CUBIC     |  4|cubic               |
+ * +----------------+---+--------------------+
+ * |XFORM_EQUALIZED |  5|histogram equalized |
+ * +----------------+---+--------------------+
+ *
+ * \endverbatim
+ */
+void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
+{
+  if (!shade_cellarray(n, x, y, SHADE_DOUBLE, 0, xform, w, h)) return;
+
   if (flag_stream)
     {
       gr_writestream("<shadepoints len=\"%d\"", n);
@@ -12161,6 +12598,25 @@ void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
     }
 }
 
+/*!
+ * Display a point set given in single precision as a aggregated and rasterized image.
+ *
+ * This function behaves like `gr_shadepoints`, but takes `float` coordinates, which halves the memory needed for
+ * very large data sets.
+ */
+void gr_shadepointsf(int n, float *x, float *y, int xform, int w, int h)
+{
+  if (!shade_cellarray(n, x, y, SHADE_FLOAT, 0, xform, w, h)) return;
+
+  if (flag_stream)
+    {
+      gr_writestream("<shadepoints len=\"%d\"", n);
+      print_single_array("x", n, x);
+      print_single_array("y", n, y);
+      gr_writestream(" xform=\"%d\" w=\"%d\" h=\"%d\"/>\n", xform, w, h);
+    }
+}
+
 /*!
  * Display a line set as a aggregated and rasterized image.
  *
@@ -12173,6 +12629,7 @@ void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
  *
  * The values for `x` and `y` are in world coordinates.
  * NaN values can be used to separate the point set into line segments.
+ * The segments are rasterized in parallel, see `gr_shadepoints`.
  *
  * \verbatim embed:rst:leading-asterisk
  *
@@ -12196,21 +12653,48 @@ void gr_shadepoints(int n, double *x, double *y, int xform, int w, int h)
  */
 void gr_shadelines(int n, double *x, double *y, int xform, int w, int h)
 {
-  int *bins;
-  double roi[4];
+  if (!shade_cellarray(n, x, y, SHADE_DOUBLE, 1, xform, w, h)) return;
 
-  if (n <= 2)
+  if (flag_stream)
     {
-      fprintf(stderr, "invalid number of points\n");
-      return;
+      gr_writestream("<shadelines len=\"%d\"", n);
+      print_float_array("x", n, x);
+      print_float_array("y", n, y);
+      gr_writestream(" xform=\"%d\" w=\"%d\" h=\"%d\"/>\n", xform, w, h);
     }
+}
 
-  if (xform < 0 || xform > 5)
+/*!
+ * Display a line set given in single precision as a aggregated and rasterized image.
+ *
+ * This function behaves like `gr_shadelines`, but takes `float` coordinates, which halves the memory needed for
+ * very large data sets.
+ */
+void gr_shadelinesf(int n, float *x, float *y, int xform, int w, int h)
+{
+  if (!shade_cellarray(n, x, y, SHADE_FLOAT, 1, xform, w, h)) return;
+
+  if (flag_stream)
     {
-      fprintf(stderr, "invalid transfer function\n");
-      return;
+      gr_writestream("<shadelines len=\"%d\"", n);
+      print_single_array("x", n, x);
+      print_single_array("y", n, y);
+      gr_writestream(" xform=\"%d\" w=\"%d\" h=\"%d\"/>\n", xform, w, h);
     }
+}
 
+/*!
+ * Start the aggregation of a point or line set that is passed in chunks.
+ *
+ * \param[in] w The width of the grid used for rasterization
+ * \param[in] h The height of the grid used for rasterization
+ *
+ * The current window is used as region of interest. The data is then passed with any number of calls to
+ * `gr_shadechunk` or `gr_shadechunkf` and displayed with `gr_endshade`. Only the w x h grid is kept in memory,
+ * so data sets that do not fit into memory can be shaded while they are read from disk.
+ */
+void gr_beginshade(int w, int h)
+{
   if (w < 1 || h < 1)
     {
       fprintf(stderr, "invalid dimensions\n");
@@ -12219,25 +12703,99 @@ void gr_shadelines(int n, double *x, double *y, int xform, int w, int h)
 
   check_autoinit;
 
-  roi[0] = lx.xmin;
-  roi[1] = lx.xmax;
-  roi[2] = lx.ymin;
-  roi[3] = lx.ymax;
-  bins = (int *)xcalloc(w * h, sizeof(int));
+  if (sh.bins != NULL) free(sh.bins);
 
-  gr_shade(n, x, y, 1, xform, roi, w, h, bins);
+  sh.w = w;
+  sh.h = h;
+  sh.bins = (int *)xcalloc(w * h, sizeof(int));
+  sh.roi[0] = lx.xmin;
+  sh.roi[1] = lx.xmax;
+  sh.roi[2] = lx.ymin;
+  sh.roi[3] = lx.ymax;
+  sh.pending = 0;
+}
 
-  gks_cellarray(lx.xmin, lx.ymax, lx.xmax, lx.ymin, w, h, 1, 1, w, h, bins);
+static void shade_chunk(int n, const void *x, const void *y, int type, int lines)
+{
+  double xj[2], yj[2];
 
-  free(bins);
+  if (sh.bins == NULL)
+    {
+      fprintf(stderr, "no shading in progress\n");
+      return;
+    }
 
-  if (flag_stream)
+  if (n < 1) return;
+
+  if (lines && sh.pending)
     {
-      gr_writestream("<shadelines len=\"%d\"", n);
-      print_float_array("x", n, x);
-      print_float_array("y", n, y);
-      gr_writestream(" xform=\"%d\" w=\"%d\" h=\"%d\"/>\n", xform, w, h);
+      /* connect the last point of the previous chunk with the first point of this one */
+      xj[0] = sh.x;
+      yj[0] = sh.y;
+      xj[1] = type == SHADE_FLOAT ? ((const float *)x)[0] : ((const double *)x)[0];
+      yj[1] = type == SHADE_FLOAT ? ((const float *)y)[0] : ((const double *)y)[0];
+      gr_shade_accumulate(2, xj, yj, SHADE_DOUBLE, 1, sh.roi, sh.w, sh.h, sh.bins, 1);
+    }
+
+  gr_shade_accumulate(n, x, y, type, lines, sh.roi, sh.w, sh.h, sh.bins, shade_threads());
+
+  sh.pending = lines;
+  if (lines)
+    {
+      sh.x = type == SHADE_FLOAT ? ((const float *)x)[n - 1] : ((const double *)x)[n - 1];
+      sh.y = type == SHADE_FLOAT ? ((const float *)y)[n - 1] : ((const double *)y)[n - 1];
+    }
+}
+
+/*!
+ * Add a chunk of points or lines to the aggregation started with `gr_beginshade`.
+ *
+ * \param[in] n The number of points
+ * \param[in] x A pointer to the X coordinates
+ * \param[in] y A pointer to the Y coordinates
+ * \param[in] lines 1 to rasterize the lines between consecutive points, 0 to rasterize the points only
+ *
+ * Lines continue from the last point of the previous chunk, a NaN value can be used to separate them.
+ */
+void gr_shadechunk(int n, double *x, double *y, int lines)
+{
+  shade_chunk(n, x, y, SHADE_DOUBLE, lines);
+}
+
+/*!
+ * Add a chunk of points or lines given in single precision to the aggregation started with `gr_beginshade`.
+ */
+void gr_shadechunkf(int n, float *x, float *y, int lines)
+{
+  shade_chunk(n, x, y, SHADE_FLOAT, lines);
+}
+
+/*!
+ * Display the data passed since `gr_beginshade` as a aggregated and rasterized image.
+ *
+ * \param[in] xform The transformation type used for color mapping, see `gr_shadepoints`
+ */
+void gr_endshade(int xform)
+{
+  if (sh.bins == NULL)
+    {
+      fprintf(stderr, "no shading in progress\n");
+      return;
     }
+
+  if (xform < 0 || xform > 5)
+    {
+      fprintf(stderr, "invalid transfer function\n");
+      return;
+    }
+
+  gr_shade_transfer(sh.w, sh.h, sh.bins, xform);
+
+  /* the grid is displayed (and streamed) as a regular cell array, so a replay of the stream draws the same image */
+  gr_cellarray(sh.roi[0], sh.roi[1], sh.roi[2], sh.roi[3], sh.w, sh.h, 1, 1, sh.w, sh.h, sh.bins);
+
+  free(sh.bins);
+  sh.bins = NULL;
 }
 
 void gr_panzoom(double x, double y, double xzoom, double yzoom, double *xmin, double *xmax, double *ymin, double *ymax)
@@ -13096,7 +13654,7 @@ static void bilinear_interpolation(double c00, double c10, double c01, double c1
 
 /*!
  * Set the number of threads which can run parallel. The default value is the number of threads the cpu has.
- * The only usage right now is inside `gr_cpubasedvolume` and `gr_volume_nogrid`.
+ * It is used by `gr_cpubasedvolume`, `gr_volume_nogrid`, `gr_shadepoints` and `gr_shadelines`.
  *
  * \param[in] num number of threads
  */
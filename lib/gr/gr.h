@@ -62,6 +62,9 @@ typedef struct
   double grid_z_re; /*!< Reciproke of interpolation kernel extent in z-direction */
 } tri_linear_t;
 
+/*! Multi-resolution min/max index for `gr_reducelod` and `gr_polylinelod` */
+typedef struct gr_lod gr_lod_t;
+
 
 DLLEXPORT void gr_initgr(void);
 DLLEXPORT int gr_debug(void);
@@ -213,6 +216,10 @@ DLLEXPORT void gr_destroycontext(int);
 DLLEXPORT int gr_uselinespec(char *);
 DLLEXPORT void gr_delaunay(int, const double *, const double *, int *, int **);
 DLLEXPORT void gr_reducepoints(int, const double *, const double *, int, double *, double *);
+DLLEXPORT gr_lod_t *gr_createlod(int, const double *, const double *);
+DLLEXPORT int gr_reducelod(gr_lod_t *, double, double, int, double *, double *);
+DLLEXPORT void gr_polylinelod(gr_lod_t *);
+DLLEXPORT void gr_destroylod(gr_lod_t *);
 DLLEXPORT void gr_trisurface(int, double *, double *, double *);
 DLLEXPORT void gr_gradient(int, int, double *, double *, double *, double *, double *);
 DLLEXPORT void gr_quiver(int, int, double *, double *, double *, double *, int);
@@ -221,7 +228,13 @@ DLLEXPORT void gr_interp2(int nx, int ny, const double *x, const double *y, cons
 DLLEXPORT const char *gr_version(void);
 DLLEXPORT void gr_shade(int, double *, double *, int, int, double *, int, int, int *);
 DLLEXPORT void gr_shadepoints(int, double *, double *, int, int, int);
+DLLEXPORT void gr_shadepointsf(int, float *, float *, int, int, int);
 DLLEXPORT void gr_shadelines(int, double *, double *, int, int, int);
+DLLEXPORT void gr_shadelinesf(int, float *, float *, int, int, int);
+DLLEXPORT void gr_beginshade(int, int);
+DLLEXPORT void gr_shadechunk(int, double *, double *, int);
+DLLEXPORT void gr_shadechunkf(int, float *, float *, int);
+DLLEXPORT void gr_endshade(int);
 DLLEXPORT void gr_panzoom(double, double, double, double, double *, double *, double *, double *);
 DLLEXPORT int gr_findboundary(int, double *, double *, double, double (*)(double, double), int, int *);
 DLLEXPORT void gr_setresamplemethod(unsigned int);
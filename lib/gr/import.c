@@ -177,9 +177,78 @@ static double ascii2double(const char *s)
     return atof(s);
 }
 
+static unsigned char base64_table[256];
+
+static unsigned char *base64_array(char *attr, char type, int width, int *n)
+
+/*
+ * Decode an array attribute written as "base64:<type><count>:<data>" in
+ * place and convert the little-endian values to host byte order
+ */
+
+{
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  unsigned char *data, v, t;
+  unsigned int acc = 0;
+  int i, j, bits = 0, nbytes = 0, little_endian = 1;
+  char *s;
+
+  little_endian = *(char *)&little_endian;
+  if (base64_table['A'] == 0)
+    for (i = 0; i < 64; i++) base64_table[(unsigned char)digits[i]] = i + 1;
+
+  *n = 0;
+  if (attr[7] != type)
+    {
+      fprintf(stderr, "base64 array of type '%c' expected\n", type);
+      return NULL;
+    }
+  *n = strtol(attr + 8, &s, 10);
+  if (*s != ':' || *n < 0)
+    {
+      fprintf(stderr, "invalid base64 array header\n");
+      *n = 0;
+      return NULL;
+    }
+
+  data = (unsigned char *)++s;
+  for (; *s; s++)
+    {
+      v = base64_table[(unsigned char)*s];
+      if (v == 0) continue;
+      acc = (acc << 6) | (v - 1);
+      bits += 6;
+      if (bits >= 8)
+        {
+          bits -= 8;
+          data[nbytes++] = (acc >> bits) & 0xff;
+          acc &= (1 << bits) - 1;
+        }
+    }
+  if (nbytes < *n * width * (type == 'v' ? 2 : 1))
+    {
+      fprintf(stderr, "base64 array too short\n");
+      *n = 0;
+      return NULL;
+    }
+
+  if (!little_endian)
+    for (i = 0; i < nbytes - width + 1; i += width)
+      for (j = 0; j < width / 2; j++)
+        {
+          t = data[i + j];
+          data[i + j] = data[i + width - 1 - j];
+          data[i + width - 1 - j] = t;
+        }
+
+  return data;
+}
+
 static char *xml(char *s, char *fmt)
 {
   char *attr, *p;
+  unsigned char *data;
+  int n;
 
   i_argc = i_arrp = i_arrc = 0;
   f_argc = f_arrp = f_arrc = 0;
@@ -215,6 +284,18 @@ static char *xml(char *s, char *fmt)
                           s_arg[s_argc++] = attr;
                           break;
                         case 'I':
+                          if (strncmp(attr, "base64:", 7) == 0)
+                            {
+                              data = base64_array(attr, 'i', sizeof(int), &n);
+                              if (n > i_arr_size[i_arrp])
+                                {
+                                  i_arr_size[i_arrp] = n;
+                                  i_arr[i_arrp] = (int *)xrealloc(i_arr[i_arrp], sizeof(int) * n);
+                                }
+                              if (n > 0) memcpy(i_arr[i_arrp], data, sizeof(int) * n);
+                              i_arrp++;
+                              break;
+                            }
                           p = strtok(attr, " \t\"");
                           while (p != NULL)
                             {
@@ -230,6 +311,18 @@ static char *xml(char *s, char *fmt)
                           i_arrc = 0;
                           break;
                         case 'F':
+                          if (strncmp(attr, "base64:", 7) == 0)
+                            {
+                              data = base64_array(attr, 'd', sizeof(double), &n);
+                              if (n > f_arr_size[f_arrp])
+                                {
+                                  f_arr_size[f_arrp] = n;
+                                  f_arr[f_arrp] = (double *)xrealloc(f_arr[f_arrp], sizeof(double) * n);
+                                }
+                              if (n > 0) memcpy(f_arr[f_arrp], data, sizeof(double) * n);
+                              f_arrp++;
+                              break;
+                            }
                           p = strtok(attr, " \t\"");
                           while (p != NULL)
                             {
@@ -246,6 +339,18 @@ static char *xml(char *s, char *fmt)
                           f_arrc = 0;
                           break;
                         case 'V':
+                          if (strncmp(attr, "base64:", 7) == 0)
+                            {
+                              data = base64_array(attr, 'v', sizeof(double), &n);
+                              if (n > v_arr_size)
+                                {
+                                  v_arr_size = n;
+                                  v_arr = (vertex_t *)xrealloc(v_arr, sizeof(vertex_t) * n);
+                                }
+                              if (n > 0) memcpy(v_arr, data, sizeof(vertex_t) * n);
+                              v_arrc = n;
+                              break;
+                            }
                           p = strtok(attr, " \t\"");
                           while (p != NULL)
                             {
@@ -262,6 +367,18 @@ static char *xml(char *s, char *fmt)
                             }
                           break;
                         case 'B':
+                          if (strncmp(attr, "base64:", 7) == 0)
+                            {
+                              data = base64_array(attr, 'b', 1, &n);
+                              if (n > b_arr_size)
+                                {
+                                  b_arr_size = n;
+                                  b_arr = (unsigned char *)xrealloc(b_arr, n);
+                                }
+                              if (n > 0) memcpy(b_arr, data, n);
+                              b_arrc = n;
+                              break;
+                            }
                           p = strtok(attr, " \t\"");
                           while (p != NULL)
                             {
@@ -15,12 +15,9 @@ Link:
 #include <stdio.h>
 
 #include "gr.h"
+#include "shade.h"
+#include "threadpool.h"
 
-#ifdef isnan
-#define is_nan(a) isnan(a)
-#else
-#define is_nan(x) ((x) != (x))
-#endif
 #ifndef log1p
 #define log1p(x) (log(1 + (x)))
 #endif
@@ -32,7 +29,20 @@ Link:
 #define XFORM_CUBIC 4
 #define XFORM_EQUALIZED 5
 
-static char *xcalloc(int count, int size)
+#define SHADE_BLOCK 256
+#define SHADE_MIN_ITEMS 65536
+#define SHADE_MAX_THREADS 256
+
+typedef struct
+{
+  const void *x, *y;
+  int type, lines, start, end;
+  double xl, xr, yb, yt;
+  int w, h;
+  int *bins;
+} shade_job_t;
+
+static char *xcalloc(size_t count, size_t size)
 {
   char *result = (char *)calloc(count, size);
   if (!result)
@@ -43,47 +53,28 @@ static char *xcalloc(int count, int size)
   return (result);
 }
 
-static void rasterize(int n, double *x, double *y, double *roi, int w, int h, int *bins)
-{
-  double xl, xr, yb, yt;
-  int i, ix, iy, num_bins = w * h;
-
-  xl = roi[0];
-  xr = roi[1];
-  yb = roi[2];
-  yt = roi[3];
-
-  for (i = 0; i < num_bins; i++) bins[i] = 0;
-
-  for (i = 0; i < n; i++)
-    {
-      if (x[i] >= roi[0] && x[i] <= roi[1] && y[i] >= roi[2] && y[i] <= roi[3])
-        {
-          ix = (int)((x[i] - xl) / (xr - xl) * (w - 1) + 0.5);
-          iy = (int)((y[i] - yb) / (yt - yb) * (h - 1) + 0.5);
-          bins[(h - iy - 1) * w + ix] += 1;
-        }
-    }
-}
-
-static void equalize(int w, int h, int *bins, int bmax)
+static void equalize(size_t num_bins, int *bins, int bmax)
 {
-  int *hist, num_bins = w * h, i, *lut;
+  int *hist, *lut, level;
+  size_t num_levels, i;
   double sum = 0, scale;
 
-  hist = (int *)xcalloc(bmax + 1, sizeof(int));
+  if (bmax < 0) return;
+  num_levels = (size_t)bmax + 1;
+
+  hist = (int *)xcalloc(num_levels, sizeof(int));
   for (i = 0; i < num_bins; i++) hist[bins[i]] += 1;
 
-  i = 0;
-  while (hist[i] == 0 && i < bmax) i++;
+  level = 0;
+  while (hist[level] == 0 && level < bmax) level++;
 
-  lut = (int *)xcalloc(bmax + 1, sizeof(int));
-  scale = 255.0 / (num_bins - hist[i]);
-  while (i < bmax)
+  lut = (int *)xcalloc(num_levels, sizeof(int));
+  scale = 255.0 / (double)(num_bins - (size_t)hist[level]);
+  while (level < bmax)
     {
-      i++;
-      sum += hist[i];
-      lut[i] = (int)(sum * scale);
+      level++;
+      sum += hist[level];
+      lut[level] = (int)(sum * scale);
     }
 
   for (i = 0; i < num_bins; i++) bins[i] = lut[bins[i]];
@@ -92,9 +83,13 @@ static void equalize(int w, int h, int *bins, int bmax)
   free(hist);
 }
 
-static void shade(int w, int h, int *bins, int xform)
+void gr_shade_transfer(int w, int h, int *bins, int xform)
 {
-  int num_bins = w * h, bmin, bmax, i;
+  size_t num_bins, i;
+  int bmin, bmax;
+
+  if (w < 1 || h < 1) return;
+  num_bins = (size_t)w * h;
 
   bmin = INT32_MAX;
   bmax = -INT32_MAX;
@@ -109,7 +104,7 @@ static void shade(int w, int h, int *bins, int xform)
 
   if (xform == XFORM_EQUALIZED) /* equalize */
     {
-      equalize(w, h, bins, bmax);
+      equalize(num_bins, bins, bmax);
     }
   else
     {
@@ -203,48 +198,172 @@ static void line(int x0, int y0, int x1, int y1, int w, int h, int *bins)
     }
 }
 
-void gr_shade(int n, double *x, double *y, int lines, int xform, double *roi, int w, int h, int *bins)
+static void bin_indices(shade_job_t *job, int start, int count, int *ix, int *iy)
 {
-  double xl, xr, yb, yt;
-  int i, j, x0, y0, x1, y1, num_bins = w * h;
-
-  if (lines == 1)
+  double xl = job->xl, xr = job->xr, yb = job->yb, yt = job->yt;
+  double dx = xr - xl, dy = yt - yb, sx = job->w - 1, sy = job->h - 1, xs, ys, tx, ty;
+  int k, jx, jy;
+
+  /* Both loops are free of calls and real branches, so they can be vectorized. The bin coordinates are clamped
+   * before the conversion, which keeps it defined and lets the compiler evaluate them for every point instead of
+   * moving the arithmetic behind the range check. Points outside the region of interest and NaNs get the index -1. */
+  if (job->type == SHADE_FLOAT)
+    {
+      const float *x = (const float *)job->x + start, *y = (const float *)job->y + start;
+      for (k = 0; k < count; k++)
+        {
+          xs = x[k];
+          ys = y[k];
+          tx = (xs - xl) / dx * sx + 0.5;
+          ty = (ys - yb) / dy * sy + 0.5;
+          tx = tx > -1 ? tx : -1;
+          tx = tx < sx + 1 ? tx : sx + 1;
+          ty = ty > -1 ? ty : -1;
+          ty = ty < sy + 1 ? ty : sy + 1;
+          jx = (int)tx;
+          jy = (int)ty;
+          if (!(xs >= xl && xs <= xr && ys >= yb && ys <= yt)) jx = jy = -1;
+          ix[k] = jx;
+          iy[k] = jy;
+        }
+    }
+  else
     {
-      xl = roi[0];
-      xr = roi[1];
-      yb = roi[2];
-      yt = roi[3];
+      const double *x = (const double *)job->x + start, *y = (const double *)job->y + start;
+      for (k = 0; k < count; k++)
+        {
+          xs = x[k];
+          ys = y[k];
+          tx = (xs - xl) / dx * sx + 0.5;
+          ty = (ys - yb) / dy * sy + 0.5;
+          tx = tx > -1 ? tx : -1;
+          tx = tx < sx + 1 ? tx : sx + 1;
+          ty = ty > -1 ? ty : -1;
+          ty = ty < sy + 1 ? ty : sy + 1;
+          jx = (int)tx;
+          jy = (int)ty;
+          if (!(xs >= xl && xs <= xr && ys >= yb && ys <= yt)) jx = jy = -1;
+          ix[k] = jx;
+          iy[k] = jy;
+        }
+    }
+}
 
-      for (i = 0; i < num_bins; i++) bins[i] = 0;
+static void accumulate(shade_job_t *job)
+{
+  int ix[SHADE_BLOCK + 1], iy[SHADE_BLOCK + 1];
+  int i, k, count, w = job->w, h = job->h, *bins = job->bins;
 
-      i = 0;
-      while (i < n)
+  for (i = job->start; i < job->end; i += count)
+    {
+      count = job->end - i < SHADE_BLOCK ? job->end - i : SHADE_BLOCK;
+      if (job->lines)
         {
-          j = i + 1;
-          while (j < n && !is_nan(x[j]) && !is_nan(y[j])) j++;
-          j--;
-
-          while (i < j)
+          /* segment k connects the points k and k + 1, a NaN on either side breaks the line */
+          bin_indices(job, i, count + 1, ix, iy);
+          for (k = 0; k < count; k++)
             {
-              if (x[i] >= xl && x[i] <= xr && y[i] >= yb && y[i] <= yt && x[i + 1] >= xl && x[i + 1] <= xr &&
-                  y[i + 1] >= yb && y[i + 1] <= yt)
-                {
-                  x0 = (int)((x[i] - xl) / (xr - xl) * (w - 1) + 0.5);
-                  y0 = (int)((y[i] - yb) / (yt - yb) * (h - 1) + 0.5);
-                  x1 = (int)((x[i + 1] - xl) / (xr - xl) * (w - 1) + 0.5);
-                  y1 = (int)((y[i + 1] - yb) / (yt - yb) * (h - 1) + 0.5);
-                  line(x0, y0, x1, y1, w, h, bins);
-                }
-              i++;
+              if (ix[k] >= 0 && ix[k + 1] >= 0) line(ix[k], iy[k], ix[k + 1], iy[k + 1], w, h, bins);
+            }
+        }
+      else
+        {
+          bin_indices(job, i, count, ix, iy);
+          for (k = 0; k < count; k++)
+            {
+              if (ix[k] >= 0) bins[(h - iy[k] - 1) * w + ix[k]] += 1;
             }
-
-          i += 2;
         }
     }
-  else
+}
+
+#ifndef NO_THREADS
+static void accumulate_job(void *arg)
+{
+  accumulate((shade_job_t *)arg);
+}
+#endif
+
+/*
+ * Add the points (or the line segments between consecutive points) to the bins of a w x h grid covering the region
+ * of interest. The bins are not cleared, so the function can be called repeatedly for chunks of a larger data set.
+ * The coordinates are either double or float arrays, depending on `type`. With more than one thread, every thread
+ * accumulates a contiguous range of the input into its own grid and the grids are summed up afterwards; the number
+ * of threads is reduced for small inputs where the reduction would dominate.
+ */
+void gr_shade_accumulate(int n, const void *x, const void *y, int type, int lines, double *roi, int w, int h,
+                         int *bins, int num_threads)
+{
+  shade_job_t *jobs;
+#ifndef NO_THREADS
+  threadpool_t *tp;
+#endif
+  int num_items = lines ? n - 1 : n, num_bins = w * h, i, t;
+
+  if (num_items <= 0 || num_bins <= 0) return;
+
+#ifdef NO_THREADS
+  num_threads = 1;
+#endif
+  if (num_threads > SHADE_MAX_THREADS) num_threads = SHADE_MAX_THREADS;
+  if (num_threads > num_items / SHADE_MIN_ITEMS) num_threads = num_items / SHADE_MIN_ITEMS;
+  if (num_threads > num_items / num_bins) num_threads = num_items / num_bins;
+  if (num_threads < 1) num_threads = 1;
+
+  jobs = (shade_job_t *)xcalloc(num_threads, sizeof(shade_job_t));
+  for (t = 0; t < num_threads; t++)
+    {
+      jobs[t].x = x;
+      jobs[t].y = y;
+      jobs[t].type = type;
+      jobs[t].lines = lines;
+      jobs[t].start = (int)((double)num_items * t / num_threads);
+      jobs[t].end = (int)((double)num_items * (t + 1) / num_threads);
+      jobs[t].xl = roi[0];
+      jobs[t].xr = roi[1];
+      jobs[t].yb = roi[2];
+      jobs[t].yt = roi[3];
+      jobs[t].w = w;
+      jobs[t].h = h;
+      jobs[t].bins = t == 0 ? bins : (int *)xcalloc(num_bins, sizeof(int));
+    }
+
+  if (num_threads == 1)
+    {
+      accumulate(jobs);
+      free(jobs);
+      return;
+    }
+
+#ifndef NO_THREADS
+  /* the calling thread takes the first job, threadpool_destroy waits for the others and frees the pool */
+  tp = (threadpool_t *)xcalloc(1, sizeof(threadpool_t));
+  threadpool_create(tp, num_threads - 1, accumulate_job);
+  for (t = 1; t < num_threads; t++) threadpool_add_work(tp, jobs + t);
+  accumulate(jobs);
+  threadpool_destroy(tp);
+#endif
+
+  for (t = 1; t < num_threads; t++)
     {
-      rasterize(n, x, y, roi, w, h, bins);
+      for (i = 0; i < num_bins; i++) bins[i] += jobs[t].bins[i];
+      free(jobs[t].bins);
     }
+  free(jobs);
+}
+
+void gr_shade(int n, double *x, double *y, int lines, int xform, double *roi, int w, int h, int *bins)
+{
+  int i, num_bins = w * h;
+
+  if (w < 1 || h < 1)
+    {
+      fprintf(stderr, "invalid dimensions\n");
+      return;
+    }
+
+  for (i = 0; i < num_bins; i++) bins[i] = 0;
 
-  shade(w, h, bins, xform);
+  gr_shade_accumulate(n, x, y, SHADE_DOUBLE, lines == 1, roi, w, h, bins, 1);
+  gr_shade_transfer(w, h, bins, xform);
 }
@@ -0,0 +1,19 @@
+#ifndef _SHADE_H_
+#define _SHADE_H_
+
+#define SHADE_DOUBLE 0
+#define SHADE_FLOAT 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void gr_shade_accumulate(int n, const void *x, const void *y, int type, int lines, double *roi, int w, int h,
+                         int *bins, int num_threads);
+void gr_shade_transfer(int w, int h, int *bins, int xform);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -165,10 +165,8 @@ static int sendstream(char *string)
   return status;
 }
 
-static void append(char *string)
+static void append(const char *string, int len)
 {
-  int len = strlen(string);
-
   if (buffer == NULL)
     {
       buffer = (char *)malloc(BUFSIZ + 1);
@@ -178,7 +176,7 @@ static void append(char *string)
 
   if (nbytes + len > size)
     {
-      while (nbytes + len > size) size += BUFSIZ;
+      while (nbytes + len > size) size *= 2;
 
       buffer = (char *)realloc(buffer, size + 1);
     }
@@ -243,7 +241,14 @@ void gr_writestream(char *string, ...)
         fprintf(stdout, "%s", s);
     }
 
-  if (stream != NULL) append(s);
+  if (stream != NULL) append(s, strlen(s));
+}
+
+void gr_writestreamdata(const char *data, int len)
+{
+  if (gr_debug()) fwrite(data, len, 1, stdout);
+
+  if (stream != NULL) append(data, len);
 }
 
 void gr_flushstream(int discard)